@@ -0,0 +1,153 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QTest>
+#include <QTemporaryFile>
+
+#include "solid/devices/backends/udev/cpuinfo.h"
+
+using namespace Solid::Backends::UDev;
+
+class CpuInfoTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testX86();
+    void testArm();
+    void testRefresh();
+    void benchmarkManyProcessors();
+
+private:
+    static QByteArray x86Processor(int number, const QByteArray &mhz);
+    static void writeFixture(QTemporaryFile *file, const QByteArray &contents);
+};
+
+QByteArray CpuInfoTest::x86Processor(int number, const QByteArray &mhz)
+{
+    return "processor\t: " + QByteArray::number(number) + "\n"
+           "vendor_id\t: GenuineIntel\n"
+           "cpu family\t: 6\n"
+           "model\t\t: 62\n"
+           "model name\t: Intel(R) Xeon(R) CPU E5-2697 v2 @ 2.70GHz\n"
+           "stepping\t: 4\n"
+           "cpu MHz\t\t: " + mhz + "\n"
+           "cache size\t: 30720 KB\n"
+           "physical id\t: " + QByteArray::number(number / 24) + "\n"
+           "core id\t\t: " + QByteArray::number(number % 12) + "\n"
+           "flags\t\t: fpu vme de pse tsc msr pae mce cx8 apic sep mtrr pge mca cmov pat pse36 clflush dts acpi mmx fxsr sse sse2 ss ht tm pbe syscall nx pdpe1gb rdtscp lm constant_tsc\n"
+           "bogomips\t: 5400.12\n"
+           "power management:\n"
+           "\n";
+}
+
+void CpuInfoTest::writeFixture(QTemporaryFile *file, const QByteArray &contents)
+{
+    QVERIFY(file->isOpen() || file->open());
+    QVERIFY(file->resize(0));
+    QVERIFY(file->seek(0));
+    QCOMPARE(file->write(contents), qint64(contents.size()));
+    QVERIFY(file->flush());
+}
+
+void CpuInfoTest::testX86()
+{
+    QTemporaryFile file;
+    writeFixture(&file, x86Processor(0, "1200.000") + x86Processor(1, "2699.812"));
+
+    CpuInfo info(file.fileName());
+    QCOMPARE(info.processorCount(), 2);
+    QCOMPARE(info.vendor(1), QString("GenuineIntel"));
+    QCOMPARE(info.model(0), QString("Intel(R) Xeon(R) CPU E5-2697 v2 @ 2.70GHz"));
+    QCOMPARE(info.currentSpeed(0), 1200);
+    QCOMPARE(info.currentSpeed(1), 2699);
+
+    QCOMPARE(info.vendor(2), QString());
+    QCOMPARE(info.currentSpeed(2), 0);
+}
+
+void CpuInfoTest::testArm()
+{
+    // Older ARM kernels only describe the machine, not each processor
+    QTemporaryFile file;
+    writeFixture(&file, "Processor\t: ARMv7 Processor rev 10 (v7l)\n"
+                        "processor\t: 0\n"
+                        "BogoMIPS\t: 1581.05\n"
+                        "\n"
+                        "processor\t: 1\n"
+                        "BogoMIPS\t: 1581.05\n"
+                        "\n"
+                        "Features\t: swp half thumb fastmult vfp edsp neon vfpv3 tls\n"
+                        "Hardware\t: Freescale i.MX 6Quad SABRE Smart Device Board\n"
+                        "Revision\t: 0000\n");
+
+    CpuInfo info(file.fileName());
+    QCOMPARE(info.processorCount(), 2);
+    QCOMPARE(info.vendor(1), QString("Freescale i.MX 6Quad SABRE Smart Device Board"));
+    QCOMPARE(info.model(0), QString("ARMv7 Processor rev 10 (v7l)"));
+    QCOMPARE(info.currentSpeed(1), 0);
+}
+
+void CpuInfoTest::testRefresh()
+{
+    QTemporaryFile file;
+    writeFixture(&file, x86Processor(0, "1200.000"));
+    CpuInfo info(file.fileName());
+    QCOMPARE(info.currentSpeed(0), 1200);
+    QCOMPARE(info.processorCount(), 1);
+
+    // The table is a snapshot until refreshed
+    writeFixture(&file, x86Processor(0, "2700.000"));
+    QCOMPARE(info.currentSpeed(0), 1200);
+    info.refresh();
+    QCOMPARE(info.currentSpeed(0), 2700);
+
+    // Even for a processor brought online since
+    writeFixture(&file, x86Processor(0, "2700.000") + x86Processor(1, "1200.000"));
+    QCOMPARE(info.vendor(1), QString());
+    QCOMPARE(info.processorCount(), 1);
+    info.refresh();
+    QCOMPARE(info.vendor(1), QString("GenuineIntel"));
+    QCOMPARE(info.processorCount(), 2);
+    QCOMPARE(info.currentSpeed(1), 1200);
+}
+
+void CpuInfoTest::benchmarkManyProcessors()
+{
+    const int processors = 512;
+
+    QByteArray contents;
+    for (int i = 0; i < processors; ++i) {
+        contents += x86Processor(i, "2699.812");
+    }
+    QTemporaryFile file;
+    writeFixture(&file, contents);
+
+    // What describing every processor costs: one parse, then lookups
+    QBENCHMARK {
+        CpuInfo info(file.fileName());
+        for (int i = 0; i < processors; ++i) {
+            QVERIFY(!info.vendor(i).isEmpty());
+            QVERIFY(!info.model(i).isEmpty());
+            QCOMPARE(info.currentSpeed(i), 2699);
+        }
+    }
+}
+
+QTEST_GUILESS_MAIN(CpuInfoTest)
+
+#include "cpuinfotest.moc"
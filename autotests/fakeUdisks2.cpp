@@ -0,0 +1,410 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fakeUdisks2.h"
+
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusObjectPath>
+#include <QDBusVariant>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
+
+FakeUdisks2::FakeUdisks2(QObject *parent)
+    : QDBusVirtualObject(parent)
+    , m_callCount(0)
+    , m_latency(0)
+    , m_replyDelay(0)
+    , m_nextDeviceNumber(2048)
+{
+    qDBusRegisterMetaType<VariantMapMap>();
+    qDBusRegisterMetaType<DBUSManagerStruct>();
+    qDBusRegisterMetaType<ByteArrayList>();
+}
+
+bool FakeUdisks2::registerOn(QDBusConnection connection)
+{
+    m_connectionName = connection.name();
+    return connection.registerService(QStringLiteral(UD2_DBUS_SERVICE))
+           && connection.registerVirtualObject(QStringLiteral(UD2_DBUS_PATH), this, QDBusConnection::SubPath);
+}
+
+QString FakeUdisks2::addDrive(const QString &name, bool optical)
+{
+    const QString path = QStringLiteral(UD2_DBUS_PATH_DRIVES) + name;
+
+    QVariantMap drive;
+    drive["Vendor"] = QStringLiteral("Solid");
+    drive["Model"] = name;
+    drive["Serial"] = name;
+    drive["Revision"] = QStringLiteral("1.0");
+    drive["ConnectionBus"] = optical ? QStringLiteral("usb") : QString();
+    drive["Size"] = optical ? qulonglong(0) : qulonglong(500107862016ULL);
+    drive["Removable"] = optical;
+    drive["MediaRemovable"] = optical;
+    drive["Ejectable"] = optical;
+    drive["Optical"] = false;
+    drive["OpticalBlank"] = false;
+    drive["MediaCompatibility"] = optical ? (QStringList() << "optical_cd" << "optical_dvd") : QStringList();
+    drive["RotationRate"] = optical ? -1 : 7200;
+
+    m_objects[path].insert(QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), drive);
+
+    return path;
+}
+
+QString FakeUdisks2::addBlockDevice(const QString &name, const QString &drive, bool partitionTable)
+{
+    const QString path = QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES) + name;
+    const QByteArray deviceFile = "/dev/" + name.toLatin1();
+
+    QVariantMap block;
+    block["Device"] = deviceFile;
+    block["PreferredDevice"] = deviceFile;
+    block["DeviceNumber"] = m_nextDeviceNumber++;
+    block["Drive"] = QVariant::fromValue(QDBusObjectPath(drive.isEmpty() ? QStringLiteral("/") : drive));
+    block["Size"] = m_objects.value(drive).value(QStringLiteral(UD2_DBUS_INTERFACE_DRIVE)).value("Size");
+    block["ReadOnly"] = false;
+    block["IdUsage"] = QString();
+    block["IdType"] = QString();
+    block["IdUUID"] = QString();
+    block["IdLabel"] = QString();
+    block["HintIgnore"] = false;
+    block["HintSystem"] = false;
+    block["HintPartitionable"] = true;
+    block["CryptoBackingDevice"] = QVariant::fromValue(QDBusObjectPath("/"));
+
+    m_objects[path].insert(QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), block);
+
+    if (partitionTable) {
+        QVariantMap table;
+        table["Type"] = QStringLiteral("gpt");
+        m_objects[path].insert(QStringLiteral(UD2_DBUS_INTERFACE_PARTITIONTABLE), table);
+    }
+
+    return path;
+}
+
+QString FakeUdisks2::addPartition(const QString &name, const QString &table, int number, bool filesystem)
+{
+    const QString drive = m_objects.value(table).value(QStringLiteral(UD2_DBUS_INTERFACE_BLOCK)).value("Drive").value<QDBusObjectPath>().path();
+    const QString path = addBlockDevice(name, drive, false);
+    const qulonglong size = 1073741824ULL;
+
+    QVariantMap &block = m_objects[path][QStringLiteral(UD2_DBUS_INTERFACE_BLOCK)];
+    block["Size"] = size;
+
+    QVariantMap partition;
+    partition["Number"] = uint(number);
+    partition["Table"] = QVariant::fromValue(QDBusObjectPath(table));
+    partition["Offset"] = qulonglong(number) * size;
+    partition["Size"] = size;
+    partition["Type"] = QStringLiteral("0fc63daf-8483-4772-8e79-3d69d8477de4");
+    m_objects[path].insert(QStringLiteral(UD2_DBUS_INTERFACE_PARTITION), partition);
+
+    if (filesystem) {
+        block["IdUsage"] = QStringLiteral("filesystem");
+        block["IdType"] = QStringLiteral("ext4");
+
+        QVariantMap fs;
+        fs["MountPoints"] = QVariant::fromValue(ByteArrayList());
+        m_objects[path].insert(QStringLiteral(UD2_DBUS_INTERFACE_FILESYSTEM), fs);
+    }
+
+    return path;
+}
+
+QString FakeUdisks2::addDisk(const QString &name, int partitions, QStringList *objects)
+{
+    const QString drive = addDrive(name);
+    const QString table = addBlockDevice(name, drive);
+    *objects << drive << table;
+
+    for (int part = 1; part <= partitions; ++part) {
+        *objects << addPartition(name + QLatin1Char('p') + QString::number(part), table, part);
+    }
+
+    return drive;
+}
+
+QStringList FakeUdisks2::addDisks(const QString &prefix, int count, int partitions)
+{
+    QStringList objects;
+    for (int i = 0; i < count; ++i) {
+        addDisk(prefix + QString::number(i), partitions, &objects);
+    }
+    return objects;
+}
+
+QString FakeUdisks2::addOpticalDrive(const QString &name)
+{
+    const QString drive = addDrive(name, true);
+    return addBlockDevice(name, drive, false);
+}
+
+QString FakeUdisks2::addClearTextDevice(const QString &name, const QString &backing)
+{
+    const QString path = addBlockDevice(name, QString(), false);
+    m_objects[path][QStringLiteral(UD2_DBUS_INTERFACE_BLOCK)]["CryptoBackingDevice"] = QVariant::fromValue(QDBusObjectPath(backing));
+    return path;
+}
+
+QStringList FakeUdisks2::plugDisk(const QString &name, int partitions)
+{
+    QStringList objects;
+    addDisk(name, partitions, &objects);
+
+    // The drive first, then what is on it, like udisksd does
+    Q_FOREACH (const QString &path, objects) {
+        emitInterfacesAdded(path);
+    }
+
+    return objects;
+}
+
+void FakeUdisks2::unplugDisk(const QString &name)
+{
+    const QString drive = QStringLiteral(UD2_DBUS_PATH_DRIVES) + name;
+    const QString table = QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES) + name;
+
+    // The partitions go first, the drive last
+    QStringList objects;
+    QMap<QString, VariantMapMap>::ConstIterator it = m_objects.constBegin();
+    for (; it != m_objects.constEnd(); ++it) {
+        const QVariantMap block = it.value().value(QStringLiteral(UD2_DBUS_INTERFACE_BLOCK));
+        if (it.key() != table && block.value("Drive").value<QDBusObjectPath>().path() == drive) {
+            objects << it.key();
+        }
+    }
+    objects << table << drive;
+
+    Q_FOREACH (const QString &path, objects) {
+        emitInterfacesRemoved(path);
+        m_objects.remove(path);
+    }
+}
+
+void FakeUdisks2::insertMedia(const QString &block)
+{
+    const QString drive = m_objects.value(block).value(QStringLiteral(UD2_DBUS_INTERFACE_BLOCK)).value("Drive").value<QDBusObjectPath>().path();
+
+    changeProperty(drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("Media"), QStringLiteral("optical_cd"));
+    changeProperty(drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("MediaAvailable"), true);
+    changeProperty(drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("Optical"), true);
+    changeProperty(block, QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), QStringLiteral("Size"), qulonglong(734003200ULL));
+}
+
+void FakeUdisks2::ejectMedia(const QString &block)
+{
+    const QString drive = m_objects.value(block).value(QStringLiteral(UD2_DBUS_INTERFACE_BLOCK)).value("Drive").value<QDBusObjectPath>().path();
+
+    changeProperty(drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("Media"), QString());
+    changeProperty(drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("MediaAvailable"), false);
+    changeProperty(drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("Optical"), false);
+    changeProperty(block, QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), QStringLiteral("Size"), qulonglong(0));
+}
+
+void FakeUdisks2::emitInterfacesAdded(const QString &path)
+{
+    QDBusMessage signal = QDBusMessage::createSignal(QStringLiteral(UD2_DBUS_PATH), QStringLiteral(DBUS_INTERFACE_MANAGER), QStringLiteral("InterfacesAdded"));
+    signal << QVariant::fromValue(QDBusObjectPath(path)) << QVariant::fromValue(m_objects.value(path));
+    QDBusConnection(m_connectionName).send(signal);
+}
+
+void FakeUdisks2::emitInterfacesRemoved(const QString &path)
+{
+    QDBusMessage signal = QDBusMessage::createSignal(QStringLiteral(UD2_DBUS_PATH), QStringLiteral(DBUS_INTERFACE_MANAGER), QStringLiteral("InterfacesRemoved"));
+    signal << QVariant::fromValue(QDBusObjectPath(path)) << QStringList(m_objects.value(path).keys());
+    QDBusConnection(m_connectionName).send(signal);
+}
+
+QStringList FakeUdisks2::objects() const
+{
+    return m_objects.keys();
+}
+
+VariantMapMap FakeUdisks2::interfacesAndProperties(const QString &path) const
+{
+    return m_objects.value(path);
+}
+
+void FakeUdisks2::changeProperty(const QString &path, const QString &interface, const QString &name, const QVariant &value)
+{
+    m_objects[path][interface][name] = value;
+
+    QVariantMap changed;
+    changed.insert(name, value);
+
+    QDBusMessage signal = QDBusMessage::createSignal(path, QStringLiteral(DBUS_INTERFACE_PROPS), QStringLiteral("PropertiesChanged"));
+    signal << interface << changed << QStringList();
+    QDBusConnection(m_connectionName).send(signal);
+}
+
+void FakeUdisks2::addInterface(const QString &path, const QString &interface, const QVariantMap &properties)
+{
+    m_objects[path].insert(interface, properties);
+
+    VariantMapMap added;
+    added.insert(interface, properties);
+
+    QDBusMessage signal = QDBusMessage::createSignal(QStringLiteral(UD2_DBUS_PATH), QStringLiteral(DBUS_INTERFACE_MANAGER), QStringLiteral("InterfacesAdded"));
+    signal << QVariant::fromValue(QDBusObjectPath(path)) << QVariant::fromValue(added);
+    QDBusConnection(m_connectionName).send(signal);
+}
+
+void FakeUdisks2::removeInterface(const QString &path, const QString &interface)
+{
+    m_objects[path].remove(interface);
+    if (m_objects.value(path).isEmpty()) {
+        m_objects.remove(path);
+    }
+
+    QDBusMessage signal = QDBusMessage::createSignal(QStringLiteral(UD2_DBUS_PATH), QStringLiteral(DBUS_INTERFACE_MANAGER), QStringLiteral("InterfacesRemoved"));
+    signal << QVariant::fromValue(QDBusObjectPath(path)) << QStringList(interface);
+    QDBusConnection(m_connectionName).send(signal);
+}
+
+int FakeUdisks2::callCount() const
+{
+    return m_callCount;
+}
+
+int FakeUdisks2::maxPendingCalls() const
+{
+    return m_maxPendingCalls.load();
+}
+
+void FakeUdisks2::resetCallCount()
+{
+    m_callCount = 0;
+    m_maxPendingCalls = 0;
+}
+
+void FakeUdisks2::setLatency(int msec)
+{
+    m_latency = msec;
+}
+
+void FakeUdisks2::setReplyDelay(int msec)
+{
+    m_replyDelay = msec;
+}
+
+bool FakeUdisks2::sendReply(const QDBusConnection &connection, const QDBusMessage &reply)
+{
+    if (m_replyDelay <= 0) {
+        return connection.send(reply);
+    }
+
+    const int pending = m_pendingCalls.fetchAndAddOrdered(1) + 1;
+    int maxPending = m_maxPendingCalls.load();
+    while (pending > maxPending && !m_maxPendingCalls.testAndSetOrdered(maxPending, pending)) {
+        maxPending = m_maxPendingCalls.load();
+    }
+
+    // handleMessage() isn't necessarily called from our thread, the timers run there
+    return QMetaObject::invokeMethod(this, "sendDelayedReply", Qt::QueuedConnection, Q_ARG(QDBusMessage, reply));
+}
+
+void FakeUdisks2::sendDelayedReply(const QDBusMessage &reply)
+{
+    const QString connectionName = m_connectionName;
+    QTimer::singleShot(m_replyDelay, this, [this, connectionName, reply]() {
+        m_pendingCalls.deref();
+        QDBusConnection(connectionName).send(reply);
+    });
+}
+
+QString FakeUdisks2::introspect(const QString &path) const
+{
+    // Only reached when QtDBus answers Introspect without asking handleMessage()
+    ++m_callCount;
+    QThread::msleep(m_latency);
+    return nodeXml(path);
+}
+
+QString FakeUdisks2::nodeXml(const QString &path) const
+{
+    QString xml;
+
+    Q_FOREACH (const QString &iface, m_objects.value(path).keys()) {
+        xml += QStringLiteral("  <interface name=\"%1\"/>\n").arg(iface);
+    }
+
+    // Children, including the intermediate nodes like block_devices
+    const QString prefix = path.endsWith('/') ? path : path + '/';
+    QSet<QString> children;
+    Q_FOREACH (const QString &object, m_objects.keys()) {
+        if (object.startsWith(prefix)) {
+            children << object.mid(prefix.length()).section('/', 0, 0);
+        }
+    }
+    Q_FOREACH (const QString &child, children) {
+        xml += QStringLiteral("  <node name=\"%1\"/>\n").arg(child);
+    }
+
+    return xml;
+}
+
+bool FakeUdisks2::handleMessage(const QDBusMessage &message, const QDBusConnection &connection)
+{
+    ++m_callCount;
+    QThread::msleep(m_latency);
+
+    const QString path = message.path();
+    const QString interface = message.interface();
+    const QString member = message.member();
+    const QList<QVariant> args = message.arguments();
+
+    if (interface == QLatin1String(DBUS_INTERFACE_INTROSPECT) && member == QLatin1String("Introspect")) {
+        const QString xml = QStringLiteral("<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n"
+                                           "\"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n"
+                                           "<node>\n") + nodeXml(path) + QStringLiteral("</node>\n");
+        return sendReply(connection, message.createReply(xml));
+    }
+
+    if (interface == QLatin1String(DBUS_INTERFACE_MANAGER) && member == QLatin1String("GetManagedObjects")) {
+        DBUSManagerStruct managedObjects;
+        QMap<QString, VariantMapMap>::ConstIterator it = m_objects.constBegin();
+        for (; it != m_objects.constEnd(); ++it) {
+            managedObjects.insert(QDBusObjectPath(it.key()), it.value());
+        }
+        return sendReply(connection, message.createReply(QVariant::fromValue(managedObjects)));
+    }
+
+    if (interface == QLatin1String(DBUS_INTERFACE_PROPS)) {
+        if (!m_objects.contains(path)) {
+            return sendReply(connection, message.createErrorReply(QDBusError::UnknownObject, path));
+        }
+
+        const QVariantMap props = m_objects.value(path).value(args.value(0).toString());
+
+        if (member == QLatin1String("GetAll")) {
+            return sendReply(connection, message.createReply(props));
+        } else if (member == QLatin1String("Get")) {
+            const QString name = args.value(1).toString();
+            if (!props.contains(name)) {
+                return sendReply(connection, message.createErrorReply(QDBusError::InvalidArgs, name));
+            }
+            return sendReply(connection, message.createReply(QVariant::fromValue(QDBusVariant(props.value(name)))));
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,112 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_FAKE_UDISKS2_H
+#define SOLID_FAKE_UDISKS2_H
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QDBusConnection>
+#include <QDBusVirtualObject>
+
+#include "solid/devices/backends/udisks2/udisks2.h"
+
+/**
+ * Stand-in for the org.freedesktop.UDisks2 service.
+ *
+ * It serves the whole object tree below /org/freedesktop/UDisks2 by itself,
+ * Introspect included, so it can count every call the backend makes.
+ *
+ * Besides single objects it can publish whole machines worth of storage and
+ * play hotplug and media change storms, emitting the same signals as the
+ * real service, so the backend can be measured without root or real disks.
+ */
+class FakeUdisks2 : public QDBusVirtualObject
+{
+    Q_OBJECT
+public:
+    explicit FakeUdisks2(QObject *parent = 0);
+
+    bool registerOn(QDBusConnection connection);
+
+    QString addDrive(const QString &name, bool optical = false);
+    QString addBlockDevice(const QString &name, const QString &drive, bool partitionTable = true);
+    QString addPartition(const QString &name, const QString &table, int number, bool filesystem = true);
+
+    // Disks named <prefix>N, each with a partition table and its partitions, all objects returned
+    QStringList addDisks(const QString &prefix, int count, int partitions);
+    // An empty optical drive, its block device returned
+    QString addOpticalDrive(const QString &name);
+    // The cleartext device of an unlocked LUKS container
+    QString addClearTextDevice(const QString &name, const QString &backing);
+
+    // Hotplug: like the add* above, but announced with InterfacesAdded / InterfacesRemoved
+    QStringList plugDisk(const QString &name, int partitions);
+    void unplugDisk(const QString &name);
+
+    // Media change on the block device of an optical drive
+    void insertMedia(const QString &block);
+    void ejectMedia(const QString &block);
+
+    QStringList objects() const;
+    VariantMapMap interfacesAndProperties(const QString &path) const;
+
+    // These emit the matching change signals, like the real service does
+    void changeProperty(const QString &path, const QString &interface, const QString &name, const QVariant &value);
+    void addInterface(const QString &path, const QString &interface, const QVariantMap &properties);
+    void removeInterface(const QString &path, const QString &interface);
+
+    int callCount() const;
+    // The most calls ever waiting for their delayed answer at once, see setReplyDelay()
+    int maxPendingCalls() const;
+    // Resets both counters
+    void resetCallCount();
+
+    // Delay each answer, to play a slow service when living in its own thread
+    void setLatency(int msec);
+    // Hold each answer back without blocking the service, like a slow link would:
+    // requests sent together are answered together
+    void setReplyDelay(int msec);
+
+    QString introspect(const QString &path) const Q_DECL_OVERRIDE;
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) Q_DECL_OVERRIDE;
+
+private Q_SLOTS:
+    void sendDelayedReply(const QDBusMessage &reply);
+
+private:
+    QString nodeXml(const QString &path) const;
+    QString addDisk(const QString &name, int partitions, QStringList *objects);
+    void emitInterfacesAdded(const QString &path);
+    void emitInterfacesRemoved(const QString &path);
+    bool sendReply(const QDBusConnection &connection, const QDBusMessage &reply);
+
+    QString m_connectionName;
+    QMap<QString, VariantMapMap> m_objects;
+    mutable int m_callCount;
+    QAtomicInt m_pendingCalls;
+    QAtomicInt m_maxPendingCalls;
+    int m_latency;
+    int m_replyDelay;
+    qulonglong m_nextDeviceNumber;
+};
+
+#endif //SOLID_FAKE_UDISKS2_H
@@ -22,6 +22,8 @@
 // Qt includes
 #include <QtTest/QtTest>
 #include <QtCore/QStringList>
+#include <QtCore/QTemporaryFile>
+#include <QtDBus/QDBusConnection>
 
 // Solid includes
 #include <solid/devices/ifaces/device.h>
@@ -43,6 +45,10 @@ void FakeHardwareTest::testFakeBackend()
     QVERIFY(computer != 0);
     QVERIFY(fakeManager->createDevice("/com/helloworld/troll/compiutor") == 0);
 
+    if (QDBusConnection::sessionBus().isConnected()) {
+        QVERIFY(QDBusConnection::sessionBus().objectRegisteredAt("/org/kde/solid/fakehw/acpi_CPU0"));
+    }
+
     Solid::Backends::Fake::FakeDevice *device = static_cast<Solid::Backends::Fake::FakeDevice *>(fakeManager->createDevice("/org/kde/solid/fakehw/acpi_CPU0"));
 
     QCOMPARE(device->udi(), QString("/org/kde/solid/fakehw/acpi_CPU0"));
@@ -74,4 +80,47 @@ void FakeHardwareTest::testFakeBackend()
     delete fakeManager;
 }
 
+void FakeHardwareTest::testSyntheticMachine()
+{
+    QTemporaryFile machine;
+    QVERIFY(machine.open());
+    machine.write(Solid::Backends::Fake::FakeManager::syntheticMachine(4, 3, 2));
+    machine.close();
+
+    Solid::Backends::Fake::FakeManager *fakeManager = new Solid::Backends::Fake::FakeManager(0, machine.fileName());
+
+    QCOMPARE(fakeManager->allDevices().size(), 1 + 4 + 3 + 3 * 2);
+    QCOMPARE(fakeManager->devicesFromQuery(QString(), Solid::DeviceInterface::Processor).size(), 4);
+    QCOMPARE(fakeManager->devicesFromQuery(QString(), Solid::DeviceInterface::StorageDrive).size(), 3);
+    QCOMPARE(fakeManager->devicesFromQuery(QString(), Solid::DeviceInterface::StorageVolume).size(), 6);
+
+    const QString drive("/org/kde/solid/fakehw/storage_serial_SYNTH2");
+    QCOMPARE(fakeManager->devicesFromQuery(drive, Solid::DeviceInterface::StorageVolume).size(), 2);
+
+    Solid::Backends::Fake::FakeDevice *volume = fakeManager->findDevice("/org/kde/solid/fakehw/volume_synth_2_1");
+    QVERIFY(volume != 0);
+    QCOMPARE(volume->parentUdi(), drive);
+    QCOMPARE(volume->property("fsType").toString(), QString("ext4"));
+    QVERIFY(volume->queryDeviceInterface(Solid::DeviceInterface::StorageAccess));
+
+    // Unlike those of the machine files, the devices aren't on the bus
+    QVERIFY(!QDBusConnection::sessionBus().objectRegisteredAt(volume->udi()));
+
+    delete fakeManager;
+}
+
+void FakeHardwareTest::benchmarkLoadMachine()
+{
+    // 64 + 250 + 250 * 16 devices
+    QTemporaryFile machine;
+    QVERIFY(machine.open());
+    machine.write(Solid::Backends::Fake::FakeManager::syntheticMachine(64, 250, 16));
+    machine.close();
+
+    QBENCHMARK {
+        Solid::Backends::Fake::FakeManager fakeManager(0, machine.fileName());
+        QCOMPARE(fakeManager.allDevices().size(), 1 + 64 + 250 + 250 * 16);
+    }
+}
+
 #include "moc_fakehardwaretest.cpp"
@@ -27,6 +27,8 @@ class FakeHardwareTest : public QObject
     Q_OBJECT
 private Q_SLOTS:
     void testFakeBackend();
+    void testSyntheticMachine();
+    void benchmarkLoadMachine();
 };
 
 #endif
@@ -26,7 +26,7 @@
 #include <QDebug>
 #include <stdlib.h>
 
-#define QTEST_GUILESS_MAIN_SYSTEM_DBUS(TestObject) \
+#define SOLID_QTEST_MAIN_SYSTEM_DBUS(TestObject, Application) \
 int main(int argc, char *argv[]) \
 { \
     QProcess dbus; \
@@ -42,7 +42,7 @@ int main(int argc, char *argv[]) \
     session = dbus.readLine(); \
     pos = session.indexOf('='); \
     QByteArray pid = session.right(session.count() - pos - 1).trimmed(); \
-    QCoreApplication app( argc, argv ); \
+    Application app( argc, argv ); \
     app.setApplicationName( QLatin1String("qttest") ); \
     TestObject tc; \
     int result = QTest::qExec( &tc, argc, argv ); \
@@ -50,4 +50,12 @@ int main(int argc, char *argv[]) \
     dbus.waitForFinished(); \
     return result; \
 }
+
+#define QTEST_GUILESS_MAIN_SYSTEM_DBUS(TestObject) SOLID_QTEST_MAIN_SYSTEM_DBUS(TestObject, QCoreApplication)
+
+#ifdef QT_GUI_LIB
+#include <QGuiApplication>
+#define QTEST_MAIN_SYSTEM_DBUS(TestObject) SOLID_QTEST_MAIN_SYSTEM_DBUS(TestObject, QGuiApplication)
+#endif
+
 #endif //SOLID_QTEST_DBUS_H
\ No newline at end of file
@@ -0,0 +1,159 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "qtest_dbus.h"
+#include "fakeUdisks2.h"
+
+#include <QTest>
+#include <QDebug>
+#include <QSignalSpy>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QThread>
+#include <QTimer>
+#include <QDBusConnection>
+
+#include <solid/device.h>
+#include <solid/storagevolume.h>
+
+class SolidAsyncQueryTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testListFromQueryAsync();
+    void testListFromTypeAsync();
+    void cleanupTestCase();
+
+private:
+    QStringList udisks2Udis(const QList<Solid::Device> &devices) const;
+
+    FakeUdisks2 *m_fakeUdisks2;
+    QThread *m_serviceThread;
+};
+
+static const int s_latency = 300;
+
+void SolidAsyncQueryTest::initTestCase()
+{
+    qunsetenv("SOLID_FAKEHW");
+
+    m_fakeUdisks2 = new FakeUdisks2;
+    for (int i = 0; i < 10; ++i) {
+        const QString disk = QStringLiteral("sd%1").arg(i);
+        const QString drive = m_fakeUdisks2->addDrive(QStringLiteral("Fake_Disk_%1").arg(i));
+        const QString table = m_fakeUdisks2->addBlockDevice(disk, drive);
+        for (int part = 1; part < 4; ++part) {
+            m_fakeUdisks2->addPartition(disk + QLatin1Char('p') + QString::number(part), table, part);
+        }
+    }
+    m_fakeUdisks2->setLatency(s_latency);
+
+    // The service answers from its own thread and connection, so that
+    // its latency is only felt by whoever waits for the answers
+    m_serviceThread = new QThread(this);
+    m_fakeUdisks2->moveToThread(m_serviceThread);
+    m_serviceThread->start();
+
+    QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SystemBus, QStringLiteral("fakeUdisks2"));
+    QVERIFY(m_fakeUdisks2->registerOn(connection));
+}
+
+void SolidAsyncQueryTest::cleanupTestCase()
+{
+    QDBusConnection::disconnectFromBus(QStringLiteral("fakeUdisks2"));
+    m_serviceThread->quit();
+    m_serviceThread->wait();
+    delete m_fakeUdisks2;
+}
+
+QStringList SolidAsyncQueryTest::udisks2Udis(const QList<Solid::Device> &devices) const
+{
+    QStringList udis;
+    Q_FOREACH (const Solid::Device &device, devices) {
+        if (device.udi().startsWith(QStringLiteral(UD2_DBUS_PATH))) {
+            udis << device.udi();
+        }
+    }
+    return udis;
+}
+
+void SolidAsyncQueryTest::testListFromQueryAsync()
+{
+    // Cold start: the backends have yet to enumerate the slow service
+    int ticks = 0;
+    QTimer ticker;
+    ticker.setInterval(10);
+    connect(&ticker, &QTimer::timeout, [&ticks]() { ++ticks; });
+    ticker.start();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QFutureWatcher<QList<Solid::Device> > watcher;
+    QThread *resultThread = 0;
+    connect(&watcher, &QFutureWatcherBase::finished, [&resultThread]() { resultThread = QThread::currentThread(); });
+    QSignalSpy spy(&watcher, SIGNAL(finished()));
+
+    watcher.setFuture(Solid::Device::listFromQueryAsync(QStringLiteral("IS StorageVolume")));
+    const qint64 returned = timer.elapsed();
+
+    QVERIFY(returned < s_latency);
+    QVERIFY(!watcher.isFinished());
+
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 30000);
+    qDebug() << "Asynchronous query returned after" << returned << "ms, answered after" << timer.elapsed() << "ms,"
+             << ticks << "event loop ticks in between";
+
+    // The calling thread kept running its event loop, and got the result there
+    QVERIFY(timer.elapsed() >= s_latency);
+    QVERIFY(ticks > 0);
+    QCOMPARE(resultThread, QThread::currentThread());
+
+    const QStringList udis = udisks2Udis(watcher.result());
+    for (int i = 0; i < 10; ++i) {
+        for (int part = 1; part < 4; ++part) {
+            QVERIFY(udis.contains(QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES "sd%1p%2").arg(i).arg(part)));
+        }
+    }
+
+    // Same answer as the blocking call
+    QCOMPARE(udis, udisks2Udis(Solid::Device::listFromQuery(QStringLiteral("IS StorageVolume"))));
+
+    // The devices are usable from the calling thread
+    Solid::Device partition(QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES "sd0p1"));
+    QVERIFY(partition.isValid());
+    QCOMPARE(partition.as<Solid::StorageVolume>()->fsType(), QStringLiteral("ext4"));
+}
+
+void SolidAsyncQueryTest::testListFromTypeAsync()
+{
+    QFutureWatcher<QList<Solid::Device> > watcher;
+    QSignalSpy spy(&watcher, SIGNAL(finished()));
+
+    watcher.setFuture(Solid::Device::listFromTypeAsync(Solid::DeviceInterface::StorageDrive));
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 30000);
+
+    const QStringList udis = udisks2Udis(watcher.result());
+    QCOMPARE(udis, udisks2Udis(Solid::Device::listFromType(Solid::DeviceInterface::StorageDrive)));
+    QCOMPARE(udis.size(), 10);
+}
+
+QTEST_GUILESS_MAIN_SYSTEM_DBUS(SolidAsyncQueryTest)
+
+#include "solidasyncquerytest.moc"
@@ -0,0 +1,241 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtTest/QtTest>
+
+#include "solid/devices/backends/udisks2/udiskscontenttypescache.h"
+
+using namespace Solid::Backends::UDisks2;
+
+class SolidContentTypesCacheTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void testFindInsert();
+    void testEviction();
+    void testAbandonedSlot();
+    void testSharedBetweenProcesses();
+    void testMultiProcessStress();
+
+private:
+    QString m_name;
+};
+
+QTEST_GUILESS_MAIN(SolidContentTypesCacheTest)
+
+static const int s_processes = 4;
+static const int s_iterations = 200000;
+
+// Discs which don't fit all at once in the cache, and a content that can be told from each
+static OpticalDisc::Identity disc(int i)
+{
+    return OpticalDisc::Identity(1460000000LL + i, (4700LL + i) << 20, qHash(i));
+}
+
+static Solid::OpticalDisc::ContentTypes contentOf(int i)
+{
+    return Solid::OpticalDisc::ContentTypes((i * 37) & 0x7f);
+}
+
+struct StressResult {
+    int hits;
+    int torn;
+};
+
+/* Every process inserts and looks up discs in turn, all in the same slots:
+ * what is found must always be what was inserted for that very disc */
+static StressResult stress(const QString &name, int seed)
+{
+    ContentTypesCache cache(name);
+    const int discs = 2 * ContentTypesCache::Sets * ContentTypesCache::Ways;
+
+    StressResult result = { 0, 0 };
+    uint random = seed;
+    for (int n = 0; n < s_iterations; ++n) {
+        random = random * 1103515245 + 12345;
+        const int i = (random >> 8) % discs;
+
+        Solid::OpticalDisc::ContentTypes content;
+        if (cache.find(disc(i), &content)) {
+            ++result.hits;
+            if (content != contentOf(i)) {
+                ++result.torn;
+            }
+        } else {
+            cache.insert(disc(i), contentOf(i));
+        }
+    }
+
+    return result;
+}
+
+void SolidContentTypesCacheTest::init()
+{
+    // Each test gets a table of its own
+    static int count = 0;
+    m_name = QStringLiteral("solid-test-%1-%2").arg(getpid()).arg(++count);
+}
+
+void SolidContentTypesCacheTest::testFindInsert()
+{
+    ContentTypesCache cache(m_name);
+    QVERIFY(cache.isShared());
+
+    Solid::OpticalDisc::ContentTypes content;
+    QVERIFY(!cache.find(disc(1), &content));
+
+    cache.insert(disc(1), Solid::OpticalDisc::Data | Solid::OpticalDisc::VideoDvd);
+    QVERIFY(cache.find(disc(1), &content));
+    QCOMPARE(content, Solid::OpticalDisc::Data | Solid::OpticalDisc::VideoDvd);
+
+    // Known discs are updated in place
+    cache.insert(disc(1), Solid::OpticalDisc::Data);
+    QVERIFY(cache.find(disc(1), &content));
+    QCOMPARE(content, Solid::OpticalDisc::ContentTypes(Solid::OpticalDisc::Data));
+
+    // An empty disc is worth remembering too
+    cache.insert(disc(2), Solid::OpticalDisc::NoContent);
+    QVERIFY(cache.find(disc(2), &content));
+    QCOMPARE(content, Solid::OpticalDisc::ContentTypes(Solid::OpticalDisc::NoContent));
+
+    QVERIFY(!cache.find(OpticalDisc::Identity(), &content));
+}
+
+void SolidContentTypesCacheTest::testEviction()
+{
+    ContentTypesCache cache(m_name);
+    const int capacity = ContentTypesCache::Sets * ContentTypesCache::Ways;
+
+    for (int i = 0; i < 4 * capacity; ++i) {
+        cache.insert(disc(i), contentOf(i));
+    }
+
+    // The table holds at most its capacity, the latest discs in priority
+    int found = 0;
+    int foundLatest = 0;
+    for (int i = 0; i < 4 * capacity; ++i) {
+        Solid::OpticalDisc::ContentTypes content;
+        if (cache.find(disc(i), &content)) {
+            QCOMPARE(content, contentOf(i));
+            ++found;
+            if (i >= 3 * capacity) {
+                ++foundLatest;
+            }
+        }
+    }
+    QVERIFY(found <= capacity);
+    QVERIFY(foundLatest > capacity / 2);
+
+    Solid::OpticalDisc::ContentTypes content;
+    QVERIFY(cache.find(disc(4 * capacity - 1), &content));
+}
+
+void SolidContentTypesCacheTest::testAbandonedSlot()
+{
+    ContentTypesCache cache(m_name);
+    const int capacity = ContentTypesCache::Sets * ContentTypesCache::Ways;
+
+    for (int i = 0; i < 4 * capacity; ++i) {
+        cache.insert(disc(i), contentOf(i));
+    }
+
+    // Writers died all over the table, none of its slots can be read anymore
+    Solid::OpticalDisc::ContentTypes content;
+    int abandoned = 0;
+    for (int i = 0; i < 4 * capacity; ++i) {
+        if (cache.find(disc(i), &content)) {
+            cache.abandonInsert(disc(i));
+            QVERIFY(!cache.find(disc(i), &content));
+            ++abandoned;
+        }
+    }
+    QCOMPARE(abandoned, capacity);
+
+    // but they can be written again
+    cache.insert(disc(4 * capacity), contentOf(4 * capacity));
+    QVERIFY(cache.find(disc(4 * capacity), &content));
+    QCOMPARE(content, contentOf(4 * capacity));
+}
+
+void SolidContentTypesCacheTest::testSharedBetweenProcesses()
+{
+    ContentTypesCache cache(m_name);
+    QVERIFY(cache.isShared());
+
+    const pid_t child = fork();
+    QVERIFY(child >= 0);
+    if (child == 0) {
+        ContentTypesCache childCache(m_name);
+        childCache.insert(disc(42), contentOf(42));
+        _exit(childCache.isShared() ? 0 : 1);
+    }
+
+    int status = 0;
+    QCOMPARE(waitpid(child, &status, 0), child);
+    QVERIFY(WIFEXITED(status));
+    QCOMPARE(WEXITSTATUS(status), 0);
+
+    Solid::OpticalDisc::ContentTypes content;
+    QVERIFY(cache.find(disc(42), &content));
+    QCOMPARE(content, contentOf(42));
+}
+
+void SolidContentTypesCacheTest::testMultiProcessStress()
+{
+    // Keep the table alive all along
+    ContentTypesCache cache(m_name);
+    QVERIFY(cache.isShared());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<pid_t> children;
+    for (int p = 1; p < s_processes; ++p) {
+        const pid_t child = fork();
+        QVERIFY(child >= 0);
+        if (child == 0) {
+            const StressResult result = stress(m_name, p);
+            _exit(result.torn ? 1 : result.hits ? 0 : 2);
+        }
+        children << child;
+    }
+
+    const StressResult result = stress(m_name, 0);
+
+    Q_FOREACH (pid_t child, children) {
+        int status = 0;
+        QCOMPARE(waitpid(child, &status, 0), child);
+        QVERIFY(WIFEXITED(status));
+        QCOMPARE(WEXITSTATUS(status), 0);
+    }
+
+    qDebug() << s_processes << "processes did" << s_iterations << "lookups each in" << timer.elapsed()
+             << "ms," << result.hits << "hits in this one";
+
+    QCOMPARE(result.torn, 0);
+    QVERIFY(result.hits > 0);
+}
+
+#include "solidcontenttypescachetest.moc"
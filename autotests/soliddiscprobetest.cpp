@@ -0,0 +1,229 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <unistd.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QtEndian>
+#include <QtTest/QtTest>
+
+#include "solid/devices/backends/udisks2/udisksdiscprobe.h"
+
+using namespace Solid::Backends::UDisks2;
+
+Q_DECLARE_METATYPE(Solid::OpticalDisc::ContentType)
+
+class SolidDiscProbeTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void testDetectContent_data();
+    void testDetectContent();
+    void testNotIso();
+    void testTruncated();
+    void testBoundedTableRead();
+    void testDeviceFile();
+    void benchmarkDetectContent();
+};
+
+QTEST_GUILESS_MAIN(SolidDiscProbeTest)
+
+static const int s_blockSize = 2048;
+static const int s_tableBlock = 18;
+
+static int s_reads = 0;
+static size_t s_bytesRead = 0;
+
+static ssize_t countingRead(int fd, void *buffer, size_t count, off_t offset)
+{
+    ++s_reads;
+    s_bytesRead += count;
+    return pread(fd, buffer, count, offset);
+}
+
+static void resetCounters()
+{
+    s_reads = 0;
+    s_bytesRead = 0;
+}
+
+// A path table entry: the directory name, and the number of its parent's entry
+typedef QPair<QByteArray, int> Directory;
+
+// An ISO9660 image reduced to what the probe reads: the primary volume descriptor and the path table
+static QByteArray isoImage(const QList<Directory> &directories, quint32 declaredTableSize = 0)
+{
+    QByteArray table;
+    QList<Directory> entries;
+    entries << Directory(QByteArray(1, '\0'), 1) << directories;
+    Q_FOREACH (const Directory &directory, entries) {
+        QByteArray entry(8, '\0');
+        entry[0] = char(directory.first.size());
+        qToLittleEndian<quint16>(directory.second, reinterpret_cast<uchar *>(entry.data() + 6));
+        entry += directory.first;
+        if (directory.first.size() % 2) {
+            entry += '\0';
+        }
+        table += entry;
+    }
+
+    QByteArray image((s_tableBlock + 1) * s_blockSize, '\0');
+    uchar *descriptor = reinterpret_cast<uchar *>(image.data() + 16 * s_blockSize);
+    descriptor[0] = 1;
+    memcpy(descriptor + 1, "CD001", 5);
+    descriptor[6] = 1;
+    qToLittleEndian<quint16>(s_blockSize, descriptor + 128);
+    qToLittleEndian<quint32>(declaredTableSize ? declaredTableSize : table.size(), descriptor + 132);
+    qToLittleEndian<quint32>(s_tableBlock, descriptor + 140);
+
+    image.replace(s_tableBlock * s_blockSize, table.size(), table);
+    return image;
+}
+
+static bool writeImage(QTemporaryFile *file, const QByteArray &image)
+{
+    return file->open() && file->write(image) == image.size() && file->flush();
+}
+
+void SolidDiscProbeTest::testDetectContent_data()
+{
+    QTest::addColumn<QByteArray>("image");
+    QTest::addColumn<Solid::OpticalDisc::ContentType>("content");
+
+    QList<Directory> dirs;
+
+    dirs << Directory("AUDIO_TS", 1) << Directory("VIDEO_TS", 1);
+    QTest::newRow("dvd") << isoImage(dirs) << Solid::OpticalDisc::VideoDvd;
+
+    dirs.clear();
+    dirs << Directory("BDMV", 1) << Directory("CERTIFICATE", 1);
+    QTest::newRow("bluray") << isoImage(dirs) << Solid::OpticalDisc::VideoBluRay;
+
+    dirs.clear();
+    dirs << Directory("CDI", 1) << Directory("EXT", 1) << Directory("MPEGAV", 1) << Directory("VCD", 1);
+    QTest::newRow("vcd") << isoImage(dirs) << Solid::OpticalDisc::VideoCd;
+
+    dirs.clear();
+    dirs << Directory("MPEG2", 1) << Directory("SVCD", 1);
+    QTest::newRow("svcd") << isoImage(dirs) << Solid::OpticalDisc::SuperVideoCd;
+
+    dirs.clear();
+    dirs << Directory("video_ts", 1);
+    QTest::newRow("lowercase") << isoImage(dirs) << Solid::OpticalDisc::VideoDvd;
+
+    dirs.clear();
+    dirs << Directory("DOCS", 1) << Directory("PHOTOS", 1) << Directory("VIDEO_TSX", 1);
+    QTest::newRow("data") << isoImage(dirs) << Solid::OpticalDisc::NoContent;
+
+    // Only the directories at the root count
+    dirs.clear();
+    dirs << Directory("BACKUP", 1) << Directory("VIDEO_TS", 2);
+    QTest::newRow("nested") << isoImage(dirs) << Solid::OpticalDisc::NoContent;
+}
+
+void SolidDiscProbeTest::testDetectContent()
+{
+    QFETCH(QByteArray, image);
+    QFETCH(Solid::OpticalDisc::ContentType, content);
+
+    QTemporaryFile file;
+    QVERIFY(writeImage(&file, image));
+
+    resetCounters();
+    QCOMPARE(DiscProbe::detectContent(file.handle(), countingRead), content);
+
+    // The volume descriptor, then the path table, and nothing else
+    QCOMPARE(s_reads, 2);
+}
+
+void SolidDiscProbeTest::testNotIso()
+{
+    QTemporaryFile file;
+    QVERIFY(writeImage(&file, QByteArray(20 * s_blockSize, 'x')));
+
+    resetCounters();
+    QCOMPARE(DiscProbe::detectContent(file.handle(), countingRead), Solid::OpticalDisc::NoContent);
+    QCOMPARE(s_reads, 1);
+}
+
+void SolidDiscProbeTest::testTruncated()
+{
+    QList<Directory> dirs;
+    dirs << Directory("VIDEO_TS", 1);
+    const QByteArray image = isoImage(dirs);
+
+    // Short of a whole volume descriptor
+    QTemporaryFile shortDescriptor;
+    QVERIFY(writeImage(&shortDescriptor, image.left(16 * s_blockSize + 100)));
+    resetCounters();
+    QCOMPARE(DiscProbe::detectContent(shortDescriptor.handle(), countingRead), Solid::OpticalDisc::NoContent);
+    QCOMPARE(s_reads, 1);
+
+    // The path table is cut within its first entry
+    QTemporaryFile shortTable;
+    QVERIFY(writeImage(&shortTable, image.left(s_tableBlock * s_blockSize + 12)));
+    resetCounters();
+    QCOMPARE(DiscProbe::detectContent(shortTable.handle(), countingRead), Solid::OpticalDisc::NoContent);
+    QCOMPARE(s_reads, 2);
+}
+
+void SolidDiscProbeTest::testBoundedTableRead()
+{
+    // A disc with a huge path table still costs one bounded read
+    QList<Directory> dirs;
+    dirs << Directory("VIDEO_TS", 1);
+
+    QTemporaryFile file;
+    QVERIFY(writeImage(&file, isoImage(dirs, 100 * 1024 * 1024)));
+
+    resetCounters();
+    QCOMPARE(DiscProbe::detectContent(file.handle(), countingRead), Solid::OpticalDisc::VideoDvd);
+    QCOMPARE(s_reads, 2);
+    QVERIFY(s_bytesRead <= size_t(s_blockSize + DiscProbe::MaxPathTableSize));
+}
+
+void SolidDiscProbeTest::testDeviceFile()
+{
+    QList<Directory> dirs;
+    dirs << Directory("BDMV", 1);
+
+    QTemporaryFile file;
+    QVERIFY(writeImage(&file, isoImage(dirs)));
+    QCOMPARE(DiscProbe::detectContent(QFile::encodeName(file.fileName())), Solid::OpticalDisc::VideoBluRay);
+
+    QCOMPARE(DiscProbe::detectContent(QByteArray("/nonexistent/sr0")), Solid::OpticalDisc::NoContent);
+}
+
+void SolidDiscProbeTest::benchmarkDetectContent()
+{
+    QList<Directory> dirs;
+    for (int i = 0; i < 500; ++i) {
+        dirs << Directory("DIR" + QByteArray::number(i), 1);
+    }
+    dirs << Directory("VIDEO_TS", 1);
+
+    QTemporaryFile file;
+    QVERIFY(writeImage(&file, isoImage(dirs)));
+
+    QBENCHMARK {
+        QCOMPARE(DiscProbe::detectContent(file.handle()), Solid::OpticalDisc::VideoDvd);
+    }
+}
+
+#include "soliddiscprobetest.moc"
@@ -30,6 +30,8 @@
 #include <solid/storagevolume.h>
 #include <solid/predicate.h>
 #include "solid/devices/managerbase_p.h"
+#include "solid/devices/frontend/predicate_p.h"
+#include "solid/devices/frontend/queryplan_p.h"
 
 #include <fakemanager.h>
 #include <fakedevice.h>
@@ -429,6 +431,212 @@ void SolidHwTest::testPredicate()
     QCOMPARE(list.size(), 0);
 }
 
+static QList<QPair<QByteArray, QString> > predicateRows()
+{
+    QList<QPair<QByteArray, QString> > rows;
+    rows << qMakePair(QByteArray("interface"), QString("IS StorageVolume"))
+         << qMakePair(QByteArray("and"), QString("[Processor.canChangeFrequency == true AND Processor.number == 1]"))
+         << qMakePair(QByteArray("or"), QString("[Processor.number == 1 OR IS StorageVolume]"))
+         << qMakePair(QByteArray("enum key"), QString("StorageVolume.usage == 'Other'"))
+         << qMakePair(QByteArray("mask"), QString("OpticalDrive.supportedMedia & 'Dvd|Cdrw'"))
+         << qMakePair(QByteArray("unknown property"), QString("[[Processor.maxSpeed == 3201 AND Processor.canChangeFrequency == false] OR StorageVolume.mountPoint == '/media/blup']"))
+         << qMakePair(QByteArray("nested"), QString("[IS Block AND [StorageVolume.fsType == 'ext3' OR [IS OpticalDisc OR StorageDrive.removable == true]]]"));
+    return rows;
+}
+
+void SolidHwTest::testCompiledPredicate_data()
+{
+    QTest::addColumn<QString>("predicate");
+
+    typedef QPair<QByteArray, QString> Row;
+    Q_FOREACH (const Row &row, predicateRows()) {
+        QTest::newRow(row.first.constData()) << row.second;
+    }
+}
+
+void SolidHwTest::testCompiledPredicate()
+{
+    QFETCH(QString, predicate);
+
+    const Solid::Predicate tree = Solid::Predicate::fromString(predicate);
+    QVERIFY(tree.isValid());
+    const Solid::CompiledPredicate program(tree);
+    QVERIFY(program.isValid());
+
+    Q_FOREACH (const Solid::Device &device, Solid::Device::allDevices()) {
+        QCOMPARE(program.matches(device), tree.matches(device));
+    }
+
+    QVERIFY(!Solid::CompiledPredicate().matches(Solid::Device("/org/kde/solid/fakehw/acpi_CPU0")));
+    QVERIFY(!Solid::CompiledPredicate(Solid::Predicate()).isValid());
+}
+
+void SolidHwTest::benchmarkPredicate_data()
+{
+    QTest::addColumn<QString>("predicate");
+    QTest::addColumn<bool>("compiled");
+
+    typedef QPair<QByteArray, QString> Row;
+    Q_FOREACH (const Row &row, predicateRows()) {
+        QTest::newRow((row.first + " tree").constData()) << row.second << false;
+        QTest::newRow((row.first + " compiled").constData()) << row.second << true;
+    }
+}
+
+void SolidHwTest::benchmarkPredicate()
+{
+    QFETCH(QString, predicate);
+    QFETCH(bool, compiled);
+
+    const Solid::Predicate tree = Solid::Predicate::fromString(predicate);
+    const QList<Solid::Device> devices = Solid::Device::allDevices();
+    int expected = 0;
+
+    // The interfaces get created on first use, don't count that
+    Q_FOREACH (const Solid::Device &device, devices) {
+        expected += tree.matches(device) ? 1 : 0;
+    }
+
+    int matching = 0;
+
+    if (compiled) {
+        QBENCHMARK {
+            const Solid::CompiledPredicate program(tree);
+            matching = 0;
+            Q_FOREACH (const Solid::Device &device, devices) {
+                matching += program.matches(device) ? 1 : 0;
+            }
+        }
+    } else {
+        QBENCHMARK {
+            matching = 0;
+            Q_FOREACH (const Solid::Device &device, devices) {
+                matching += tree.matches(device) ? 1 : 0;
+            }
+        }
+    }
+
+    QCOMPARE(matching, expected);
+}
+
+void SolidHwTest::testQueryIndexHotplug()
+{
+    const QString computer("/org/kde/solid/fakehw/computer");
+    const QString cpu0("/org/kde/solid/fakehw/acpi_CPU0");
+    const QString cpu1("/org/kde/solid/fakehw/acpi_CPU1");
+
+    QList<Solid::Device> list = Solid::Device::listFromType(Solid::DeviceInterface::Processor, computer);
+    QCOMPARE(list.size(), 2);
+
+    // The type and parent indexes have to follow the hotplug events
+    fakeManager->unplug(cpu0);
+    list = Solid::Device::listFromType(Solid::DeviceInterface::Processor);
+    QCOMPARE(list.size(), 1);
+    QCOMPARE(list.at(0).udi(), cpu1);
+    list = Solid::Device::listFromType(Solid::DeviceInterface::Processor, computer);
+    QCOMPARE(list.size(), 1);
+    list = Solid::Device::listFromQuery("IS Processor");
+    QCOMPARE(list.size(), 1);
+
+    fakeManager->plug(cpu0);
+    list = Solid::Device::listFromType(Solid::DeviceInterface::Processor, computer);
+    QCOMPARE(list.size(), 2);
+    QCOMPARE(list.at(0).udi(), cpu0);
+    QCOMPARE(list.at(1).udi(), cpu1);
+
+    // Type and parent have to be both honored
+    list = Solid::Device::listFromType(Solid::DeviceInterface::StorageVolume, computer);
+    QCOMPARE(list.size(), 0);
+    list = Solid::Device::listFromType(Solid::DeviceInterface::Unknown);
+    QCOMPARE(list.size(), 0);
+}
+
+void SolidHwTest::testQueryPlan()
+{
+    QStringList plan = Solid::explainQuery("[IS Processor AND Processor.number == 1]").split('\n');
+    QCOMPARE(plan.size(), 4);
+    QCOMPARE(plan.at(0), QString("AND: 2 candidates, checked one by one"));
+    QCOMPARE(plan.at(1), QString("  IS Processor: 2 candidates"));
+    QCOMPARE(plan.at(2), QString("  Processor.number == 1: 2 candidates, checked one by one"));
+    QCOMPARE(plan.at(3), QString("2 devices checked, 1 matching"));
+
+    // Only interface checks: the index answers alone
+    plan = Solid::explainQuery("[IS Processor OR IS StorageVolume]").split('\n');
+    QCOMPARE(plan.first(), QString("OR: 11 candidates"));
+    QCOMPARE(plan.last(), QString("11 devices, no check needed"));
+    QCOMPARE(Solid::Device::listFromQuery("[IS Processor OR IS StorageVolume]").size(), 11);
+
+    // Disjoint interfaces: nothing left to check
+    plan = Solid::explainQuery("[Processor.number == 1 AND StorageVolume.usage == 'FileSystem']").split('\n');
+    QCOMPARE(plan.first(), QString("AND: 0 candidates, checked one by one"));
+    QCOMPARE(plan.last(), QString("0 devices checked, 0 matching"));
+
+    plan = Solid::explainQuery("IS Processor", "/org/kde/solid/fakehw/computer").split('\n');
+    QCOMPARE(plan.at(1), QString("children of /org/kde/solid/fakehw/computer: 2 candidates"));
+
+    QCOMPARE(Solid::explainQuery("blup"), QString("invalid predicate"));
+}
+
+void SolidHwTest::testBatchedNotifications()
+{
+    Solid::DeviceNotifier *notifier = Solid::DeviceNotifier::instance();
+    QCOMPARE(notifier->batchInterval(), 0);
+
+    int perDeviceWakeups = 0;
+    int batchWakeups = 0;
+    QStringList added;
+    QStringList removed;
+    connect(notifier, &Solid::DeviceNotifier::deviceAdded, this, [&perDeviceWakeups]() { ++perDeviceWakeups; });
+    connect(notifier, &Solid::DeviceNotifier::deviceRemoved, this, [&perDeviceWakeups]() { ++perDeviceWakeups; });
+    connect(notifier, &Solid::DeviceNotifier::devicesChanged, this,
+            [&](const QStringList &a, const QStringList &r) { ++batchWakeups; added = a; removed = r; });
+
+    // Storm of at least 500 changes: unplug and replug the whole machine, over and over
+    const QStringList udis = fakeManager->allDevices();
+    int changes = 0;
+    while (changes < 500) {
+        Q_FOREACH (const QString &udi, udis) {
+            fakeManager->unplug(udi);
+        }
+        Q_FOREACH (const QString &udi, udis) {
+            fakeManager->plug(udi);
+        }
+        changes += 2 * udis.size();
+    }
+
+    QCOMPARE(perDeviceWakeups, changes);
+    QCOMPARE(batchWakeups, 0);
+    QTRY_COMPARE(batchWakeups, 1);
+    qDebug() << changes << "changes:" << perDeviceWakeups << "per device wake-ups," << batchWakeups << "batched";
+    QCOMPARE(added, udis);
+    QCOMPARE(removed, udis);
+
+    // The last change of a device wins, in order of arrival
+    const QString cpu0("/org/kde/solid/fakehw/acpi_CPU0");
+    const QString cpu1("/org/kde/solid/fakehw/acpi_CPU1");
+    fakeManager->unplug(cpu0);
+    fakeManager->plug(cpu0);
+    fakeManager->unplug(cpu1);
+    QTRY_COMPARE(batchWakeups, 2);
+    QCOMPARE(added, QStringList() << cpu0);
+    QCOMPARE(removed, QStringList() << cpu0 << cpu1);
+
+    // Bursts within the window get merged
+    notifier->setBatchInterval(200);
+    QCOMPARE(notifier->batchInterval(), 200);
+    fakeManager->plug(cpu1);
+    QTest::qWait(20);
+    fakeManager->unplug(cpu0);
+    QTest::qWait(20);
+    fakeManager->plug(cpu0);
+    QTRY_COMPARE(batchWakeups, 3);
+    QCOMPARE(added, QStringList() << cpu1 << cpu0);
+    QCOMPARE(removed, QStringList() << cpu0);
+
+    notifier->setBatchInterval(0);
+    disconnect(notifier, 0, this, 0);
+}
+
 void SolidHwTest::testSetupTeardown()
 {
     Solid::StorageAccess *access;
@@ -50,6 +50,13 @@ private Q_SLOTS:
     void testDeviceInterfaceIntrospectionCornerCases();
     void testDeviceInterfaces();
     void testPredicate();
+    void testCompiledPredicate_data();
+    void testCompiledPredicate();
+    void benchmarkPredicate_data();
+    void benchmarkPredicate();
+    void testQueryIndexHotplug();
+    void testQueryPlan();
+    void testBatchedNotifications();
     void testSetupTeardown();
 
     void slotPropertyChanged(const QMap<QString, int> &changes);
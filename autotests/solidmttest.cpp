@@ -21,24 +21,143 @@
 #include <QtCore/QObject>
 #include <QtCore/QThread>
 #include <QtCore/QThreadPool>
+#include <QtCore/QElapsedTimer>
 #include <qtconcurrentrun.h>
 
 #include <QtTest/QtTest>
 
 #include <solid/device.h>
+#include <solid/devicenotifier.h>
 #include <solid/predicate.h>
 #include <solid/storagevolume.h>
 #include <solid/storagedrive.h>
 #include <solid/genericinterface.h>
+#include "solid/devices/managerbase_p.h"
+#include "solid/devices/ifaces/devicemanager.h"
 
 class SolidMtTest : public QObject
 {
     Q_OBJECT
 private Q_SLOTS:
+    void testConcurrentEnumeration();
     void testWorkerThread();
     void testThreadedPredicate();
+    void testBackendFanOut();
+    void testSerializedBackend();
+    void benchmarkBackendFanOut_data();
+    void benchmarkBackendFanOut();
 };
 
+// How many backends are in allDevices() at once, all of them together
+static QAtomicInt s_answering;
+static QAtomicInt s_maxAnswering;
+
+static void raiseMax(QAtomicInt *max, int value)
+{
+    int current = max->load();
+    while (value > current && !max->testAndSetOrdered(current, value)) {
+        current = max->load();
+    }
+}
+
+// Answers after some time, like a backend waiting on its service
+class SlowBackend : public Solid::Ifaces::DeviceManager
+{
+public:
+    SlowBackend(const QString &prefix, int latency, bool threadSafe)
+        : m_prefix(prefix), m_latency(latency), m_threadSafe(threadSafe), m_meeting(0), m_running(0), m_maxRunning(0)
+    {
+    }
+
+    // Stay in allDevices() until that many backends are in theirs, or for 5 s at most
+    void meet(int backends)
+    {
+        m_meeting = backends;
+    }
+
+    // The most threads ever seen in allDevices() at once
+    int maxRunning() const
+    {
+        return m_maxRunning.load();
+    }
+
+    QString udiPrefix() const Q_DECL_OVERRIDE
+    {
+        return m_prefix;
+    }
+    QSet<Solid::DeviceInterface::Type> supportedInterfaces() const Q_DECL_OVERRIDE
+    {
+        return QSet<Solid::DeviceInterface::Type>();
+    }
+    QStringList allDevices() Q_DECL_OVERRIDE
+    {
+        raiseMax(&m_maxRunning, m_running.fetchAndAddOrdered(1) + 1);
+        raiseMax(&s_maxAnswering, s_answering.fetchAndAddOrdered(1) + 1);
+
+        QThread::msleep(m_latency);
+
+        QElapsedTimer timer;
+        timer.start();
+        while (s_maxAnswering.load() < m_meeting && timer.elapsed() < 5000) {
+            QThread::msleep(1);
+        }
+
+        s_answering.deref();
+        m_running.deref();
+        return QStringList() << m_prefix + QStringLiteral("/a") << m_prefix + QStringLiteral("/b");
+    }
+    QStringList devicesFromQuery(const QString &, Solid::DeviceInterface::Type) Q_DECL_OVERRIDE
+    {
+        return allDevices();
+    }
+    QObject *createDevice(const QString &) Q_DECL_OVERRIDE
+    {
+        return 0;
+    }
+    bool isEnumerationThreadSafe() const Q_DECL_OVERRIDE
+    {
+        return m_threadSafe;
+    }
+
+private:
+    QString m_prefix;
+    int m_latency;
+    bool m_threadSafe;
+    int m_meeting;
+    QAtomicInt m_running;
+    QAtomicInt m_maxRunning;
+};
+
+// Takes backends the way the device manager gets them loaded
+class TestManager : public Solid::ManagerBasePrivate
+{
+public:
+    void add(QObject *backend)
+    {
+        addBackend(backend);
+    }
+};
+
+static QStringList slowBackendDevices(QObject *backend)
+{
+    return static_cast<SlowBackend *>(backend)->allDevices();
+}
+
+static QList<QStringList> fanOutAll(TestManager *manager)
+{
+    return manager->fanOut(manager->managerBackends(), &slowBackendDevices);
+}
+
+static QList<QObject *> slowBackends(bool threadSafe)
+{
+    // The latencies of a typical system: UDisks2, UPower, and a local one
+    QList<QObject *> backends;
+    backends << new SlowBackend(QStringLiteral("/slow"), 60, threadSafe)
+             << new SlowBackend(QStringLiteral("/fast"), 20, threadSafe)
+             << new SlowBackend(QStringLiteral("/local"), 40, false);
+    return backends;
+}
+
 class WorkerThread : public QThread
 {
     Q_OBJECT
@@ -64,8 +183,44 @@ static void doPredicates()
     Solid::Predicate p7 = Solid::Predicate::fromString(QString("StorageVolume.usage == %1").arg((int)Solid::StorageVolume::Other));
 }
 
+static QList<QObject *> enumerateDevices()
+{
+    Solid::Device::allDevices();
+    Solid::Device::listFromType(Solid::DeviceInterface::StorageVolume);
+    Solid::Device::listFromQuery("StorageVolume.usage == 'FileSystem'");
+
+    Solid::ManagerBasePrivate *manager
+        = dynamic_cast<Solid::ManagerBasePrivate *>(Solid::DeviceNotifier::instance());
+    return manager->managerBackends();
+}
+
 QTEST_MAIN(SolidMtTest)
 
+void SolidMtTest::testConcurrentEnumeration()
+{
+    // Nobody touched Solid yet, all the threads race to create the manager
+    QThreadPool::globalInstance()->setMaxThreadCount(16);
+    QList<QFuture<QList<QObject *> > > futures;
+    for (int i = 0; i < 16; ++i) {
+        futures << QtConcurrent::run(&enumerateDevices);
+    }
+
+    QSet<QObject *> backends;
+    Q_FOREACH (QFuture<QList<QObject *> > f, futures) {
+        QCOMPARE(f.result(), enumerateDevices());
+        backends += f.result().toSet();
+    }
+
+    // Exactly one set of backends for the whole process, owned by the main thread
+    QCOMPARE(backends.size(), enumerateDevices().size());
+    QCOMPARE(Solid::DeviceNotifier::instance()->thread(), QThread::currentThread());
+    Q_FOREACH (QObject *backend, backends) {
+        QCOMPARE(backend->thread(), QThread::currentThread());
+    }
+
+    QThreadPool::globalInstance()->setMaxThreadCount(1); // delete those threads
+}
+
 void SolidMtTest::testWorkerThread()
 {
     Solid::Device dev("/org/freedesktop/Hal/devices/acpi_ADP1");
@@ -102,5 +257,78 @@ void SolidMtTest::testThreadedPredicate()
     QThreadPool::globalInstance()->setMaxThreadCount(1); // delete those threads
 }
 
+void SolidMtTest::testBackendFanOut()
+{
+    QThreadPool::globalInstance()->setMaxThreadCount(4);
+
+    const QList<QObject *> backends = slowBackends(true);
+    Q_FOREACH (QObject *backend, backends) {
+        static_cast<SlowBackend *>(backend)->meet(backends.size());
+    }
+    s_maxAnswering = 0;
+
+    Solid::ManagerBasePrivate manager;
+    const QList<QStringList> results = manager.fanOut(backends, &slowBackendDevices);
+
+    // Whoever answers first, the results come in backend order
+    QCOMPARE(results.size(), 3);
+    QCOMPARE(results.at(0), QStringList() << "/slow/a" << "/slow/b");
+    QCOMPARE(results.at(1), QStringList() << "/fast/a" << "/fast/b");
+    QCOMPARE(results.at(2), QStringList() << "/local/a" << "/local/b");
+
+    // The three were asked at once, not one after the other
+    QCOMPARE(s_maxAnswering.load(), backends.size());
+
+    qDeleteAll(backends);
+    QThreadPool::globalInstance()->setMaxThreadCount(1); // delete those threads
+}
+
+void SolidMtTest::testSerializedBackend()
+{
+    QThreadPool::globalInstance()->setMaxThreadCount(8);
+
+    TestManager manager;
+    SlowBackend *backend = new SlowBackend(QStringLiteral("/local"), 5, false);
+    manager.add(backend);
+
+    // However many threads enumerate at once, the backend gets them one by one
+    QList<QFuture<QList<QStringList> > > futures;
+    for (int i = 0; i < 8; ++i) {
+        futures << QtConcurrent::run(&fanOutAll, &manager);
+    }
+    Q_FOREACH (QFuture<QList<QStringList> > f, futures) {
+        QCOMPARE(f.result(), QList<QStringList>() << (QStringList() << "/local/a" << "/local/b"));
+    }
+
+    QCOMPARE(backend->maxRunning(), 1);
+    QVERIFY(manager.backendMutex(backend));
+
+    QThreadPool::globalInstance()->setMaxThreadCount(1); // delete those threads
+}
+
+void SolidMtTest::benchmarkBackendFanOut_data()
+{
+    QTest::addColumn<bool>("threadSafe");
+
+    QTest::newRow("serial") << false;
+    QTest::newRow("concurrent") << true;
+}
+
+void SolidMtTest::benchmarkBackendFanOut()
+{
+    QFETCH(bool, threadSafe);
+
+    QThreadPool::globalInstance()->setMaxThreadCount(4);
+    const QList<QObject *> backends = slowBackends(threadSafe);
+    Solid::ManagerBasePrivate manager;
+
+    QBENCHMARK {
+        manager.fanOut(backends, &slowBackendDevices);
+    }
+
+    qDeleteAll(backends);
+    QThreadPool::globalInstance()->setMaxThreadCount(1); // delete those threads
+}
+
 #include "solidmttest.moc"
 
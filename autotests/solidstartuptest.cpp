@@ -0,0 +1,94 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "solid/devices/frontend/devicemanager_p.h"
+#include "solid/devices/ifaces/devicemanager.h"
+
+class SolidStartupTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testLazyBackends();
+    void benchmarkFirstProcessorQuery_data();
+    void benchmarkFirstProcessorQuery();
+};
+
+QTEST_MAIN(SolidStartupTest)
+
+void SolidStartupTest::initTestCase()
+{
+    // The real backends are what this is about
+    qunsetenv("SOLID_FAKEHW");
+}
+
+void SolidStartupTest::testLazyBackends()
+{
+    Solid::DeviceManagerPrivate manager;
+    QVERIFY(manager.loadedBackends().isEmpty());
+
+    QSet<Solid::DeviceInterface::Type> types;
+    types << Solid::DeviceInterface::Processor;
+    manager.indexedDevices(types, QString());
+
+    // Only the backends which can have processors got loaded
+    const QList<QObject *> loaded = manager.loadedBackends();
+    Q_FOREACH (QObject *backend, loaded) {
+        Solid::Ifaces::DeviceManager *deviceManager = qobject_cast<Solid::Ifaces::DeviceManager *>(backend);
+        QVERIFY(deviceManager);
+        QVERIFY(deviceManager->supportedInterfaces().contains(Solid::DeviceInterface::Processor));
+    }
+
+    // The others come when asked for
+    const QList<QObject *> all = manager.managerBackends();
+    QVERIFY(all.size() > loaded.size());
+    QCOMPARE(manager.loadedBackends(), all);
+    Q_FOREACH (QObject *backend, loaded) {
+        QVERIFY(all.contains(backend));
+    }
+}
+
+void SolidStartupTest::benchmarkFirstProcessorQuery_data()
+{
+    QTest::addColumn<bool>("eager");
+
+    QTest::newRow("eager") << true;
+    QTest::newRow("lazy") << false;
+}
+
+void SolidStartupTest::benchmarkFirstProcessorQuery()
+{
+    QFETCH(bool, eager);
+
+    QSet<Solid::DeviceInterface::Type> types;
+    types << Solid::DeviceInterface::Processor;
+
+    // What a tool only interested in processors pays before its first answer
+    QBENCHMARK {
+        Solid::DeviceManagerPrivate manager;
+        if (eager) {
+            manager.managerBackends();
+        }
+        manager.indexedDevices(types, QString());
+    }
+}
+
+#include "solidstartuptest.moc"
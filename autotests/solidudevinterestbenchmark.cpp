@@ -0,0 +1,92 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "solid/devices/backends/udev/udevmanager.h"
+
+using Solid::Backends::UDev::UDevManager;
+
+class SolidUDevInterestBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void benchmarkVerdicts_data();
+    void benchmarkVerdicts();
+
+private:
+    int replay(UDevManager *manager);
+
+    UdevQt::DeviceList m_devices;
+};
+
+QTEST_GUILESS_MAIN(SolidUDevInterestBenchmark)
+
+void SolidUDevInterestBenchmark::initTestCase()
+{
+    // The subsystems the udev manager watches
+    QStringList subsystems;
+    subsystems << "processor" << "cpu" << "sound" << "tty" << "dvb" << "net" << "usb" << "input";
+
+    UdevQt::Client client;
+    m_devices = client.devicesBySubsystems(subsystems);
+    if (m_devices.isEmpty()) {
+        QSKIP("udev knows of no device here");
+    }
+}
+
+// What a coldplug replay does, `udevadm trigger --action=add`: all the devices come again
+int SolidUDevInterestBenchmark::replay(UDevManager *manager)
+{
+    QSignalSpy spy(manager, SIGNAL(deviceAdded(QString)));
+    Q_FOREACH (const UdevQt::Device &device, m_devices) {
+        QMetaObject::invokeMethod(manager, "slotDeviceAdded", Qt::DirectConnection, Q_ARG(UdevQt::Device, device));
+    }
+    return spy.count();
+}
+
+void SolidUDevInterestBenchmark::benchmarkVerdicts_data()
+{
+    QTest::addColumn<bool>("warm");
+
+    QTest::newRow("first pass") << false;
+    QTest::newRow("next passes") << true;
+}
+
+void SolidUDevInterestBenchmark::benchmarkVerdicts()
+{
+    QFETCH(bool, warm);
+
+    UDevManager manager(0);
+
+    if (warm) {
+        replay(&manager);
+        QBENCHMARK {
+            replay(&manager);
+        }
+    } else {
+        // Only the first pass finds the verdicts to make
+        QBENCHMARK_ONCE {
+            replay(&manager);
+        }
+    }
+}
+
+#include "solidudevinterestbenchmark.moc"
@@ -0,0 +1,150 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "qtest_dbus.h"
+#include "fakeUdisks2.h"
+
+#include <QTest>
+#include <QDebug>
+#include <QSignalSpy>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimer>
+#include <QDBusConnection>
+
+#include "solid/devices/backends/udisks2/udisksmanager.h"
+
+using namespace Solid::Backends::UDisks2;
+
+class SolidUDisks2ActivationTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testDelayedActivation();
+    void testNoDuplicateAnnouncements();
+    void cleanupTestCase();
+
+private:
+    FakeUdisks2 *m_fakeUdisks2;
+    QThread *m_serviceThread;
+    int m_devices;
+};
+
+static const int s_latency = 300;
+
+void SolidUDisks2ActivationTest::initTestCase()
+{
+    m_fakeUdisks2 = new FakeUdisks2;
+    for (int i = 0; i < 5; ++i) {
+        const QString disk = QStringLiteral("sd%1").arg(i);
+        const QString drive = m_fakeUdisks2->addDrive(QStringLiteral("Fake_Disk_%1").arg(i));
+        const QString table = m_fakeUdisks2->addBlockDevice(disk, drive);
+        for (int part = 1; part < 4; ++part) {
+            m_fakeUdisks2->addPartition(disk + QLatin1Char('p') + QString::number(part), table, part);
+        }
+    }
+    m_devices = m_fakeUdisks2->objects().size();
+    m_fakeUdisks2->setLatency(s_latency);
+
+    m_serviceThread = new QThread(this);
+    m_fakeUdisks2->moveToThread(m_serviceThread);
+    m_serviceThread->start();
+}
+
+void SolidUDisks2ActivationTest::cleanupTestCase()
+{
+    QDBusConnection::disconnectFromBus(QStringLiteral("fakeUdisks2"));
+    m_serviceThread->quit();
+    m_serviceThread->wait();
+    delete m_fakeUdisks2;
+}
+
+void SolidUDisks2ActivationTest::testDelayedActivation()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Manager manager(0);
+    const qint64 constructed = timer.elapsed();
+    QSignalSpy spy(&manager, SIGNAL(deviceAdded(QString)));
+
+    // Nothing to wait for: the service isn't even there yet
+    QVERIFY(constructed < s_latency);
+
+    // A query made meanwhile finds nothing, what comes later has to be announced
+    QVERIFY(manager.allDevices().isEmpty());
+
+    int ticks = 0;
+    QTimer ticker;
+    ticker.setInterval(10);
+    connect(&ticker, &QTimer::timeout, [&ticks]() { ++ticks; });
+    ticker.start();
+
+    // The service shows up late, and is slow to answer once there
+    QTimer::singleShot(s_latency, [this]() {
+        QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SystemBus, QStringLiteral("fakeUdisks2"));
+        QVERIFY(m_fakeUdisks2->registerOn(connection));
+    });
+
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), m_devices, 30000);
+    qDebug() << "Backend constructed in" << constructed << "ms," << spy.count() << "devices announced after"
+             << timer.elapsed() << "ms," << ticks << "event loop ticks in between";
+
+    QVERIFY(timer.elapsed() >= 2 * s_latency);
+    QVERIFY(ticks > 0);
+
+    QSet<QString> announced;
+    for (int i = 0; i < spy.count(); ++i) {
+        announced << spy.at(i).at(0).toString();
+    }
+    QCOMPARE(announced.size(), m_devices);
+    QCOMPARE(manager.allDevices().toSet(), announced);
+
+    // A restarted service brings a new disk: only that one is news
+    spy.clear();
+    const QString drive = m_fakeUdisks2->addDrive(QStringLiteral("Fake_Disk_New"));
+    const QString block = m_fakeUdisks2->addBlockDevice(QStringLiteral("sdz"), drive);
+    QVERIFY(QMetaObject::invokeMethod(&manager, "slotStartEnumeration"));
+
+    QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 2, 30000);
+    announced.clear();
+    for (int i = 0; i < spy.count(); ++i) {
+        announced << spy.at(i).at(0).toString();
+    }
+    QCOMPARE(announced, QSet<QString>() << drive << block);
+    m_devices = m_fakeUdisks2->objects().size();
+}
+
+void SolidUDisks2ActivationTest::testNoDuplicateAnnouncements()
+{
+    // The service is up by now: enumerating synchronously before the
+    // background enumeration finishes must not announce anything twice
+    Manager manager(0);
+    QSignalSpy spy(&manager, SIGNAL(deviceAdded(QString)));
+
+    QCOMPARE(manager.allDevices().size(), m_devices);
+
+    QTest::qWait(3 * s_latency);
+    QCOMPARE(spy.count(), 0);
+}
+
+QTEST_GUILESS_MAIN_SYSTEM_DBUS(SolidUDisks2ActivationTest)
+
+#include "solidudisks2activationtest.moc"
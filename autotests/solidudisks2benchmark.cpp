@@ -0,0 +1,172 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "qtest_dbus.h"
+#include "fakeUdisks2.h"
+
+#include <QTest>
+#include <QDebug>
+#include <QSignalSpy>
+#include <QEventLoop>
+#include <QTimer>
+#include <QDBusConnection>
+
+#include "solid/devices/backends/udisks2/udisksmanager.h"
+
+using namespace Solid::Backends::UDisks2;
+
+/**
+ * Drives UDisks2::Manager against a fake service publishing a big machine:
+ * enumeration, type queries, hotplug and media change storms.
+ */
+class SolidUDisks2Benchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void benchmarkEnumeration();
+    void benchmarkTypeQuery();
+    void benchmarkHotplugStorm();
+    void benchmarkMediaChangeStorm();
+
+private:
+    FakeUdisks2 *m_fakeUdisks2;
+    QStringList m_opticalBlocks;
+    int m_objects;
+};
+
+static const int s_disks = 1000;
+static const int s_partitions = 3;
+static const int s_opticalDrives = 50;
+static const int s_pluggedDisks = 100;
+
+/* Runs the events until the spy has seen that many signals: QTRY_COMPARE would only
+ * look every 50 ms, which is more than a storm takes */
+template<typename Signal>
+static void waitForCount(const QSignalSpy &spy, Manager *manager, Signal signal, int count)
+{
+    QEventLoop loop;
+    QTimer::singleShot(60000, &loop, SLOT(quit()));
+    QObject::connect(manager, signal, &loop, [&]() {
+        if (spy.count() >= count) {
+            loop.quit();
+        }
+    });
+
+    if (spy.count() < count) {
+        loop.exec();
+    }
+}
+
+void SolidUDisks2Benchmark::initTestCase()
+{
+    m_fakeUdisks2 = new FakeUdisks2(this);
+
+    m_objects = m_fakeUdisks2->addDisks(QStringLiteral("sd"), s_disks, s_partitions).size();
+    for (int i = 0; i < s_opticalDrives; ++i) {
+        m_opticalBlocks << m_fakeUdisks2->addOpticalDrive(QStringLiteral("sr%1").arg(i));
+    }
+
+    QVERIFY(m_fakeUdisks2->registerOn(QDBusConnection::systemBus()));
+}
+
+void SolidUDisks2Benchmark::benchmarkEnumeration()
+{
+    int devices = 0;
+
+    QBENCHMARK {
+        Manager manager(0);
+        devices = manager.allDevices().size();
+    }
+
+    // The optical drives have no disc, their block devices aren't listed
+    QCOMPARE(devices, m_objects + s_opticalDrives);
+}
+
+void SolidUDisks2Benchmark::benchmarkTypeQuery()
+{
+    Manager manager(0);
+    manager.allDevices();
+
+    QStringList volumes;
+    QBENCHMARK {
+        volumes = manager.devicesFromQuery(QString(), Solid::DeviceInterface::StorageVolume);
+    }
+
+    QCOMPARE(volumes.size(), s_disks * (1 + s_partitions));
+}
+
+void SolidUDisks2Benchmark::benchmarkHotplugStorm()
+{
+    Manager manager(0);
+    manager.allDevices();
+
+    QSignalSpy added(&manager, SIGNAL(deviceAdded(QString)));
+    QSignalSpy removed(&manager, SIGNAL(deviceRemoved(QString)));
+    const int objects = s_pluggedDisks * (2 + s_partitions);
+
+    QBENCHMARK {
+        added.clear();
+        removed.clear();
+
+        for (int i = 0; i < s_pluggedDisks; ++i) {
+            m_fakeUdisks2->plugDisk(QStringLiteral("usb%1").arg(i), s_partitions);
+        }
+        waitForCount(added, &manager, &Manager::deviceAdded, objects);
+        QCOMPARE(added.count(), objects);
+
+        for (int i = 0; i < s_pluggedDisks; ++i) {
+            m_fakeUdisks2->unplugDisk(QStringLiteral("usb%1").arg(i));
+        }
+        waitForCount(removed, &manager, &Manager::deviceRemoved, objects);
+        QCOMPARE(removed.count(), objects);
+    }
+
+    QCOMPARE(manager.allDevices().size(), m_objects + s_opticalDrives);
+}
+
+void SolidUDisks2Benchmark::benchmarkMediaChangeStorm()
+{
+    Manager manager(0);
+    manager.allDevices();
+
+    QSignalSpy added(&manager, SIGNAL(deviceAdded(QString)));
+    QSignalSpy removed(&manager, SIGNAL(deviceRemoved(QString)));
+
+    QBENCHMARK {
+        added.clear();
+        removed.clear();
+
+        Q_FOREACH (const QString &block, m_opticalBlocks) {
+            m_fakeUdisks2->insertMedia(block);
+        }
+        waitForCount(added, &manager, &Manager::deviceAdded, s_opticalDrives);
+        QCOMPARE(added.count(), s_opticalDrives);
+
+        Q_FOREACH (const QString &block, m_opticalBlocks) {
+            m_fakeUdisks2->ejectMedia(block);
+        }
+        waitForCount(removed, &manager, &Manager::deviceRemoved, s_opticalDrives);
+        QCOMPARE(removed.count(), s_opticalDrives);
+    }
+}
+
+QTEST_GUILESS_MAIN_SYSTEM_DBUS(SolidUDisks2Benchmark)
+
+#include "solidudisks2benchmark.moc"
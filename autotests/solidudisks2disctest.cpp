@@ -0,0 +1,125 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "qtest_dbus.h"
+#include "fakeUdisks2.h"
+
+#include <QTest>
+#include <QSignalSpy>
+#include <QDateTime>
+#include <QTemporaryFile>
+#include <QtEndian>
+#include <QDBusConnection>
+
+#include "solid/devices/backends/udisks2/udisksdevice.h"
+#include "solid/devices/backends/udisks2/udisksdevicebackend.h"
+
+using namespace Solid::Backends::UDisks2;
+
+// Disc content is probed in the background only for the GUI thread of a GUI application
+class SolidUDisks2DiscTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testDescriptionOnly();
+
+private:
+    FakeUdisks2 *m_fakeUdisks2;
+    QTemporaryFile m_image;
+    QString m_block;
+    QString m_drive;
+};
+
+static const int s_blockSize = 2048;
+static const int s_tableBlock = 18;
+
+// A video DVD as far as the probe reads it: the primary volume descriptor, and a VIDEO_TS directory at the root
+static QByteArray videoDvdImage()
+{
+    QByteArray table(8, '\0');
+    table[0] = 1;
+    qToLittleEndian<quint16>(1, reinterpret_cast<uchar *>(table.data() + 6));
+    table += QByteArray(2, '\0');
+
+    QByteArray entry(8, '\0');
+    entry[0] = 8;
+    qToLittleEndian<quint16>(1, reinterpret_cast<uchar *>(entry.data() + 6));
+    table += entry + "VIDEO_TS";
+
+    QByteArray image((s_tableBlock + 1) * s_blockSize, '\0');
+    uchar *descriptor = reinterpret_cast<uchar *>(image.data() + 16 * s_blockSize);
+    descriptor[0] = 1;
+    memcpy(descriptor + 1, "CD001", 5);
+    descriptor[6] = 1;
+    qToLittleEndian<quint16>(s_blockSize, descriptor + 128);
+    qToLittleEndian<quint32>(table.size(), descriptor + 132);
+    qToLittleEndian<quint32>(s_tableBlock, descriptor + 140);
+
+    image.replace(s_tableBlock * s_blockSize, table.size(), table);
+    return image;
+}
+
+void SolidUDisks2DiscTest::initTestCase()
+{
+    const QByteArray image = videoDvdImage();
+    QVERIFY(m_image.open());
+    QCOMPARE(m_image.write(image), qint64(image.size()));
+    QVERIFY(m_image.flush());
+
+    m_fakeUdisks2 = new FakeUdisks2(this);
+    m_block = m_fakeUdisks2->addOpticalDrive(QStringLiteral("sr0"));
+    m_drive = QStringLiteral(UD2_DBUS_PATH_DRIVES) + "sr0";
+
+    // The disc is the image, with one data track
+    m_fakeUdisks2->insertMedia(m_block);
+    m_fakeUdisks2->changeProperty(m_drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("Media"), QStringLiteral("optical_dvd"));
+    m_fakeUdisks2->changeProperty(m_drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("OpticalNumDataTracks"), 1u);
+    // The content of the discs seen is shared between processes: this one is new
+    m_fakeUdisks2->changeProperty(m_drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("TimeMediaDetected"),
+                                  qulonglong(QDateTime::currentMSecsSinceEpoch()));
+    m_fakeUdisks2->changeProperty(m_block, QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), QStringLiteral("Device"), QFile::encodeName(m_image.fileName()));
+
+    QVERIFY(m_fakeUdisks2->registerOn(QDBusConnection::systemBus()));
+}
+
+void SolidUDisks2DiscTest::testDescriptionOnly()
+{
+    DeviceBackend::backendForUDI(m_drive, m_fakeUdisks2->interfacesAndProperties(m_drive));
+    DeviceBackend::backendForUDI(m_block, m_fakeUdisks2->interfacesAndProperties(m_block));
+
+    Device disc(m_block);
+    QSignalSpy spy(&disc, SIGNAL(propertyChanged(QMap<QString,int>)));
+
+    // Nothing but the description asks for the content, through a disc interface of its own
+    QVERIFY(!disc.description().isEmpty());
+    QCOMPARE(spy.count(), 0);
+
+    // The probe outlives it, and still tells the device
+    QTRY_VERIFY_WITH_TIMEOUT(spy.count() > 0, 5000);
+    const QMap<QString, int> changes = spy.first().first().value<QMap<QString, int> >();
+    QVERIFY(changes.contains(QStringLiteral("availableContent")));
+    QCOMPARE(disc.icon(), QStringLiteral("media-optical-dvd-video"));
+
+    DeviceBackend::destroyBackend(m_block);
+    DeviceBackend::destroyBackend(m_drive);
+}
+
+QTEST_MAIN_SYSTEM_DBUS(SolidUDisks2DiscTest)
+
+#include "solidudisks2disctest.moc"
@@ -0,0 +1,132 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "qtest_dbus.h"
+#include "fakeUdisks2.h"
+
+#include <QTest>
+#include <QThread>
+#include <QDBusConnection>
+
+#include "solid/devices/backends/udisks2/udisksdevicebackend.h"
+
+using namespace Solid::Backends::UDisks2;
+
+class SolidUDisks2PropertiesTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testPipelinedGetAll();
+    void testMissingProperties();
+    void cleanupTestCase();
+
+private:
+    FakeUdisks2 *m_fakeUdisks2;
+    QThread *m_serviceThread;
+    QStringList m_partitions;
+};
+
+static const int s_delay = 100;
+
+void SolidUDisks2PropertiesTest::initTestCase()
+{
+    m_fakeUdisks2 = new FakeUdisks2;
+    for (int i = 0; i < 4; ++i) {
+        const QString disk = QStringLiteral("sd%1").arg(i);
+        const QString drive = m_fakeUdisks2->addDrive(QStringLiteral("Fake_Disk_%1").arg(i));
+        const QString table = m_fakeUdisks2->addBlockDevice(disk, drive);
+        for (int part = 1; part < 4; ++part) {
+            m_partitions << m_fakeUdisks2->addPartition(disk + QLatin1Char('p') + QString::number(part), table, part);
+        }
+    }
+
+    // Each answer takes a while to come back, like over a busy bus
+    m_fakeUdisks2->setReplyDelay(s_delay);
+
+    m_serviceThread = new QThread(this);
+    m_fakeUdisks2->moveToThread(m_serviceThread);
+    m_serviceThread->start();
+
+    QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SystemBus, QStringLiteral("fakeUdisks2"));
+    QVERIFY(m_fakeUdisks2->registerOn(connection));
+}
+
+void SolidUDisks2PropertiesTest::cleanupTestCase()
+{
+    Q_FOREACH (const QString &udi, m_partitions) {
+        DeviceBackend::destroyBackend(udi);
+    }
+
+    QDBusConnection::disconnectFromBus(QStringLiteral("fakeUdisks2"));
+    m_serviceThread->quit();
+    m_serviceThread->wait();
+    delete m_fakeUdisks2;
+}
+
+void SolidUDisks2PropertiesTest::testPipelinedGetAll()
+{
+    // Partitions have the Block, Partition and Filesystem interfaces
+    const int interfaces = 3;
+
+    Q_FOREACH (const QString &udi, m_partitions) {
+        DeviceBackend *backend = DeviceBackend::backendForUDI(udi);
+        QCOMPARE(backend->interfaces().size(), interfaces);
+        backend->invalidateProperties();
+    }
+
+    m_fakeUdisks2->resetCallCount();
+    Q_FOREACH (const QString &udi, m_partitions) {
+        DeviceBackend *backend = DeviceBackend::backendForUDI(udi, false);
+        QCOMPARE(backend->prop("IdType").toString(), QStringLiteral("ext4"));
+        QCOMPARE(backend->prop("Number").toUInt(), udi.right(1).toUInt());
+        QVERIFY(backend->propertyExists("MountPoints"));
+    }
+
+    // Still one call per interface, but all those of a device in flight at
+    // once, a single round trip instead of one each
+    QCOMPARE(m_fakeUdisks2->callCount(), m_partitions.size() * interfaces);
+    QCOMPARE(m_fakeUdisks2->maxPendingCalls(), interfaces);
+}
+
+void SolidUDisks2PropertiesTest::testMissingProperties()
+{
+    DeviceBackend *backend = DeviceBackend::backendForUDI(m_partitions.first());
+    QVERIFY(backend->propertyExists("Size"));
+
+    // Asking for what doesn't exist never goes to the bus
+    m_fakeUdisks2->resetCallCount();
+    for (int i = 0; i < 10; ++i) {
+        QVERIFY(!backend->propertyExists("NoSuchProperty"));
+        QVERIFY(!backend->prop("HintNoSuchThing").isValid());
+    }
+    QCOMPARE(m_fakeUdisks2->callCount(), 0);
+
+    // Until it shows up
+    QVariantMap encrypted;
+    encrypted["NoSuchProperty"] = true;
+    m_fakeUdisks2->addInterface(m_partitions.first(), QStringLiteral(UD2_DBUS_INTERFACE_ENCRYPTED), encrypted);
+
+    QTRY_VERIFY_WITH_TIMEOUT(backend->propertyExists("NoSuchProperty"), 5000);
+    QCOMPARE(m_fakeUdisks2->callCount(), 0);
+}
+
+QTEST_GUILESS_MAIN_SYSTEM_DBUS(SolidUDisks2PropertiesTest)
+
+#include "solidudisks2propertiestest.moc"
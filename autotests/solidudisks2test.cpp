@@ -0,0 +1,400 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "qtest_dbus.h"
+#include "fakeUdisks2.h"
+
+#include <QTest>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QDBusConnection>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+#include <ctime>
+
+#include <solid/device.h>
+
+#include "solid/devices/backends/udisks2/udisksmanager.h"
+#include "solid/devices/backends/udisks2/udisksdevicebackend.h"
+#include "solid/devices/frontend/devicemanager_p.h"
+
+using namespace Solid::Backends::UDisks2;
+
+class SolidUDisks2Test : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testPerObjectEnumeration();
+    void testManagedObjectsEnumeration();
+    void testHotplugDispatch();
+    void testClearTextIndex();
+    void testClearTextIndexSeeded();
+    void testDerivedValuesCached();
+    void testIndexFollowsInterfaces();
+    void testLoadedOnWorkerThread();
+    void benchmarkManyLoopDevices();
+
+private:
+    FakeUdisks2 *m_fakeUdisks2;
+    int m_blockDevices;
+};
+
+void SolidUDisks2Test::initTestCase()
+{
+    m_fakeUdisks2 = new FakeUdisks2(this);
+
+    // 50 disks with 3 partitions each, plus an empty DVD writer: 200 block devices
+    for (int i = 0; i < 50; ++i) {
+        const QString disk = QStringLiteral("sd%1").arg(i);
+        const QString drive = m_fakeUdisks2->addDrive(QStringLiteral("Fake_Disk_%1").arg(i));
+        const QString table = m_fakeUdisks2->addBlockDevice(disk, drive);
+        for (int part = 1; part < 4; ++part) {
+            m_fakeUdisks2->addPartition(disk + QLatin1Char('p') + QString::number(part), table, part);
+        }
+    }
+    m_blockDevices = 200;
+
+    const QString dvd = m_fakeUdisks2->addDrive(QStringLiteral("Fake_DVD"), true);
+    m_fakeUdisks2->addBlockDevice(QStringLiteral("sr0"), dvd, false);
+
+    QVERIFY(m_fakeUdisks2->registerOn(QDBusConnection::systemBus()));
+}
+
+void SolidUDisks2Test::testPerObjectEnumeration()
+{
+    // What every DeviceBackend used to cost: Introspect and a GetAll per interface
+    const QStringList objects = m_fakeUdisks2->objects();
+
+    m_fakeUdisks2->resetCallCount();
+    QElapsedTimer timer;
+    timer.start();
+
+    Q_FOREACH (const QString &udi, objects) {
+        DeviceBackend *backend = DeviceBackend::backendForUDI(udi);
+        QVERIFY(!backend->interfaces().isEmpty());
+        QVERIFY(!backend->allProperties().isEmpty());
+    }
+
+    const qint64 elapsed = timer.elapsed();
+    const int calls = m_fakeUdisks2->callCount();
+    qDebug() << "Per object enumeration of" << objects.size() << "objects:" << calls << "round trips in" << elapsed << "ms";
+    QVERIFY(calls >= 2 * objects.size());
+
+    Q_FOREACH (const QString &udi, objects) {
+        DeviceBackend::destroyBackend(udi);
+    }
+}
+
+void SolidUDisks2Test::testManagedObjectsEnumeration()
+{
+    Manager manager(0);
+
+    m_fakeUdisks2->resetCallCount();
+    QElapsedTimer timer;
+    timer.start();
+
+    const QStringList udis = manager.allDevices();
+
+    const qint64 elapsed = timer.elapsed();
+    const int calls = m_fakeUdisks2->callCount();
+    qDebug() << "GetManagedObjects enumeration of" << udis.size() << "objects:" << calls << "round trips in" << elapsed << "ms";
+
+    // The empty DVD writer has no disc, so its block device isn't listed
+    QCOMPARE(udis.size(), m_blockDevices + 51);
+    QCOMPARE(calls, 1);
+
+    // Backends are fully primed, using them doesn't go to the bus
+    Q_FOREACH (const QString &udi, udis) {
+        Device device(udi);
+        QVERIFY(!device.interfaces().isEmpty());
+        QCOMPARE(device.isStorageAccess(), udi.section('/', -1).contains(QLatin1Char('p')));
+    }
+    Device partition(QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES) + "sd0p1");
+    QCOMPARE(partition.prop("Number").toUInt(), 1u);
+    QCOMPARE(partition.prop("IdType").toString(), QStringLiteral("ext4"));
+    QCOMPARE(m_fakeUdisks2->callCount(), 1);
+}
+
+void SolidUDisks2Test::testHotplugDispatch()
+{
+    // Every signal reaches only the backend of its object, whatever the number of backends
+    const int loopDevices = 500;
+    QStringList loops;
+    for (int i = 0; i < loopDevices; ++i) {
+        loops << m_fakeUdisks2->addBlockDevice(QStringLiteral("loop%1").arg(i), QString(), false);
+    }
+
+    int changes = 0;
+    Q_FOREACH (const QString &udi, loops) {
+        DeviceBackend *backend = DeviceBackend::backendForUDI(udi, m_fakeUdisks2->interfacesAndProperties(udi));
+        connect(backend, &DeviceBackend::changed, [&changes]() { ++changes; });
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    std::clock_t cpu = std::clock();
+
+    Q_FOREACH (const QString &udi, loops) {
+        m_fakeUdisks2->changeProperty(udi, QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), QStringLiteral("Size"), qulonglong(1048576));
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(changes, loopDevices, 30000);
+
+    qDebug() << loopDevices << "PropertiesChanged with" << loops.size() << "backends:"
+             << (std::clock() - cpu) * 1000 / CLOCKS_PER_SEC << "ms CPU," << timer.elapsed() << "ms";
+
+    timer.restart();
+    cpu = std::clock();
+
+    Q_FOREACH (const QString &udi, loops) {
+        m_fakeUdisks2->addInterface(udi, QStringLiteral(UD2_DBUS_INTERFACE_FILESYSTEM), QVariantMap());
+    }
+    const QString lastLoop = loops.last();
+    QTRY_VERIFY_WITH_TIMEOUT(DeviceBackend::backendForUDI(lastLoop, false)->interfaces().contains(QStringLiteral(UD2_DBUS_INTERFACE_FILESYSTEM)), 30000);
+
+    qDebug() << loopDevices << "InterfacesAdded with" << loops.size() << "backends:"
+             << (std::clock() - cpu) * 1000 / CLOCKS_PER_SEC << "ms CPU," << timer.elapsed() << "ms";
+
+    Q_FOREACH (const QString &udi, loops) {
+        DeviceBackend *backend = DeviceBackend::backendForUDI(udi, false);
+        QCOMPARE(backend->prop("Size").toULongLong(), qulonglong(1048576));
+        QCOMPARE(backend->interfaces().count(QStringLiteral(UD2_DBUS_INTERFACE_FILESYSTEM)), 1);
+    }
+    QCOMPARE(changes, loopDevices);
+
+    Q_FOREACH (const QString &udi, loops) {
+        DeviceBackend::destroyBackend(udi);
+    }
+}
+
+void SolidUDisks2Test::testClearTextIndex()
+{
+    const QString luks = m_fakeUdisks2->addBlockDevice(QStringLiteral("luks0"), QString(), false);
+    DeviceBackend *backend = DeviceBackend::backendForUDI(luks, m_fakeUdisks2->interfacesAndProperties(luks));
+    QVERIFY(backend);
+    QVERIFY(DeviceBackend::clearTextDevice(luks).isEmpty());
+
+    // Unlocking makes the cleartext device appear
+    const QString clearText = QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES) + "dm_2d0";
+    QVariantMap block;
+    block["Device"] = QByteArray("/dev/dm-0");
+    block["CryptoBackingDevice"] = QVariant::fromValue(QDBusObjectPath(luks));
+    m_fakeUdisks2->addInterface(clearText, QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), block);
+    QTRY_COMPARE_WITH_TIMEOUT(DeviceBackend::clearTextDevice(luks), clearText, 5000);
+
+    // Looking it up doesn't cost anything on the bus
+    m_fakeUdisks2->resetCallCount();
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 10000; ++i) {
+        QCOMPARE(DeviceBackend::clearTextDevice(luks), clearText);
+    }
+    qDebug() << "10000 cleartext lookups in" << timer.elapsed() << "ms";
+    QCOMPARE(m_fakeUdisks2->callCount(), 0);
+
+    // Locking makes it go away
+    m_fakeUdisks2->removeInterface(clearText, QStringLiteral(UD2_DBUS_INTERFACE_BLOCK));
+    QTRY_VERIFY_WITH_TIMEOUT(DeviceBackend::clearTextDevice(luks).isEmpty(), 5000);
+
+    // Backends primed from GetManagedObjects feed the index too
+    VariantMapMap clearTextObject;
+    clearTextObject.insert(QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), block);
+    DeviceBackend::backendForUDI(clearText, clearTextObject);
+    QCOMPARE(DeviceBackend::clearTextDevice(luks), clearText);
+
+    DeviceBackend::destroyBackend(clearText);
+    DeviceBackend::destroyBackend(luks);
+}
+
+void SolidUDisks2Test::testClearTextIndexSeeded()
+{
+    // No backend left: nothing follows the signals, the index is gone
+    Q_FOREACH (const QString &udi, m_fakeUdisks2->objects()) {
+        DeviceBackend::destroyBackend(udi);
+    }
+
+    // A container unlocked while nobody was looking
+    const QString luks = m_fakeUdisks2->addBlockDevice(QStringLiteral("luks1"), QString(), false);
+    const QString clearText = m_fakeUdisks2->addClearTextDevice(QStringLiteral("dm_2d1"), luks);
+    DeviceBackend::backendForUDI(luks, m_fakeUdisks2->interfacesAndProperties(luks));
+
+    // The first miss asks the service once, the next ones are answered from the index
+    m_fakeUdisks2->resetCallCount();
+    QCOMPARE(DeviceBackend::clearTextDevice(luks), clearText);
+    QVERIFY(DeviceBackend::clearTextDevice(QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES) + "sd0").isEmpty());
+    QCOMPARE(m_fakeUdisks2->callCount(), 1);
+
+    DeviceBackend::destroyBackend(luks);
+}
+
+void SolidUDisks2Test::testDerivedValuesCached()
+{
+    const QString udi = QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES) + "sd1p1";
+    const QString drive = QStringLiteral(UD2_DBUS_PATH_DRIVES) + "Fake_Disk_1";
+    DeviceBackend::backendForUDI(drive, m_fakeUdisks2->interfacesAndProperties(drive));
+    DeviceBackend::backendForUDI(udi, m_fakeUdisks2->interfacesAndProperties(udi));
+
+    Device partition(udi);
+    const QString description = partition.description();
+    const QString icon = partition.icon();
+    QVERIFY(!description.isEmpty());
+    QVERIFY(!icon.isEmpty());
+
+    // Asking again doesn't look at a single property
+    const int lookups = DeviceBackend::propertyLookups();
+    for (int i = 0; i < 1000; ++i) {
+        QCOMPARE(partition.description(), description);
+        QCOMPARE(partition.icon(), icon);
+    }
+    QCOMPARE(DeviceBackend::propertyLookups(), lookups);
+
+    // Until a property of the device changes
+    m_fakeUdisks2->changeProperty(udi, QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), QStringLiteral("IdLabel"), QStringLiteral("Photos"));
+    QTRY_COMPARE_WITH_TIMEOUT(partition.description(), QStringLiteral("Photos"), 5000);
+    m_fakeUdisks2->changeProperty(udi, QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), QStringLiteral("IdLabel"), QString());
+    QTRY_COMPARE_WITH_TIMEOUT(partition.description(), description, 5000);
+
+    // Or one of its drive
+    m_fakeUdisks2->changeProperty(drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("Removable"), true);
+    QTRY_VERIFY_WITH_TIMEOUT(partition.description() != description, 5000);
+    m_fakeUdisks2->changeProperty(drive, QStringLiteral(UD2_DBUS_INTERFACE_DRIVE), QStringLiteral("Removable"), false);
+    QTRY_COMPARE_WITH_TIMEOUT(partition.description(), description, 5000);
+
+    DeviceBackend::destroyBackend(udi);
+    DeviceBackend::destroyBackend(drive);
+}
+
+static bool contains(const QList<Solid::Device> &devices, const QString &udi)
+{
+    Q_FOREACH (const Solid::Device &device, devices) {
+        if (device.udi() == udi) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool listedAs(const QString &udi, Solid::DeviceInterface::Type type)
+{
+    return contains(Solid::Device::listFromType(type), udi);
+}
+
+void SolidUDisks2Test::testIndexFollowsInterfaces()
+{
+    const QString udi = QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES) + "sd49p3";
+    QVERIFY(listedAs(udi, Solid::DeviceInterface::StorageAccess));
+    QVERIFY(listedAs(udi, Solid::DeviceInterface::StorageVolume));
+
+    // Wiping the file system leaves the partition there, with one interface less
+    const QVariantMap filesystem = m_fakeUdisks2->interfacesAndProperties(udi).value(QStringLiteral(UD2_DBUS_INTERFACE_FILESYSTEM));
+    m_fakeUdisks2->removeInterface(udi, QStringLiteral(UD2_DBUS_INTERFACE_FILESYSTEM));
+    QTRY_VERIFY_WITH_TIMEOUT(!listedAs(udi, Solid::DeviceInterface::StorageAccess), 5000);
+    QVERIFY(listedAs(udi, Solid::DeviceInterface::StorageVolume));
+    QVERIFY(!contains(Solid::Device::listFromQuery(QStringLiteral("IS StorageAccess")), udi));
+
+    // Formatting it gives it back
+    m_fakeUdisks2->addInterface(udi, QStringLiteral(UD2_DBUS_INTERFACE_FILESYSTEM), filesystem);
+    QTRY_VERIFY_WITH_TIMEOUT(listedAs(udi, Solid::DeviceInterface::StorageAccess), 5000);
+    QVERIFY(listedAs(udi, Solid::DeviceInterface::StorageVolume));
+}
+
+void SolidUDisks2Test::testLoadedOnWorkerThread()
+{
+    Solid::DeviceManagerPrivate manager;
+    QSet<Solid::DeviceInterface::Type> types;
+    types << Solid::DeviceInterface::StorageDrive;
+
+    // The first query loads the backend, here from a worker thread without an event loop
+    QFutureWatcher<QStringList> watcher;
+    watcher.setFuture(QtConcurrent::run(&manager, &Solid::DeviceManagerPrivate::indexedDevices, types, QString()));
+    QTRY_VERIFY_WITH_TIMEOUT(watcher.isFinished(), 30000);
+    QVERIFY(watcher.result().contains(QStringLiteral(UD2_DBUS_PATH_DRIVES) + "Fake_Disk_0"));
+
+    // It came to the manager's thread, along with everything it listens through
+    Manager *backend = 0;
+    Q_FOREACH (QObject *loaded, manager.loadedBackends()) {
+        if (qobject_cast<Manager *>(loaded)) {
+            backend = static_cast<Manager *>(loaded);
+        }
+    }
+    QVERIFY(backend);
+    QCOMPARE(backend->thread(), manager.thread());
+    Q_FOREACH (QObject *child, backend->findChildren<QObject *>()) {
+        QCOMPARE(child->thread(), manager.thread());
+    }
+
+    // And so did the backends of the devices it found there
+    DeviceBackend *driveBackend = DeviceBackend::backendForUDI(QStringLiteral(UD2_DBUS_PATH_DRIVES) + "Fake_Disk_0", false);
+    QVERIFY(driveBackend);
+    QCOMPARE(driveBackend->thread(), manager.thread());
+
+    // So hotplug still gets there once the worker is done
+    const QString drive = m_fakeUdisks2->plugDisk(QStringLiteral("sdw"), 1).first();
+    QTRY_VERIFY_WITH_TIMEOUT(manager.indexedDevices(types, QString()).contains(drive), 5000);
+}
+
+void SolidUDisks2Test::benchmarkManyLoopDevices()
+{
+    // A container host with thousands of loop devices
+    const int loopDevices = 5000;
+    for (int i = 0; i < loopDevices; ++i) {
+        m_fakeUdisks2->addBlockDevice(QStringLiteral("manyloop%1").arg(i), QString(), false);
+    }
+
+    Manager manager(0);
+    const int devices = manager.allDevices().size();
+    QVERIFY(devices > loopDevices);
+
+    // Hotplug doesn't walk the known devices anymore
+    QSignalSpy added(&manager, SIGNAL(deviceAdded(QString)));
+    QSignalSpy removed(&manager, SIGNAL(deviceRemoved(QString)));
+    const int hotplugged = 100;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < hotplugged; ++i) {
+        QVariantMap block;
+        block["Device"] = QByteArray("/dev/hotloop") + QByteArray::number(i);
+        block["Drive"] = QVariant::fromValue(QDBusObjectPath("/"));
+        m_fakeUdisks2->addInterface(QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES "hotloop%1").arg(i), QStringLiteral(UD2_DBUS_INTERFACE_BLOCK), block);
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(added.count(), hotplugged, 30000);
+    for (int i = 0; i < hotplugged; ++i) {
+        m_fakeUdisks2->removeInterface(QStringLiteral(UD2_DBUS_PATH_BLOCKDEVICES "hotloop%1").arg(i), QStringLiteral(UD2_DBUS_INTERFACE_BLOCK));
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(removed.count(), hotplugged, 30000);
+    qDebug() << hotplugged << "loop devices plugged and unplugged among" << devices << "in" << timer.elapsed() << "ms";
+
+    // Type queries come straight from their bucket
+    QStringList volumes;
+    QBENCHMARK {
+        volumes = manager.devicesFromQuery(QString(), Solid::DeviceInterface::StorageVolume);
+    }
+    QVERIFY(volumes.size() >= m_blockDevices);
+    Q_FOREACH (const QString &udi, volumes) {
+        QVERIFY(!udi.contains(QStringLiteral("manyloop")));
+    }
+
+    QStringList blocks = manager.devicesFromQuery(QString(), Solid::DeviceInterface::Block);
+    QCOMPARE(blocks.size(), devices);
+}
+
+QTEST_GUILESS_MAIN_SYSTEM_DBUS(SolidUDisks2Test)
+
+#include "solidudisks2test.moc"
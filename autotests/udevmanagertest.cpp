@@ -0,0 +1,115 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "solid/devices/backends/udev/udevmanager.h"
+
+using Solid::Backends::UDev::UDevManager;
+
+class UDevManagerTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testEnumeratesWatchedSubsystems();
+    void testVerdictsStable();
+
+private:
+    int replay(UDevManager *manager);
+
+    UdevQt::DeviceList m_devices;
+};
+
+QTEST_GUILESS_MAIN(UDevManagerTest)
+
+void UDevManagerTest::initTestCase()
+{
+    // The subsystems the udev manager watches
+    QStringList subsystems;
+    subsystems << "processor" << "cpu" << "sound" << "tty" << "dvb" << "net" << "usb" << "input";
+
+    UdevQt::Client client;
+    m_devices = client.devicesBySubsystems(subsystems);
+    if (m_devices.isEmpty()) {
+        QSKIP("udev knows of no device here");
+    }
+}
+
+// What a coldplug replay does, `udevadm trigger --action=add`: all the devices come again
+int UDevManagerTest::replay(UDevManager *manager)
+{
+    QSignalSpy spy(manager, SIGNAL(deviceAdded(QString)));
+    Q_FOREACH (const UdevQt::Device &device, m_devices) {
+        QMetaObject::invokeMethod(manager, "slotDeviceAdded", Qt::DirectConnection, Q_ARG(UdevQt::Device, device));
+    }
+    return spy.count();
+}
+
+void UDevManagerTest::testEnumeratesWatchedSubsystems()
+{
+    // What looking at every single device would find of interest
+    UDevManager reference(0);
+    QSignalSpy spy(&reference, SIGNAL(deviceAdded(QString)));
+    UdevQt::Client client;
+    Q_FOREACH (const UdevQt::Device &device, client.allDevices()) {
+        QMetaObject::invokeMethod(&reference, "slotDeviceAdded", Qt::DirectConnection, Q_ARG(UdevQt::Device, device));
+    }
+
+    QSet<QString> expected;
+    Q_FOREACH (const QList<QVariant> &arguments, spy) {
+        expected << arguments.first().toString();
+    }
+
+    // Only enumerating the watched subsystems misses none of them
+    UDevManager manager(0);
+    const QStringList devices = manager.allDevices();
+    QCOMPARE(devices.toSet(), expected);
+    QCOMPARE(devices.size(), expected.size());
+}
+
+void UDevManagerTest::testVerdictsStable()
+{
+    UDevManager manager(0);
+
+    const int interesting = replay(&manager);
+    qDebug() << interesting << "devices of interest out of" << m_devices.size();
+
+    // Remembered verdicts, same answers
+    QCOMPARE(replay(&manager), interesting);
+
+    // A device gone and back is judged again
+    UDevManager other(0);
+    Q_FOREACH (const UdevQt::Device &device, m_devices) {
+        QMetaObject::invokeMethod(&other, "slotDeviceRemoved", Qt::DirectConnection, Q_ARG(UdevQt::Device, device));
+    }
+    QCOMPARE(replay(&other), interesting);
+
+    // And so is a changed one, which is no news when its verdict holds
+    QSignalSpy added(&manager, SIGNAL(deviceAdded(QString)));
+    QSignalSpy removed(&manager, SIGNAL(deviceRemoved(QString)));
+    manager.allDevices();
+    Q_FOREACH (const UdevQt::Device &device, m_devices) {
+        QMetaObject::invokeMethod(&manager, "slotDeviceChanged", Qt::DirectConnection, Q_ARG(UdevQt::Device, device));
+    }
+    QCOMPARE(added.count(), 0);
+    QCOMPARE(removed.count(), 0);
+}
+
+#include "udevmanagertest.moc"
@@ -0,0 +1,344 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QThread>
+#include <QtTest/QtTest>
+
+#include "solid/devices/backends/shared/udevqtmonitorreader.h"
+
+using UdevQt::MonitorReader;
+
+/* The netlink socket of udev is played by a socket pair: the events are
+ * datagrams written to one end, and read from the other one */
+
+static QAtomicInt s_disposed;
+
+static void *receiveDatagram(void *source)
+{
+    char buffer[256];
+    const ssize_t size = recv(*static_cast<int *>(source), buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (size < 0) {
+        return 0;
+    }
+    return new QByteArray(buffer, size);
+}
+
+// A datagram saying "overflow" plays the ENOBUFS of a netlink socket which lost events
+static void *receiveWithOverflow(void *source)
+{
+    QByteArray *event = static_cast<QByteArray *>(receiveDatagram(source));
+    if (event && *event == "overflow") {
+        delete event;
+        errno = ENOBUFS;
+        return 0;
+    }
+    return event;
+}
+
+static void disposeDatagram(void *event)
+{
+    s_disposed.ref();
+    delete static_cast<QByteArray *>(event);
+}
+
+static QByteArray eventName(int i)
+{
+    return "add@/devices/pci0000:00/0000:00:03.0/net/vf" + QByteArray::number(i);
+}
+
+static bool inject(int fd, int first, int count)
+{
+    for (int i = first; i < first + count; ++i) {
+        const QByteArray event = eventName(i);
+        ssize_t sent;
+        do {
+            sent = send(fd, event.constData(), event.size(), 0);
+        } while (sent < 0 && errno == EINTR);
+        if (sent != event.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A storm made by a thread of its own, blocking when the socket is full
+class Injector : public QThread
+{
+public:
+    Injector(int fd, int count) : m_fd(fd), m_count(count), m_ok(false) { }
+    bool ok() const
+    {
+        return m_ok;
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        m_ok = inject(m_fd, 0, m_count);
+    }
+
+private:
+    int m_fd;
+    int m_count;
+    bool m_ok;
+};
+
+// What the client does with the reader thread
+class BatchSink : public QObject
+{
+    Q_OBJECT
+public:
+    BatchSink() : reader(0), wakeups(0), overflows(0) { }
+
+    MonitorReader *reader;
+    QList<QByteArray> events;
+    int wakeups;
+    int overflows;
+
+public Q_SLOTS:
+    void eventsReady()
+    {
+        ++wakeups;
+        if (!reader) {
+            return;
+        }
+        Q_FOREACH (void *event, reader->takeEvents()) {
+            events << *static_cast<QByteArray *>(event);
+            delete static_cast<QByteArray *>(event);
+        }
+        if (reader->takeOverflow()) {
+            ++overflows;
+        }
+    }
+};
+
+// What the client does without: one event per activation of the socket notifier
+class NotifierSink : public QObject
+{
+    Q_OBJECT
+public:
+    NotifierSink(int fd)
+        : notifier(fd, QSocketNotifier::Read), fd(fd), wakeups(0)
+    {
+        connect(&notifier, SIGNAL(activated(int)), this, SLOT(readyRead()));
+    }
+
+    QSocketNotifier notifier;
+    int fd;
+    QList<QByteArray> events;
+    int wakeups;
+
+public Q_SLOTS:
+    void readyRead()
+    {
+        ++wakeups;
+        notifier.setEnabled(false);
+        QByteArray *event = static_cast<QByteArray *>(receiveDatagram(&fd));
+        notifier.setEnabled(true);
+        if (event) {
+            events << *event;
+            delete event;
+        }
+    }
+};
+
+class UdevMonitorReaderTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void testDrainsInBatches();
+    void testStorm();
+    void testStopDisposesPending();
+    void testOverflow();
+    void benchmarkStorm_data();
+    void benchmarkStorm();
+
+private:
+    int m_fds[2];
+};
+
+QTEST_GUILESS_MAIN(UdevMonitorReaderTest)
+
+void UdevMonitorReaderTest::init()
+{
+    QCOMPARE(socketpair(AF_UNIX, SOCK_DGRAM, 0, m_fds), 0);
+    fcntl(m_fds[0], F_SETFL, fcntl(m_fds[0], F_GETFL) | O_NONBLOCK);
+    s_disposed = 0;
+}
+
+void UdevMonitorReaderTest::cleanup()
+{
+    close(m_fds[0]);
+    close(m_fds[1]);
+}
+
+static bool checkOrder(const QList<QByteArray> &events, int count)
+{
+    if (events.size() != count) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (events.at(i) != eventName(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void UdevMonitorReaderTest::testDrainsInBatches()
+{
+    // Events waiting when the reader wakes up all come in one call
+    const int count = 100;
+    QVERIFY(inject(m_fds[1], 0, count));
+
+    BatchSink sink;
+    MonitorReader reader(m_fds[0], &m_fds[0], receiveDatagram, disposeDatagram, &sink, "eventsReady");
+    sink.reader = &reader;
+    reader.start();
+
+    QTRY_COMPARE(sink.events.size(), count);
+    QVERIFY(checkOrder(sink.events, count));
+    QCOMPARE(sink.wakeups, 1);
+
+    // and the reader keeps going
+    QVERIFY(inject(m_fds[1], count, 1));
+    QTRY_COMPARE(sink.events.size(), count + 1);
+    QCOMPARE(sink.events.last(), eventName(count));
+    QCOMPARE(sink.wakeups, 2);
+}
+
+void UdevMonitorReaderTest::testStorm()
+{
+    // More than the socket holds: nothing is lost, the order is kept
+    const int count = 20000;
+
+    BatchSink sink;
+    MonitorReader reader(m_fds[0], &m_fds[0], receiveDatagram, disposeDatagram, &sink, "eventsReady");
+    sink.reader = &reader;
+    reader.start();
+
+    Injector injector(m_fds[1], count);
+    injector.start();
+
+    QTRY_COMPARE_WITH_TIMEOUT(sink.events.size(), count, 30000);
+    QVERIFY(injector.wait());
+    QVERIFY(injector.ok());
+    QVERIFY(checkOrder(sink.events, count));
+    qDebug() << count << "events in" << sink.wakeups << "wakeups of the receiving thread";
+}
+
+void UdevMonitorReaderTest::testStopDisposesPending()
+{
+    const int count = 50;
+    QVERIFY(inject(m_fds[1], 0, count));
+
+    BatchSink sink;
+    MonitorReader *reader = new MonitorReader(m_fds[0], &m_fds[0], receiveDatagram, disposeDatagram, &sink, "eventsReady");
+    reader->start();
+
+    // Wait for the reader to drain the socket, without taking the events
+    char peek;
+    QTRY_VERIFY(recv(m_fds[0], &peek, 1, MSG_PEEK | MSG_DONTWAIT) < 0);
+
+    delete reader;
+    QCOMPARE(s_disposed.load(), count);
+
+    // Its call to the sink may come later, and find nothing
+    QTest::qWait(10);
+    QVERIFY(sink.events.isEmpty());
+}
+
+void UdevMonitorReaderTest::testOverflow()
+{
+    BatchSink sink;
+    MonitorReader reader(m_fds[0], &m_fds[0], receiveWithOverflow, disposeDatagram, &sink, "eventsReady");
+    sink.reader = &reader;
+
+    // The events around the loss all come, and the loss is told once
+    QVERIFY(inject(m_fds[1], 0, 10));
+    QCOMPARE(send(m_fds[1], "overflow", 8, 0), ssize_t(8));
+    QVERIFY(inject(m_fds[1], 10, 10));
+    reader.start();
+
+    QTRY_COMPARE(sink.events.size(), 20);
+    QTRY_COMPARE(sink.overflows, 1);
+    QVERIFY(checkOrder(sink.events, 20));
+
+    // A loss with nothing else to read still gets to the receiver
+    const int wakeups = sink.wakeups;
+    QCOMPARE(send(m_fds[1], "overflow", 8, 0), ssize_t(8));
+    QTRY_COMPARE(sink.overflows, 2);
+    QCOMPARE(sink.wakeups, wakeups + 1);
+    QCOMPARE(sink.events.size(), 20);
+}
+
+void UdevMonitorReaderTest::benchmarkStorm_data()
+{
+    QTest::addColumn<bool>("readerThread");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("owner thread, 300 events") << false << 300;
+    QTest::newRow("reader thread, 300 events") << true << 300;
+    QTest::newRow("owner thread, 5000 events") << false << 5000;
+    QTest::newRow("reader thread, 5000 events") << true << 5000;
+}
+
+void UdevMonitorReaderTest::benchmarkStorm()
+{
+    QFETCH(bool, readerThread);
+    QFETCH(int, count);
+
+    int wakeups = 0;
+    QBENCHMARK {
+        Injector injector(m_fds[1], count);
+
+        if (readerThread) {
+            BatchSink sink;
+            MonitorReader reader(m_fds[0], &m_fds[0], receiveDatagram, disposeDatagram, &sink, "eventsReady");
+            sink.reader = &reader;
+            reader.start();
+            injector.start();
+            while (sink.events.size() < count) {
+                QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+            }
+            wakeups = sink.wakeups;
+        } else {
+            NotifierSink sink(m_fds[0]);
+            injector.start();
+            while (sink.events.size() < count) {
+                QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+            }
+            wakeups = sink.wakeups;
+        }
+
+        injector.wait();
+    }
+
+    qDebug() << count << "events," << wakeups << "wakeups of the receiving thread";
+}
+
+#include "udevmonitorreadertest.moc"
@@ -0,0 +1,188 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QtCore/QObject>
+#include <QtTest/QtTest>
+
+#include "solid/devices/backends/shared/udevqt.h"
+
+class UdevQtDeviceTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void testDevicesBySubsystems();
+    void testCachedProperties();
+    void testCopiesShareCache();
+    void benchmarkDeviceProperty_data();
+    void benchmarkDeviceProperty();
+
+private:
+    UdevQt::DeviceList devices(bool cached, int count);
+
+    QStringList m_sysfsPaths;
+};
+
+QTEST_GUILESS_MAIN(UdevQtDeviceTest)
+
+// What UDevDevice::queryDeviceInterface() and the udev manager ask every device
+static const char *const s_names[] = {
+    "ID_MEDIA_PLAYER", "ID_GPHOTO2", "SOUND_FORM_FACTOR", "DEVPATH",
+    "ID_INPUT_MOUSE", "ID_INPUT_TOUCHPAD", "ID_INPUT_TABLET", "ID_INPUT_TOUCHSCREEN",
+    "ID_VENDOR", "ID_VENDOR_FROM_DATABASE", "ID_MODEL", "ID_MODEL_FROM_DATABASE",
+    "SUBSYSTEM", "DEVTYPE"
+};
+
+void UdevQtDeviceTest::initTestCase()
+{
+    UdevQt::Client client;
+    Q_FOREACH (const UdevQt::Device &device, client.allDevices()) {
+        m_sysfsPaths << device.sysfsPath();
+    }
+
+    if (m_sysfsPaths.isEmpty()) {
+        QSKIP("udev knows of no device here");
+    }
+}
+
+static QStringList sysfsPaths(const UdevQt::DeviceList &devices)
+{
+    QStringList paths;
+    Q_FOREACH (const UdevQt::Device &device, devices) {
+        paths << device.sysfsPath();
+    }
+    paths.sort();
+    return paths;
+}
+
+void UdevQtDeviceTest::testDevicesBySubsystems()
+{
+    UdevQt::Client client;
+
+    QStringList netAndInput;
+    QStringList usbDevices;
+    Q_FOREACH (const UdevQt::Device &device, client.allDevices()) {
+        if (device.subsystem() == QLatin1String("net") || device.subsystem() == QLatin1String("input")) {
+            netAndInput << device.sysfsPath();
+        } else if (device.subsystem() == QLatin1String("usb") && device.devType() == QLatin1String("usb_device")) {
+            usbDevices << device.sysfsPath();
+        }
+    }
+    netAndInput.sort();
+    usbDevices.sort();
+
+    // Several subsystems at once, and a devtype within one
+    QCOMPARE(sysfsPaths(client.devicesBySubsystems(QStringList() << "net" << "input")), netAndInput);
+    QCOMPARE(sysfsPaths(client.devicesBySubsystems(QStringList() << "usb/usb_device")), usbDevices);
+    QVERIFY(client.devicesBySubsystems(QStringList() << "solid-no-such-subsystem").isEmpty());
+}
+
+// As many devices as asked for, each one read afresh from udev
+UdevQt::DeviceList UdevQtDeviceTest::devices(bool cached, int count)
+{
+    UdevQt::Client client;
+    client.setPropertyCacheEnabled(cached);
+
+    UdevQt::DeviceList list;
+    for (int i = 0; list.size() < count && i < 2 * count; ++i) {
+        const UdevQt::Device device = client.deviceBySysfsPath(m_sysfsPaths.at(i % m_sysfsPaths.size()));
+        if (device.isValid()) {
+            list << device;
+        }
+    }
+    return list;
+}
+
+void UdevQtDeviceTest::testCachedProperties()
+{
+    const UdevQt::DeviceList plain = devices(false, m_sysfsPaths.size());
+    const UdevQt::DeviceList cached = devices(true, m_sysfsPaths.size());
+    QCOMPARE(cached.size(), plain.size());
+
+    for (int i = 0; i < plain.size(); ++i) {
+        QStringList names = plain.at(i).deviceProperties();
+        names << QStringLiteral("SOLID_NO_SUCH_PROPERTY") << QString();
+
+        Q_FOREACH (const QString &name, names) {
+            const QVariant expected = plain.at(i).deviceProperty(name);
+            const QVariant actual = cached.at(i).deviceProperty(name);
+            QCOMPARE(actual.isValid(), expected.isValid());
+            QCOMPARE(actual.toString(), expected.toString());
+        }
+    }
+}
+
+void UdevQtDeviceTest::testCopiesShareCache()
+{
+    const UdevQt::DeviceList list = devices(true, 1);
+    QCOMPARE(list.size(), 1);
+
+    const UdevQt::Device device = list.first();
+    // Copied before anything was looked up
+    const UdevQt::Device early(device);
+    const QVariant devPath = device.deviceProperty(QStringLiteral("DEVPATH"));
+    QVERIFY(devPath.isValid());
+    QCOMPARE(early.deviceProperty(QStringLiteral("DEVPATH")).toString().constData(),
+             devPath.toString().constData());
+
+    // The copy answers with the very same string, the table was not read again
+    UdevQt::Device copy(device);
+    QCOMPARE(copy.deviceProperty(QStringLiteral("DEVPATH")).toString().constData(),
+             devPath.toString().constData());
+
+    UdevQt::Device assigned;
+    assigned = device;
+    QCOMPARE(assigned.deviceProperty(QStringLiteral("DEVPATH")).toString().constData(),
+             devPath.toString().constData());
+}
+
+void UdevQtDeviceTest::benchmarkDeviceProperty_data()
+{
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("libudev") << false;
+    QTest::newRow("property table") << true;
+}
+
+void UdevQtDeviceTest::benchmarkDeviceProperty()
+{
+    QFETCH(bool, cached);
+
+    QStringList names;
+    for (uint i = 0; i < sizeof(s_names) / sizeof(*s_names); ++i) {
+        names << QString::fromLatin1(s_names[i]);
+    }
+
+    // 10k devices, as asked by queryDeviceInterface() for every interface type
+    const int types = 5;
+    int found = 0;
+    QBENCHMARK_ONCE {
+        const UdevQt::DeviceList list = devices(cached, 10000);
+        Q_FOREACH (const UdevQt::Device &device, list) {
+            for (int type = 0; type < types; ++type) {
+                Q_FOREACH (const QString &name, names) {
+                    found += device.deviceProperty(name).isValid();
+                }
+            }
+        }
+    }
+
+    QVERIFY(found > 0);
+}
+
+#include "udevqtdevicetest.moc"
@@ -42,8 +42,8 @@
 
 using namespace Solid::Backends::Fake;
 
-FakeDevice::FakeDevice(const QString &udi, const QMap<QString, QVariant> &propertyMap)
-    : Solid::Ifaces::Device(), d(new Private)
+FakeDevice::FakeDevice(const QString &udi, const QMap<QString, QVariant> &propertyMap, bool exported)
+    : Solid::Ifaces::Device(), d(new Private), m_exported(exported)
 {
     d->udi = udi;
     d->propertyMap = propertyMap;
@@ -52,15 +52,17 @@ FakeDevice::FakeDevice(const QString &udi, const QMap<QString, QVariant> &proper
     d->locked = false;
     d->broken = false;
 
-    QDBusConnection::sessionBus().registerObject(udi, this, QDBusConnection::ExportNonScriptableSlots);
+    if (m_exported) {
+        QDBusConnection::sessionBus().registerObject(udi, this, QDBusConnection::ExportNonScriptableSlots);
 
-    // Force instantiation of all the device interfaces
-    // this way they'll get exported on the bus
-    // that means they'll be created twice, but that won't be
-    // a problem for unit testing.
-    Q_FOREACH (const QString &interface, d->interfaceList) {
-        Solid::DeviceInterface::Type type = Solid::DeviceInterface::stringToType(interface);
-        createDeviceInterface(type);
+        // Force instantiation of all the device interfaces
+        // this way they'll get exported on the bus
+        // that means they'll be created twice, but that won't be
+        // a problem for unit testing.
+        Q_FOREACH (const QString &interface, d->interfaceList) {
+            Solid::DeviceInterface::Type type = Solid::DeviceInterface::stringToType(interface);
+            createDeviceInterface(type);
+        }
     }
 
     connect(d.data(), SIGNAL(propertyChanged(QMap<QString,int>)),
@@ -70,7 +72,7 @@ FakeDevice::FakeDevice(const QString &udi, const QMap<QString, QVariant> &proper
 }
 
 FakeDevice::FakeDevice(const FakeDevice &dev)
-    : Solid::Ifaces::Device(), d(dev.d)
+    : Solid::Ifaces::Device(), d(dev.d), m_exported(false)
 {
     connect(d.data(), SIGNAL(propertyChanged(QMap<QString,int>)),
             this, SIGNAL(propertyChanged(QMap<QString,int>)));
@@ -80,7 +82,9 @@ FakeDevice::FakeDevice(const FakeDevice &dev)
 
 FakeDevice::~FakeDevice()
 {
-    QDBusConnection::sessionBus().unregisterObject(d->udi, QDBusConnection::UnregisterTree);
+    if (m_exported) {
+        QDBusConnection::sessionBus().unregisterObject(d->udi, QDBusConnection::UnregisterTree);
+    }
 }
 
 QString FakeDevice::udi() const
@@ -303,7 +307,7 @@ QObject *FakeDevice::createDeviceInterface(const Solid::DeviceInterface::Type &t
         break;
     }
 
-    if (iface) {
+    if (iface && m_exported) {
         QDBusConnection::sessionBus().registerObject(d->udi + '/' + Solid::DeviceInterface::typeToString(type), iface,
                 QDBusConnection::ExportNonScriptableSlots);
     }
@@ -35,7 +35,11 @@ class FakeDevice : public Solid::Ifaces::Device
 {
     Q_OBJECT
 public:
-    FakeDevice(const QString &udi, const QMap<QString, QVariant> &propertyMap);
+    /**
+     * Only @p exported devices get registered on the session bus, along
+     * with their device interfaces. Copies never are.
+     */
+    FakeDevice(const QString &udi, const QMap<QString, QVariant> &propertyMap, bool exported = false);
     FakeDevice(const FakeDevice &dev);
     ~FakeDevice();
 
@@ -74,6 +78,7 @@ Q_SIGNALS:
 private:
     class Private;
     QSharedPointer<Private> d;
+    bool m_exported;
 };
 }
 }
@@ -22,13 +22,12 @@
 #include "fakedevice.h"
 
 // Qt includes
-#include <QtXml/QDomDocument>
-#include <QtXml/QDomElement>
-#include <QtXml/QDomNode>
 #include <QtCore/QDebug>
 #include <QtCore/QFile>
 #include <QtCore/QString>
 #include <QtCore/QTimer>
+#include <QtCore/QXmlStreamReader>
+#include <QtCore/QXmlStreamWriter>
 #include <QtDBus/QDBusConnection>
 
 using namespace Solid::Backends::Fake;
@@ -40,6 +39,8 @@ public:
     QMap<QString, QMap<QString, QVariant> > hiddenDevices;
     QString xmlFile;
     QSet<Solid::DeviceInterface::Type> supportedInterfaces;
+    // Whether each device gets registered on the session bus, all but those of synthetic machines
+    bool exportDevices;
 };
 
 FakeManager::FakeManager(QObject *parent, const QString &xmlFile)
@@ -47,6 +48,7 @@ FakeManager::FakeManager(QObject *parent, const QString &xmlFile)
 {
     QString machineXmlFile = xmlFile;
     d->xmlFile = machineXmlFile;
+    d->exportDevices = true;
 
     QDBusConnection::sessionBus().registerObject("/org/kde/solid/fakehw", this, QDBusConnection::ExportNonScriptableSlots);
 
@@ -172,7 +174,7 @@ void FakeManager::plug(const QString &udi)
 {
     if (d->hiddenDevices.contains(udi)) {
         QMap<QString, QVariant> properties = d->hiddenDevices.take(udi);
-        d->loadedDevices[udi] = new FakeDevice(udi, properties);
+        d->loadedDevices[udi] = new FakeDevice(udi, properties, d->exportDevices);
         emit deviceAdded(udi);
     }
 }
@@ -195,58 +197,145 @@ void FakeManager::parseMachineFile()
         return;
     }
 
-    QDomDocument fakeDocument;
-    if (!fakeDocument.setContent(&machineFile)) {
-        qWarning() << Q_FUNC_INFO << "Error while creating the QDomDocument." << endl;
-        machineFile.close();
+    qDebug() << Q_FUNC_INFO << "Parsing fake computer XML: " << d->xmlFile << endl;
+
+    // Streamed, big machines don't need to fit in a DOM tree first
+    QXmlStreamReader reader(&machineFile);
+    if (!reader.readNextStartElement()) {
+        qWarning() << Q_FUNC_INFO << "Error while reading the machine:" << reader.errorString() << endl;
         return;
     }
-    machineFile.close();
 
-    qDebug() << Q_FUNC_INFO << "Parsing fake computer XML: " << d->xmlFile << endl;
-    QDomElement mainElement = fakeDocument.documentElement();
-    QDomNode node = mainElement.firstChild();
-    while (!node.isNull()) {
-        QDomElement tempElement = node.toElement();
-        if (!tempElement.isNull() && tempElement.tagName() == QLatin1String("device")) {
-            FakeDevice *tempDevice = parseDeviceElement(tempElement);
-            if (tempDevice) {
-                Q_ASSERT(!d->loadedDevices.contains(tempDevice->udi()));
-                d->loadedDevices.insert(tempDevice->udi(), tempDevice);
-                emit deviceAdded(tempDevice->udi());
-            }
+    // Exporting the thousands of devices of a synthetic machine on the bus
+    // costs more than the parsing, and nothing drives them through D-Bus
+    d->exportDevices = reader.attributes().value(QLatin1String("synthetic")) != QLatin1String("true");
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() != QLatin1String("device")) {
+            reader.skipCurrentElement();
+            continue;
+        }
+
+        FakeDevice *tempDevice = parseDeviceElement(reader);
+        if (tempDevice) {
+            Q_ASSERT(!d->loadedDevices.contains(tempDevice->udi()));
+            d->loadedDevices.insert(tempDevice->udi(), tempDevice);
+            emit deviceAdded(tempDevice->udi());
         }
+    }
 
-        node = node.nextSibling();
+    if (reader.hasError()) {
+        qWarning() << Q_FUNC_INFO << "Error while reading the machine:" << reader.errorString()
+                   << "at line" << reader.lineNumber() << endl;
     }
 }
 
-FakeDevice *FakeManager::parseDeviceElement(const QDomElement &deviceElement)
+FakeDevice *FakeManager::parseDeviceElement(QXmlStreamReader &reader)
 {
     FakeDevice *device = 0;
     QMap<QString, QVariant> propertyMap;
-    QString udi = deviceElement.attribute("udi");
-
-    QDomNode propertyNode = deviceElement.firstChild();
-    while (!propertyNode.isNull()) {
-        QDomElement propertyElement = propertyNode.toElement();
-        if (!propertyElement.isNull() && propertyElement.tagName() == QLatin1String("property")) {
-            QString propertyKey;
-            QVariant propertyValue;
+    QString udi = reader.attributes().value("udi").toString();
 
-            propertyKey = propertyElement.attribute("key");
-            propertyValue = QVariant(propertyElement.text());
+    while (reader.readNextStartElement()) {
+        if (reader.name() == QLatin1String("property")) {
+            const QString propertyKey = reader.attributes().value("key").toString();
+            const QVariant propertyValue = QVariant(reader.readElementText(QXmlStreamReader::IncludeChildElements));
 
             propertyMap.insert(propertyKey, propertyValue);
+        } else {
+            reader.skipCurrentElement();
         }
-
-        propertyNode = propertyNode.nextSibling();
     }
 
     if (!propertyMap.isEmpty()) {
-        device = new FakeDevice(udi, propertyMap);
+        device = new FakeDevice(udi, propertyMap, d->exportDevices);
     }
 
     return device;
 }
 
+QByteArray FakeManager::syntheticMachine(int processors, int drives, int volumesPerDrive)
+{
+    QByteArray xml;
+    QXmlStreamWriter writer(&xml);
+    writer.setAutoFormatting(true);
+
+    const QString prefix = QStringLiteral("/org/kde/solid/fakehw/");
+    const QString computer = prefix + QStringLiteral("computer");
+
+    // Writes a <device> element, closed when going out of scope
+    struct Device {
+        QXmlStreamWriter &writer;
+        Device(QXmlStreamWriter &w, const QString &udi) : writer(w)
+        {
+            writer.writeStartElement(QStringLiteral("device"));
+            writer.writeAttribute(QStringLiteral("udi"), udi);
+        }
+        ~Device()
+        {
+            writer.writeEndElement();
+        }
+        void property(const QString &key, const QString &value)
+        {
+            writer.writeStartElement(QStringLiteral("property"));
+            writer.writeAttribute(QStringLiteral("key"), key);
+            writer.writeCharacters(value);
+            writer.writeEndElement();
+        }
+    };
+
+    writer.writeStartDocument();
+    writer.writeStartElement(QStringLiteral("machine"));
+    writer.writeAttribute(QStringLiteral("synthetic"), QStringLiteral("true"));
+
+    {
+        Device root(writer, computer);
+        root.property(QStringLiteral("name"), QStringLiteral("Computer"));
+        root.property(QStringLiteral("vendor"), QStringLiteral("Solid"));
+    }
+
+    for (int i = 0; i < processors; ++i) {
+        Device cpu(writer, prefix + QStringLiteral("acpi_CPU%1").arg(i));
+        cpu.property(QStringLiteral("name"), QStringLiteral("Solid Processor #%1").arg(i));
+        cpu.property(QStringLiteral("interfaces"), QStringLiteral("Processor"));
+        cpu.property(QStringLiteral("parent"), computer);
+        cpu.property(QStringLiteral("number"), QString::number(i));
+        cpu.property(QStringLiteral("maxSpeed"), QStringLiteral("3200"));
+        cpu.property(QStringLiteral("canChangeFrequency"), QStringLiteral("true"));
+    }
+
+    for (int i = 0; i < drives; ++i) {
+        const QString drive = prefix + QStringLiteral("storage_serial_SYNTH%1").arg(i);
+        {
+            Device storage(writer, drive);
+            storage.property(QStringLiteral("name"), QStringLiteral("Synthetic Disk #%1").arg(i));
+            storage.property(QStringLiteral("interfaces"), QStringLiteral("StorageDrive,Block"));
+            storage.property(QStringLiteral("parent"), computer);
+            storage.property(QStringLiteral("major"), QStringLiteral("8"));
+            storage.property(QStringLiteral("minor"), QString::number(i * 16));
+            storage.property(QStringLiteral("device"), QStringLiteral("/dev/sd%1").arg(i));
+            storage.property(QStringLiteral("bus"), QStringLiteral("sata"));
+            storage.property(QStringLiteral("driveType"), QStringLiteral("disk"));
+            storage.property(QStringLiteral("isHotpluggable"), QStringLiteral("true"));
+        }
+
+        for (int j = 1; j <= volumesPerDrive; ++j) {
+            Device volume(writer, prefix + QStringLiteral("volume_synth_%1_%2").arg(i).arg(j));
+            volume.property(QStringLiteral("name"), QStringLiteral("Volume %1").arg(j));
+            volume.property(QStringLiteral("interfaces"), QStringLiteral("Block,StorageVolume,StorageAccess"));
+            volume.property(QStringLiteral("parent"), drive);
+            volume.property(QStringLiteral("major"), QStringLiteral("8"));
+            volume.property(QStringLiteral("minor"), QString::number(i * 16 + j));
+            volume.property(QStringLiteral("device"), QStringLiteral("/dev/sd%1%2").arg(i).arg(j));
+            volume.property(QStringLiteral("usage"), QStringLiteral("filesystem"));
+            volume.property(QStringLiteral("fsType"), QStringLiteral("ext4"));
+            volume.property(QStringLiteral("uuid"), QStringLiteral("synth-%1-%2").arg(i).arg(j));
+            volume.property(QStringLiteral("size"), QStringLiteral("1073741824"));
+        }
+    }
+
+    writer.writeEndElement();
+    writer.writeEndDocument();
+
+    return xml;
+}
@@ -23,7 +23,7 @@
 
 #include <solid/devices/ifaces/devicemanager.h>
 
-class QDomElement;
+class QXmlStreamReader;
 
 using namespace Solid::Ifaces;
 
@@ -61,6 +61,16 @@ public:
     QObject *createDevice(const QString &udi) Q_DECL_OVERRIDE;
     virtual FakeDevice *findDevice(const QString &udi);
 
+    /**
+     * Generates the XML description of a machine with the given number of
+     * processors, and of drives each holding @p volumesPerDrive volumes,
+     * for tests and benchmarks which need a big machine.
+     *
+     * Its devices aren't registered on the session bus, unlike those of
+     * the machine files written by hand.
+     */
+    static QByteArray syntheticMachine(int processors, int drives, int volumesPerDrive);
+
 public Q_SLOTS:
     void plug(const QString &udi);
     void unplug(const QString &udi);
@@ -71,13 +81,14 @@ private Q_SLOTS:
      * Parse the XML file that represent the fake machine.
      */
     void parseMachineFile();
+
+private:
     /**
      * @internal
-     * Parse a device node and the return the device.
+     * Parse a device element and the return the device.
      */
-    FakeDevice *parseDeviceElement(const QDomElement &element);
+    FakeDevice *parseDeviceElement(QXmlStreamReader &reader);
 
-private:
     QStringList findDeviceStringMatch(const QString &key, const QString &value);
     QStringList findDeviceByDeviceInterface(Solid::DeviceInterface::Type type);
 
@@ -193,6 +193,7 @@ void Solid::Backends::Fstab::FstabHandling::_k_updateFstabMountPointsCache()
 
 QStringList Solid::Backends::Fstab::FstabHandling::deviceList()
 {
+    QMutexLocker locker(&globalFstabCache->m_cacheMutex);
     _k_updateFstabMountPointsCache();
     _k_updateMtabMountPointsCache();
 
@@ -204,6 +205,7 @@ QStringList Solid::Backends::Fstab::FstabHandling::deviceList()
 
 QStringList Solid::Backends::Fstab::FstabHandling::mountPoints(const QString &device)
 {
+    QMutexLocker locker(&globalFstabCache->m_cacheMutex);
     _k_updateFstabMountPointsCache();
     _k_updateMtabMountPointsCache();
 
@@ -354,16 +356,19 @@ void Solid::Backends::Fstab::FstabHandling::_k_updateMtabMountPointsCache()
 
 QStringList Solid::Backends::Fstab::FstabHandling::currentMountPoints(const QString &device)
 {
+    QMutexLocker locker(&globalFstabCache->m_cacheMutex);
     _k_updateMtabMountPointsCache();
     return globalFstabCache->m_mtabCache.values(device);
 }
 
 void Solid::Backends::Fstab::FstabHandling::flushMtabCache()
 {
+    QMutexLocker locker(&globalFstabCache->m_cacheMutex);
     globalFstabCache->m_mtabCacheValid = false;
 }
 
 void Solid::Backends::Fstab::FstabHandling::flushFstabCache()
 {
+    QMutexLocker locker(&globalFstabCache->m_cacheMutex);
     globalFstabCache->m_fstabCacheValid = false;
 }
@@ -24,6 +24,7 @@
 
 #include <QtCore/QString>
 #include <QtCore/QMultiHash>
+#include <QtCore/QMutex>
 
 class QProcess;
 class QObject;
@@ -58,6 +59,8 @@ private:
 
     typedef QMultiHash<QString, QString> QStringMultiHash;
 
+    // The devices read the caches from any thread, the manager flushes them from its own
+    QMutex m_cacheMutex;
     QStringMultiHash m_mtabCache;
     QStringMultiHash m_fstabCache;
     bool m_fstabCacheValid;
@@ -31,8 +31,7 @@ using namespace Solid::Backends::Shared;
 FstabManager::FstabManager(QObject *parent)
     : Solid::Ifaces::DeviceManager(parent)
 {
-    m_supportedInterfaces << Solid::DeviceInterface::StorageAccess;
-    m_supportedInterfaces << Solid::DeviceInterface::NetworkShare;
+    m_supportedInterfaces = supportedInterfaceTypes();
 
     m_deviceList = FstabHandling::deviceList();
 
@@ -50,11 +49,20 @@ QSet<Solid::DeviceInterface::Type> FstabManager::supportedInterfaces() const
     return m_supportedInterfaces;
 }
 
+QSet<Solid::DeviceInterface::Type> FstabManager::supportedInterfaceTypes()
+{
+    QSet<Solid::DeviceInterface::Type> types;
+    types << Solid::DeviceInterface::StorageAccess;
+    types << Solid::DeviceInterface::NetworkShare;
+    return types;
+}
+
 QStringList FstabManager::allDevices()
 {
     QStringList result;
 
     result << udiPrefix();
+    QMutexLocker locker(&m_deviceListMutex);
     Q_FOREACH (const QString &device, m_deviceList) {
         result << udiPrefix() + "/" + device;
     }
@@ -94,7 +102,10 @@ QObject *FstabManager::createDevice(const QString &udi)
     } else {
         // global device manager makes sure udi starts with udi prefix + '/'
         QString internalName = udi.mid(udiPrefix().length() + 1, -1);
-        if (!m_deviceList.contains(internalName)) {
+        m_deviceListMutex.lock();
+        const bool known = m_deviceList.contains(internalName);
+        m_deviceListMutex.unlock();
+        if (!known) {
             return 0;
         }
 
@@ -129,7 +140,9 @@ void FstabManager::_k_updateDeviceList()
         }
     }
 
+    m_deviceListMutex.lock();
     m_deviceList = deviceList;
+    m_deviceListMutex.unlock();
 
     Q_FOREACH (const QString &device, newlist) {
         if (!oldlist.contains(device)) {
@@ -23,6 +23,7 @@
 
 #include <solid/devices/ifaces/devicemanager.h>
 #include <solid/deviceinterface.h>
+#include <QtCore/QMutex>
 #include <QtCore/QStringList>
 #include <QtCore/QSet>
 
@@ -44,6 +45,10 @@ public:
 
     QString udiPrefix() const Q_DECL_OVERRIDE;
     QSet<Solid::DeviceInterface::Type> supportedInterfaces() const Q_DECL_OVERRIDE;
+    /**
+     * What supportedInterfaces() answers, known without constructing a manager
+     */
+    static QSet<Solid::DeviceInterface::Type> supportedInterfaceTypes();
     QStringList allDevices() Q_DECL_OVERRIDE;
     QStringList devicesFromQuery(const QString &parentUdi, Solid::DeviceInterface::Type type) Q_DECL_OVERRIDE;
     QObject *createDevice(const QString &udi) Q_DECL_OVERRIDE;
@@ -57,7 +62,9 @@ private Q_SLOTS:
 
 private:
     QSet<Solid::DeviceInterface::Type> m_supportedInterfaces;
+    // Written by the slots on the manager's thread, read by the enumerating threads
     QStringList m_deviceList;
+    QMutex m_deviceListMutex;
     void _k_updateDeviceList();
 };
 
@@ -27,25 +27,59 @@ extern "C"
 #include <libudev.h>
 }
 
+#include <QtCore/QSharedData>
+#include <QtCore/QVector>
+
 class QByteArray;
 class QSocketNotifier;
 
 namespace UdevQt
 {
 
+/**
+ * All the properties of a udev device, read at once.
+ *
+ * A udev device never changes, a change event brings a new one: the table
+ * is built along with the device and shared by all its copies. The names are
+ * interned, the lookups hash probes into a flat array.
+ */
+class PropertyTable : public QSharedData
+{
+public:
+    explicit PropertyTable(struct udev_device *udev);
+
+    // An invalid QVariant for the properties missing or empty, like udev
+    QVariant value(const QString &name) const;
+
+private:
+    struct Entry {
+        QString name;
+        QVariant value;
+    };
+
+    // Open addressing, a null name marks a free entry
+    QVector<Entry> m_entries;
+    uint m_mask;
+};
+
 class DevicePrivate
 {
 public:
-    DevicePrivate(struct udev_device *udev_, bool ref = true);
+    DevicePrivate(struct udev_device *udev_, bool ref = true, bool cacheProperties_ = false);
+    DevicePrivate(const DevicePrivate &other);
     ~DevicePrivate();
     DevicePrivate &operator=(const DevicePrivate &other);
 
     QString decodePropertyValue(const QByteArray &encoded) const;
 
     struct udev_device *udev;
+    bool cacheProperties;
+    // Never built lazily: the copies handed to other threads couldn't share it
+    QExplicitlySharedDataPointer<PropertyTable> properties;
 };
 
 class Client;
+class MonitorReader;
 class ClientPrivate
 {
 public:
@@ -56,13 +90,23 @@ public:
 
     void init(const QStringList &subsystemList, ListenToWhat what);
     void setWatchedSubsystems(const QStringList &subsystemList);
+    void stopMonitor();
+    void applyReceiveBufferSize(struct udev_monitor *m);
     void _uq_monitorReadyRead(int fd);
+    void _uq_monitorEventsReady();
+    void dispatchEvent(struct udev_device *dev);
     DeviceList deviceListFromEnumerate(struct udev_enumerate *en);
 
     struct udev *udev;
+    // The context of the monitor, only the reader thread's when it has one
+    struct udev *monitorUdev;
     struct udev_monitor *monitor;
     Client *q;
     QSocketNotifier *monitorNotifier;
+    MonitorReader *monitorReader;
+    Client::MonitorMode monitorMode;
+    int receiveBufferSize;
+    bool cacheProperties;
     QStringList watchedSubsystems;
 };
 
@@ -20,26 +20,39 @@
 
 #include "udevqtclient.h"
 #include "udevqt_p.h"
+#include "udevqtmonitorreader.h"
 
+#include <QtCore/QMultiHash>
 #include <QtCore/QSocketNotifier>
 #include <qplatformdefs.h>
 
+#include <errno.h>
+#include <sys/socket.h>
+
 namespace UdevQt
 {
 
 ClientPrivate::ClientPrivate(Client *q_)
-    : udev(0), monitor(0), q(q_), monitorNotifier(0)
+    : udev(0), monitorUdev(0), monitor(0), q(q_), monitorNotifier(0), monitorReader(0),
+      monitorMode(Client::MonitorOnOwnerThread), receiveBufferSize(0),
+      cacheProperties(false)
 {
 }
 
 ClientPrivate::~ClientPrivate()
 {
+    stopMonitor();
     udev_unref(udev);
-    delete monitorNotifier;
+}
 
-    if (monitor) {
-        udev_monitor_unref(monitor);
-    }
+static void *receiveDevice(void *monitor)
+{
+    return udev_monitor_receive_device(static_cast<struct udev_monitor *>(monitor));
+}
+
+static void disposeDevice(void *device)
+{
+    udev_device_unref(static_cast<struct udev_device *>(device));
 }
 
 void ClientPrivate::init(const QStringList &subsystemList, ListenToWhat what)
@@ -53,11 +66,20 @@ void ClientPrivate::init(const QStringList &subsystemList, ListenToWhat what)
 
 void ClientPrivate::setWatchedSubsystems(const QStringList &subsystemList)
 {
+    // libudev is not thread-safe: a reader thread gets a context of its own,
+    // which nothing but its monitor uses
+    struct udev *newUdev = monitorMode == Client::MonitorOnReaderThread ? udev_new() : udev_ref(udev);
+    if (!newUdev) {
+        qWarning("UdevQt: unable to create udev context for the monitor");
+        return;
+    }
+
     // create a listener
-    struct udev_monitor *newM = udev_monitor_new_from_netlink(udev, "udev");
+    struct udev_monitor *newM = udev_monitor_new_from_netlink(newUdev, "udev");
 
     if (!newM) {
         qWarning("UdevQt: unable to create udev monitor connection");
+        udev_unref(newUdev);
         return;
     }
 
@@ -75,34 +97,105 @@ void ClientPrivate::setWatchedSubsystems(const QStringList &subsystemList)
     }
 
     // start the new monitor receiving
+    applyReceiveBufferSize(newM);
     udev_monitor_enable_receiving(newM);
-    QSocketNotifier *sn = new QSocketNotifier(udev_monitor_get_fd(newM), QSocketNotifier::Read);
-    QObject::connect(sn, SIGNAL(activated(int)), q, SLOT(_uq_monitorReadyRead(int)));
+    QSocketNotifier *sn = 0;
+    MonitorReader *reader = 0;
+    if (monitorMode == Client::MonitorOnReaderThread) {
+        reader = new MonitorReader(udev_monitor_get_fd(newM), newM, receiveDevice, disposeDevice,
+                                   q, "_uq_monitorEventsReady");
+    } else {
+        sn = new QSocketNotifier(udev_monitor_get_fd(newM), QSocketNotifier::Read, q);
+        QObject::connect(sn, SIGNAL(activated(int)), q, SLOT(_uq_monitorReadyRead(int)));
+    }
 
     // kill any previous monitor
-    delete monitorNotifier;
-    if (monitor) {
-        udev_monitor_unref(monitor);
-    }
+    stopMonitor();
 
     // and save our new one
+    monitorUdev = newUdev;
     monitor = newM;
     monitorNotifier = sn;
+    monitorReader = reader;
     watchedSubsystems = subsystemList;
+
+    if (reader) {
+        reader->start();
+    }
+}
+
+void ClientPrivate::stopMonitor()
+{
+    // the reader thread uses the monitor until it is gone
+    delete monitorReader;
+    monitorReader = 0;
+    delete monitorNotifier;
+    monitorNotifier = 0;
+
+    if (monitor) {
+        udev_monitor_unref(monitor);
+        monitor = 0;
+    }
+
+    if (monitorUdev) {
+        udev_unref(monitorUdev);
+        monitorUdev = 0;
+    }
+}
+
+void ClientPrivate::applyReceiveBufferSize(struct udev_monitor *m)
+{
+    if (receiveBufferSize <= 0 || udev_monitor_set_receive_buffer_size(m, receiveBufferSize) == 0) {
+        return;
+    }
+
+    // SO_RCVBUFFORCE needs CAP_NET_ADMIN, others get what net.core.rmem_max allows
+    if (setsockopt(udev_monitor_get_fd(m), SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize)) < 0
+            && errno != EPERM) {
+        qWarning("UdevQt: unable to set the monitor receive buffer to %d bytes", receiveBufferSize);
+    }
 }
 
 void ClientPrivate::_uq_monitorReadyRead(int fd)
 {
     Q_UNUSED(fd);
     monitorNotifier->setEnabled(false);
+    errno = 0;
     struct udev_device *dev = udev_monitor_receive_device(monitor);
+    const bool overflowed = !dev && errno == ENOBUFS;
     monitorNotifier->setEnabled(true);
 
+    if (overflowed) {
+        emit q->monitorOverflowed();
+    }
+
     if (!dev) {
         return;
     }
 
-    Device device(new DevicePrivate(dev, false));
+    dispatchEvent(dev);
+}
+
+void ClientPrivate::_uq_monitorEventsReady()
+{
+    if (!monitorReader) {
+        return;
+    }
+
+    const QList<void *> events = monitorReader->takeEvents();
+    const bool overflowed = monitorReader->takeOverflow();
+    Q_FOREACH (void *event, events) {
+        dispatchEvent(static_cast<struct udev_device *>(event));
+    }
+
+    if (overflowed) {
+        emit q->monitorOverflowed();
+    }
+}
+
+void ClientPrivate::dispatchEvent(struct udev_device *dev)
+{
+    Device device(new DevicePrivate(dev, false, cacheProperties));
 
     QByteArray action(udev_device_get_action(dev));
     if (action == "add") {
@@ -135,7 +228,7 @@ DeviceList ClientPrivate::deviceListFromEnumerate(struct udev_enumerate *en)
             continue;
         }
 
-        ret << Device(new DevicePrivate(ud, false));
+        ret << Device(new DevicePrivate(ud, false, cacheProperties));
     }
 
     udev_enumerate_unref(en);
@@ -188,6 +281,49 @@ void Client::setWatchedSubsystems(const QStringList &subsystemList)
     d->setWatchedSubsystems(subsystemList);
 }
 
+Client::MonitorMode Client::monitorMode() const
+{
+    return d->monitorMode;
+}
+
+void Client::setMonitorMode(MonitorMode mode)
+{
+    if (d->monitorMode == mode) {
+        return;
+    }
+
+    d->monitorMode = mode;
+
+    // restart the monitor the new way
+    if (d->monitor) {
+        d->setWatchedSubsystems(d->watchedSubsystems);
+    }
+}
+
+int Client::receiveBufferSize() const
+{
+    return d->receiveBufferSize;
+}
+
+void Client::setReceiveBufferSize(int bytes)
+{
+    d->receiveBufferSize = bytes;
+
+    if (d->monitor) {
+        d->applyReceiveBufferSize(d->monitor);
+    }
+}
+
+bool Client::isPropertyCacheEnabled() const
+{
+    return d->cacheProperties;
+}
+
+void Client::setPropertyCacheEnabled(bool enabled)
+{
+    d->cacheProperties = enabled;
+}
+
 DeviceList Client::devicesByProperty(const QString &property, const QVariant &value)
 {
     struct udev_enumerate *en = udev_enumerate_new(d->udev);
@@ -215,6 +351,45 @@ DeviceList Client::devicesBySubsystem(const QString &subsystem)
     return d->deviceListFromEnumerate(en);
 }
 
+DeviceList Client::devicesBySubsystems(const QStringList &subsystemList)
+{
+    // Takes the same "subsystem[/devtype]" list as setWatchedSubsystems()
+    struct udev_enumerate *en = udev_enumerate_new(d->udev);
+    QMultiHash<QString, QString> devTypes;
+
+    Q_FOREACH (const QString &subsysDevtype, subsystemList) {
+        const int ix = subsysDevtype.indexOf("/");
+        const QString subsystem = (ix > 0) ? subsysDevtype.left(ix) : subsysDevtype;
+
+        // Several subsystem matches are or'ed by udev
+        udev_enumerate_add_match_subsystem(en, subsystem.toLatin1().constData());
+
+        if (ix > 0) {
+            devTypes.insert(subsystem, subsysDevtype.mid(ix + 1));
+        }
+    }
+
+    DeviceList ret = d->deviceListFromEnumerate(en);
+
+    if (devTypes.isEmpty()) {
+        return ret;
+    }
+
+    // udev can't enumerate by devtype, filter those afterwards
+    QMutableListIterator<Device> it(ret);
+    while (it.hasNext()) {
+        const Device &device = it.next();
+        const QList<QString> wanted = devTypes.values(device.subsystem());
+
+        if (!wanted.isEmpty() && !wanted.contains(device.devType())
+                && !subsystemList.contains(device.subsystem())) {
+            it.remove();
+        }
+    }
+
+    return ret;
+}
+
 Device Client::deviceByDeviceFile(const QString &deviceFile)
 {
     QT_STATBUF sb;
@@ -235,7 +410,7 @@ Device Client::deviceByDeviceFile(const QString &deviceFile)
         return Device();
     }
 
-    return Device(new DevicePrivate(ud, false));
+    return Device(new DevicePrivate(ud, false, d->cacheProperties));
 }
 
 Device Client::deviceBySysfsPath(const QString &sysfsPath)
@@ -246,7 +421,7 @@ Device Client::deviceBySysfsPath(const QString &sysfsPath)
         return Device();
     }
 
-    return Device(new DevicePrivate(ud, false));
+    return Device(new DevicePrivate(ud, false, d->cacheProperties));
 }
 
 Device Client::deviceBySubsystemAndName(const QString &subsystem, const QString &name)
@@ -259,7 +434,7 @@ Device Client::deviceBySubsystemAndName(const QString &subsystem, const QString
         return Device();
     }
 
-    return Device(new DevicePrivate(ud, false));
+    return Device(new DevicePrivate(ud, false, d->cacheProperties));
 }
 
 }
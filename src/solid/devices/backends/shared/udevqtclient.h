@@ -40,6 +40,13 @@ class Client : public QObject
     Q_PROPERTY(QStringList watchedSubsystems READ watchedSubsystems WRITE setWatchedSubsystems)
 
 public:
+    enum MonitorMode {
+        // The client's thread reads one event each time the socket is readable
+        MonitorOnOwnerThread,
+        // A thread of its own drains the socket, the events come to the client's thread in batches
+        MonitorOnReaderThread
+    };
+
     Client(QObject *parent = 0);
     Client(const QStringList &subsystemList, QObject *parent = 0);
     ~Client();
@@ -47,9 +54,22 @@ public:
     QStringList watchedSubsystems() const;
     void setWatchedSubsystems(const QStringList &subsystemList);
 
+    MonitorMode monitorMode() const;
+    void setMonitorMode(MonitorMode mode);
+
+    // Size of the kernel buffer for the events not read yet, 0 for the system default
+    int receiveBufferSize() const;
+    void setReceiveBufferSize(int bytes);
+
+    // Whether the devices from now on read all their properties at the first
+    // Device::deviceProperty() call, and answer the next ones from memory
+    bool isPropertyCacheEnabled() const;
+    void setPropertyCacheEnabled(bool enabled);
+
     DeviceList allDevices();
     DeviceList devicesByProperty(const QString &property, const QVariant &value);
     DeviceList devicesBySubsystem(const QString &subsystem);
+    DeviceList devicesBySubsystems(const QStringList &subsystemList);
     Device deviceByDeviceFile(const QString &deviceFile);
     Device deviceBySysfsPath(const QString &sysfsPath);
     Device deviceBySubsystemAndName(const QString &subsystem, const QString &name);
@@ -61,9 +81,13 @@ Q_SIGNALS:
     void deviceOnlined(const UdevQt::Device &dev);
     void deviceOfflined(const UdevQt::Device &dev);
 
+    // The monitor's buffer overflowed, some events were lost for good
+    void monitorOverflowed();
+
 private:
     friend class ClientPrivate;
     Q_PRIVATE_SLOT(d, void _uq_monitorReadyRead(int fd))
+    Q_PRIVATE_SLOT(d, void _uq_monitorEventsReady())
     ClientPrivate *d;
 };
 
@@ -22,16 +22,103 @@
 #include "udevqt_p.h"
 
 #include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 
 namespace UdevQt
 {
 
-DevicePrivate::DevicePrivate(struct udev_device *udev_, bool ref)
-    : udev(udev_)
+/* The names of the properties, the same few dozens on all the devices:
+ * every table shares the one copy of each */
+class PropertyNames
+{
+public:
+    QString intern(const char *name)
+    {
+        const QByteArray key = QByteArray::fromRawData(name, qstrlen(name));
+
+        QMutexLocker locker(&m_mutex);
+        QHash<QByteArray, QString>::const_iterator it = m_names.constFind(key);
+        if (it != m_names.constEnd()) {
+            return *it;
+        }
+
+        const QString interned = QString::fromLatin1(name);
+        m_names.insert(QByteArray(name), interned);
+        return interned;
+    }
+
+private:
+    QMutex m_mutex;
+    QHash<QByteArray, QString> m_names;
+};
+
+Q_GLOBAL_STATIC(PropertyNames, s_propertyNames)
+
+PropertyTable::PropertyTable(struct udev_device *udev)
+    : m_mask(0)
+{
+    struct udev_list_entry *list = udev_device_get_properties_list_entry(udev);
+    struct udev_list_entry *entry;
+
+    int count = 0;
+    udev_list_entry_foreach(entry, list) {
+        ++count;
+    }
+
+    // at most half full, so that misses are short too
+    int size = 8;
+    while (size < 2 * count) {
+        size *= 2;
+    }
+    m_entries.resize(size);
+    m_mask = size - 1;
+
+    udev_list_entry_foreach(entry, list) {
+        const char *value = udev_list_entry_get_value(entry);
+        if (!value || !*value) {
+            continue;
+        }
+
+        const QString name = s_propertyNames->intern(udev_list_entry_get_name(entry));
+        uint i = qHash(name) & m_mask;
+        while (!m_entries.at(i).name.isNull() && m_entries.at(i).name != name) {
+            i = (i + 1) & m_mask;
+        }
+        m_entries[i].name = name;
+        m_entries[i].value = QVariant::fromValue(QString::fromLatin1(value));
+    }
+}
+
+QVariant PropertyTable::value(const QString &name) const
+{
+    uint i = qHash(name) & m_mask;
+    while (!m_entries.at(i).name.isNull()) {
+        if (m_entries.at(i).name == name) {
+            return m_entries.at(i).value;
+        }
+        i = (i + 1) & m_mask;
+    }
+
+    return QVariant();
+}
+
+DevicePrivate::DevicePrivate(struct udev_device *udev_, bool ref, bool cacheProperties_)
+    : udev(udev_), cacheProperties(cacheProperties_)
 {
     if (ref) {
         udev_device_ref(udev);
     }
+    if (cacheProperties) {
+        properties = new PropertyTable(udev);
+    }
+}
+
+DevicePrivate::DevicePrivate(const DevicePrivate &other)
+    : udev(udev_device_ref(other.udev))
+    , cacheProperties(other.cacheProperties)
+    , properties(other.properties)
+{
 }
 
 DevicePrivate::~DevicePrivate()
@@ -43,6 +130,8 @@ DevicePrivate &DevicePrivate::operator=(const DevicePrivate &other)
 {
     udev_device_unref(udev);
     udev = udev_device_ref(other.udev);
+    cacheProperties = other.cacheProperties;
+    properties = other.properties;
     return *this;
 }
 
@@ -84,7 +173,7 @@ Device::Device()
 Device::Device(const Device &other)
 {
     if (other.d) {
-        d = new DevicePrivate(other.d->udev);
+        d = new DevicePrivate(*other.d);
     } else {
         d = 0;
     }
@@ -111,7 +200,7 @@ Device &Device::operator=(const Device &other)
         return *this;
     }
     if (!d) {
-        d = new DevicePrivate(other.d->udev);
+        d = new DevicePrivate(*other.d);
     } else {
         *d = *other.d;
     }
@@ -234,7 +323,7 @@ Device Device::parent() const
         return Device();
     }
 
-    return Device(new DevicePrivate(p));
+    return Device(new DevicePrivate(p, true, d->cacheProperties));
 }
 
 QVariant Device::deviceProperty(const QString &name) const
@@ -243,6 +332,10 @@ QVariant Device::deviceProperty(const QString &name) const
         return QVariant();
     }
 
+    if (d->cacheProperties) {
+        return d->properties->value(name);
+    }
+
     QByteArray propName = name.toLatin1();
     QString propValue = QString::fromLatin1(udev_device_get_property_value(d->udev, propName.constData()));
     if (!propValue.isEmpty()) {
@@ -288,7 +381,7 @@ Device Device::ancestorOfType(const QString &subsys, const QString &devtype) con
         return Device();
     }
 
-    return Device(new DevicePrivate(p));
+    return Device(new DevicePrivate(p, true, d->cacheProperties));
 }
 
 }
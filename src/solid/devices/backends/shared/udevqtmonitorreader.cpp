@@ -0,0 +1,186 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "udevqtmonitorreader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace UdevQt
+{
+
+MonitorReader::MonitorReader(int fd, void *source, ReceiveFunction receive, DisposeFunction dispose,
+                             QObject *receiver, const char *member)
+    : m_fd(fd)
+    , m_source(source)
+    , m_receive(receive)
+    , m_dispose(dispose)
+    , m_receiver(receiver)
+    , m_member(member)
+    , m_batches(0)
+    , m_overflowed(0)
+{
+    if (pipe(m_stopPipe) == 0) {
+        fcntl(m_stopPipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(m_stopPipe[1], F_SETFD, FD_CLOEXEC);
+    } else {
+        qWarning("UdevQt: unable to create the monitor reader pipe");
+        m_stopPipe[0] = m_stopPipe[1] = -1;
+    }
+}
+
+MonitorReader::~MonitorReader()
+{
+    if (isRunning()) {
+        char stop = 0;
+        while (write(m_stopPipe[1], &stop, 1) < 0 && errno == EINTR) {
+        }
+        wait();
+    }
+
+    if (m_stopPipe[0] >= 0) {
+        close(m_stopPipe[0]);
+        close(m_stopPipe[1]);
+    }
+
+    disposeBatches(m_batches.fetchAndStoreAcquire(0), m_dispose);
+}
+
+void MonitorReader::run()
+{
+    if (m_stopPipe[0] < 0) {
+        return;
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = m_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_stopPipe[0];
+    fds[1].events = POLLIN;
+
+    Q_FOREVER {
+        fds[0].revents = fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qWarning("UdevQt: polling the monitor failed, errno %d", errno);
+            return;
+        }
+
+        if (fds[1].revents) {
+            return;
+        }
+
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            // Whatever could be read has been, nothing more will come
+            if (!(fds[0].revents & POLLIN)) {
+                return;
+            }
+        }
+
+        // Drain the socket: one wakeup of the receiver for the whole burst
+        Batch *batch = new Batch;
+        bool overflowed = false;
+        Q_FOREVER {
+            errno = 0;
+            void *event = m_receive(m_source);
+            if (!event) {
+                overflowed = (errno == ENOBUFS);
+                break;
+            }
+
+            batch->events.append(event);
+            if (batch->events.size() == MaxBatchSize) {
+                push(batch);
+                batch = new Batch;
+            }
+        }
+
+        if (overflowed) {
+            // What is still queued came after the loss, keep on reading it
+            m_overflowed.storeRelease(1);
+            push(batch);
+        } else if (batch->events.isEmpty()) {
+            delete batch;
+        } else {
+            push(batch);
+        }
+    }
+}
+
+void MonitorReader::push(Batch *batch)
+{
+    Batch *head;
+    do {
+        head = m_batches.loadAcquire();
+        batch->next = head;
+    } while (!m_batches.testAndSetRelease(head, batch));
+
+    // The first batch since the receiver last took them, call it over
+    if (!head) {
+        QMetaObject::invokeMethod(m_receiver, m_member.constData(), Qt::QueuedConnection);
+    }
+}
+
+QList<void *> MonitorReader::takeEvents()
+{
+    // Only the reader pushes and only the receiver takes, all at once: no ABA
+    Batch *batches = m_batches.fetchAndStoreAcquire(0);
+
+    Batch *oldestFirst = 0;
+    while (batches) {
+        Batch *next = batches->next;
+        batches->next = oldestFirst;
+        oldestFirst = batches;
+        batches = next;
+    }
+
+    QList<void *> events;
+    while (oldestFirst) {
+        Batch *next = oldestFirst->next;
+        Q_FOREACH (void *event, oldestFirst->events) {
+            events.append(event);
+        }
+        delete oldestFirst;
+        oldestFirst = next;
+    }
+
+    return events;
+}
+
+bool MonitorReader::takeOverflow()
+{
+    return m_overflowed.fetchAndStoreAcquire(0);
+}
+
+void MonitorReader::disposeBatches(Batch *batches, DisposeFunction dispose)
+{
+    while (batches) {
+        Batch *next = batches->next;
+        Q_FOREACH (void *event, batches->events) {
+            dispose(event);
+        }
+        delete batches;
+        batches = next;
+    }
+}
+
+}
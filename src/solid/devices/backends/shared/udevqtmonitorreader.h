@@ -0,0 +1,92 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UDEVQTMONITORREADER_H
+#define UDEVQTMONITORREADER_H
+
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+namespace UdevQt
+{
+
+/**
+ * Reads events from a socket in a thread of its own.
+ *
+ * Each time the socket is readable, everything pending on it is received
+ * at once, and handed as one batch to the thread of the receiver, which
+ * gets one queued call of its member for any number of batches.
+ *
+ * The events are opaque: receive() gets the next one from the source,
+ * or 0 when there is none left for now, and dispose() frees those that
+ * are never taken. The reader owns the source while it runs.
+ *
+ * When receive() fails with ENOBUFS, the socket overflowed and events were
+ * lost: the receiver is called even if nothing else came, to learn it from
+ * takeOverflow().
+ */
+class MonitorReader : public QThread
+{
+public:
+    typedef void *(*ReceiveFunction)(void *source);
+    typedef void (*DisposeFunction)(void *event);
+
+    MonitorReader(int fd, void *source, ReceiveFunction receive, DisposeFunction dispose,
+                  QObject *receiver, const char *member);
+    // Stops reading, the events not taken yet are disposed of
+    ~MonitorReader();
+
+    // Largest batch, a longer storm comes in several
+    static const int MaxBatchSize = 256;
+
+    // The events received so far, oldest first; for the receiver's thread
+    QList<void *> takeEvents();
+    // Whether events were lost since last asked; for the receiver's thread, after takeEvents()
+    bool takeOverflow();
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    struct Batch {
+        Batch *next;
+        QVector<void *> events;
+    };
+
+    void push(Batch *batch);
+    static void disposeBatches(Batch *batches, DisposeFunction dispose);
+
+    int m_fd;
+    void *m_source;
+    ReceiveFunction m_receive;
+    DisposeFunction m_dispose;
+    QObject *m_receiver;
+    QByteArray m_member;
+    int m_stopPipe[2];
+
+    // The batches not taken yet, newest first; pushed by the reader, taken all at once by the receiver
+    QAtomicPointer<Batch> m_batches;
+    QAtomicInt m_overflowed;
+};
+
+}
+
+#endif
@@ -20,10 +20,7 @@
 
 #include "cpuinfo.h"
 
-#include <QtCore/QDebug>
 #include <QtCore/QFile>
-#include <QtCore/QRegExp>
-#include <QtCore/QStringList>
 
 namespace Solid
 {
@@ -32,91 +29,123 @@ namespace Backends
 namespace UDev
 {
 
-class CpuInfo
-{
-public:
-    CpuInfo();
-    QString extractCpuInfoLine(int processorNumber, const QString &regExpStr);
-    QString extractInfoLine(const QString &regExpStr);
-
-private:
-    QStringList cpuInfo;
-};
+Q_GLOBAL_STATIC(CpuInfo, globalCpuInfo)
 
 QString extractCpuVendor(int processorNumber) {
-    CpuInfo info;
-    QString vendor = info.extractCpuInfoLine(processorNumber, "vendor_id\\s+:\\s+(\\S.+)");
-
-    if (vendor.isEmpty()) {
-        vendor = info.extractInfoLine("Hardware\\s+:\\s+(\\S.+)");
-    }
-
-    return vendor;
+    return CpuInfo::instance()->vendor(processorNumber);
 }
 
 QString extractCpuModel(int processorNumber) {
-    CpuInfo info;
-    QString model = info.extractCpuInfoLine(processorNumber, "model name\\s+:\\s+(\\S.+)");
-
-    if (model.isEmpty()) {
-        model = info.extractInfoLine("Processor\\s+:\\s+(\\S.+)");
-    }
-
-    return model;
+    return CpuInfo::instance()->model(processorNumber);
 }
 
 int extractCurrentCpuSpeed(int processorNumber) {
-    CpuInfo info;
-    int speed = info.extractCpuInfoLine(processorNumber, "cpu MHz\\s+:\\s+(\\d+).*").toInt();
-    return speed;
+    return CpuInfo::instance()->currentSpeed(processorNumber);
 }
 
 
-CpuInfo::CpuInfo() {
-    QFile cpuInfoFile("/proc/cpuinfo");
+CpuInfo::CpuInfo(const QString &fileName)
+    : m_fileName(fileName)
+{
+    refresh();
+}
+
+CpuInfo *CpuInfo::instance()
+{
+    return globalCpuInfo();
+}
+
+void CpuInfo::refresh()
+{
+    QFile cpuInfoFile(m_fileName);
     if (!cpuInfoFile.open(QIODevice::ReadOnly)) {
         return;
     }
-    cpuInfo = QString(cpuInfoFile.readAll()).split('\n', QString::SkipEmptyParts);
+
+    // Read it without holding the lock, it's the slow part
+    const QByteArray data = cpuInfoFile.readAll();
+
+    QWriteLocker locker(&m_lock);
+    parse(data);
 }
 
-QString CpuInfo::extractCpuInfoLine(int processorNumber, const QString &regExpStr)
+void CpuInfo::parse(const QByteArray &data)
 {
-    const QRegExp processorRegExp("processor\\s+:\\s+(\\d+)");
-    const QRegExp regExp(regExpStr);
-
-    int line = 0;
-    while (line < cpuInfo.size()) {
-        if (processorRegExp.exactMatch(cpuInfo.at(line))) {
-            int recordProcNum = processorRegExp.capturedTexts()[1].toInt();
-            if (recordProcNum == processorNumber) {
-                ++line;
-                while (line < cpuInfo.size()) {
-                    if (regExp.exactMatch(cpuInfo.at(line))) {
-                        return regExp.capturedTexts()[1];
-                    }
-                    ++line;
-                }
+    m_processors.clear();
+    m_hardware.clear();
+    m_processorName.clear();
+
+    // One "key : value" per line, each processor record starting with "processor : <number>"
+    Processor *current = 0;
+
+    Q_FOREACH (const QByteArray &line, data.split('\n')) {
+        const int colon = line.indexOf(':');
+        if (colon < 0) {
+            continue;
+        }
+
+        const QByteArray key = line.left(colon).trimmed();
+        const QByteArray value = line.mid(colon + 1).trimmed();
+
+        if (key == "processor") {
+            bool ok;
+            const int number = value.toInt(&ok);
+            if (ok) {
+                current = &m_processors[number];
+                continue;
+            }
+        }
+
+        if (value.isEmpty()) {
+            continue;
+        }
+
+        if (key == "Hardware") {
+            if (m_hardware.isEmpty()) {
+                m_hardware = QString::fromLatin1(value);
+            }
+        } else if (key == "Processor") {
+            if (m_processorName.isEmpty()) {
+                m_processorName = QString::fromLatin1(value);
+            }
+        } else if (current) {
+            if (key == "vendor_id") {
+                current->vendor = QString::fromLatin1(value);
+            } else if (key == "model name") {
+                current->model = QString::fromLatin1(value);
+            } else if (key == "cpu MHz") {
+                // Whole MHz are enough
+                current->speed = value.left(value.indexOf('.')).toInt();
             }
         }
-        ++line;
     }
+}
 
-    return QString();
+int CpuInfo::processorCount() const
+{
+    QReadLocker locker(&m_lock);
+    return m_processors.size();
 }
 
-QString CpuInfo::extractInfoLine(const QString &regExpStr)
+QString CpuInfo::vendor(int processorNumber) const
 {
-    const QRegExp regExp(regExpStr);
+    QReadLocker locker(&m_lock);
+    const QString vendor = m_processors.value(processorNumber).vendor;
+    return vendor.isEmpty() ? m_hardware : vendor;
+}
 
-    foreach (const QString &line, cpuInfo) {
-        if (regExp.exactMatch(line)) {
-            return regExp.capturedTexts()[1];
-        }
-    }
-    return QString();
+QString CpuInfo::model(int processorNumber) const
+{
+    QReadLocker locker(&m_lock);
+    const QString model = m_processors.value(processorNumber).model;
+    return model.isEmpty() ? m_processorName : model;
 }
 
+int CpuInfo::currentSpeed(int processorNumber) const
+{
+    QReadLocker locker(&m_lock);
+    return m_processors.value(processorNumber).speed;
+}
 
 }
 }
@@ -21,6 +21,8 @@
 #ifndef SOLID_BACKENDS_UDEV_CPUINFO_H
 #define SOLID_BACKENDS_UDEV_CPUINFO_H
 
+#include <QtCore/QHash>
+#include <QtCore/QReadWriteLock>
 #include <QtCore/QString>
 
 namespace Solid
@@ -30,6 +32,50 @@ namespace Backends
 namespace UDev
 {
 
+/**
+ * The contents of /proc/cpuinfo, parsed once into a table indexed by
+ * processor number.
+ *
+ * The table isn't updated behind the caller's back: call refresh() to
+ * pick up the values which change over time, like the current speed,
+ * or the processors brought online since.
+ */
+class CpuInfo
+{
+public:
+    explicit CpuInfo(const QString &fileName = QStringLiteral("/proc/cpuinfo"));
+
+    /**
+     * The table shared by all the processor devices
+     */
+    static CpuInfo *instance();
+
+    void refresh();
+
+    int processorCount() const;
+    QString vendor(int processorNumber) const;
+    QString model(int processorNumber) const;
+    int currentSpeed(int processorNumber) const;
+
+private:
+    struct Processor {
+        Processor() : speed(0) {}
+
+        QString vendor;
+        QString model;
+        int speed;
+    };
+
+    void parse(const QByteArray &data);
+
+    QString m_fileName;
+    mutable QReadWriteLock m_lock;
+    QHash<int, Processor> m_processors;
+    // Machine wide lines, used by some architectures instead of per processor ones
+    QString m_hardware;
+    QString m_processorName;
+};
+
 /**
  * Extracts vendor from /proc/cpuinfo for a given processor
  */
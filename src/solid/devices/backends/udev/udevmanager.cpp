@@ -22,30 +22,51 @@
 
 #include "udev.h"
 #include "udevdevice.h"
+#include "cpuinfo.h"
 #include "../shared/rootdevice.h"
 
+#include <QtCore/QHash>
 #include <QtCore/QSet>
 #include <QtCore/QFile>
+#include <QtCore/QMutex>
 #include <QtCore/QDebug>
 
 using namespace Solid::Backends::UDev;
 using namespace Solid::Backends::Shared;
 
+// Room for the events of a storm; without CAP_NET_ADMIN, the kernel caps it at net.core.rmem_max
+static const int s_receiveBufferSize = 8 * 1024 * 1024;
+
 class UDevManager::Private
 {
 public:
     Private();
     ~Private();
 
-    bool isOfInterest(const QString &udi, const UdevQt::Device &device);
+    bool isOfInterest(const UdevQt::Device &device);
     bool checkOfInterest(const UdevQt::Device &device);
+    QSet<QString> enumerateDevices();
 
     UdevQt::Client *m_client;
-    QStringList m_devicesOfInterest;
+
+    // Guards the members below, allDevices() can be called from any thread
+    QMutex m_devicesMutex;
+
+    // The verdicts of checkOfInterest(), both ways, by sysfs path: most of
+    // the devices of the watched subsystems are of no interest, and they keep
+    // coming back in enumerations and events. Forgotten when a device changes
+    // or goes away.
+    QHash<QString, bool> m_interest;
+
+    // The devices of interest currently present, filled by the first
+    // enumeration and then kept current by the monitor
+    bool m_devicesEnumerated;
+    QSet<QString> m_devices;
     QSet<Solid::DeviceInterface::Type> m_supportedInterfaces;
 };
 
 UDevManager::Private::Private()
+    : m_devicesEnumerated(false)
 {
     QStringList subsystems;
     subsystems << "processor";
@@ -56,7 +77,15 @@ UDevManager::Private::Private()
     subsystems << "net";
     subsystems << "usb";
     subsystems << "input";
-    m_client = new UdevQt::Client(subsystems);
+
+    // Hotplug storms (hundreds of network interfaces at once) are drained
+    // off the manager's thread, which gets them in a few batches
+    m_client = new UdevQt::Client;
+    m_client->setMonitorMode(UdevQt::Client::MonitorOnReaderThread);
+    m_client->setReceiveBufferSize(s_receiveBufferSize);
+    // The interfaces of a device are told by a dozen of its properties, each asked several times
+    m_client->setPropertyCacheEnabled(true);
+    m_client->setWatchedSubsystems(subsystems);
 }
 
 UDevManager::Private::~Private()
@@ -64,20 +93,40 @@ UDevManager::Private::~Private()
     delete m_client;
 }
 
-bool UDevManager::Private::isOfInterest(const QString &udi, const UdevQt::Device &device)
+bool UDevManager::Private::isOfInterest(const UdevQt::Device &device)
 {
-    if (m_devicesOfInterest.contains(udi)) {
-        return true;
+    if (!device.isValid()) {
+        return false;
     }
 
-    bool isOfInterest = checkOfInterest(device);
-    if (isOfInterest) {
-        m_devicesOfInterest.append(udi);
+    const QString sysfsPath = device.sysfsPath();
+    QHash<QString, bool>::const_iterator it = m_interest.constFind(sysfsPath);
+    if (it != m_interest.constEnd()) {
+        return *it;
     }
 
+    const bool isOfInterest = checkOfInterest(device);
+    m_interest.insert(sysfsPath, isOfInterest);
+
     return isOfInterest;
 }
 
+QSet<QString> UDevManager::Private::enumerateDevices()
+{
+    QSet<QString> devices;
+
+    // Only the subsystems we watch can hold devices of interest, and the
+    // monitor wouldn't tell us about the others coming and going anyway
+    const UdevQt::DeviceList deviceList = m_client->devicesBySubsystems(m_client->watchedSubsystems());
+    Q_FOREACH (const UdevQt::Device &device, deviceList) {
+        if (isOfInterest(device)) {
+            devices.insert(QStringLiteral(UDEV_UDI_PREFIX) + device.sysfsPath());
+        }
+    }
+
+    return devices;
+}
+
 bool UDevManager::Private::checkOfInterest(const UdevQt::Device &device)
 {
 #ifdef UDEV_DETAILED_OUTPUT
@@ -132,15 +181,15 @@ UDevManager::UDevManager(QObject *parent)
     : Solid::Ifaces::DeviceManager(parent),
       d(new Private)
 {
+    // The monitor answers in the thread of the client, it has to follow us there
+    d->m_client->setParent(this);
+
     connect(d->m_client, SIGNAL(deviceAdded(UdevQt::Device)), this, SLOT(slotDeviceAdded(UdevQt::Device)));
     connect(d->m_client, SIGNAL(deviceRemoved(UdevQt::Device)), this, SLOT(slotDeviceRemoved(UdevQt::Device)));
+    connect(d->m_client, SIGNAL(deviceChanged(UdevQt::Device)), this, SLOT(slotDeviceChanged(UdevQt::Device)));
+    connect(d->m_client, SIGNAL(monitorOverflowed()), this, SLOT(slotMonitorOverflowed()));
 
-    d->m_supportedInterfaces << Solid::DeviceInterface::GenericInterface
-                             << Solid::DeviceInterface::Processor
-                             << Solid::DeviceInterface::Camera
-                             << Solid::DeviceInterface::PortableMediaPlayer
-                             << Solid::DeviceInterface::Block
-                             ;
+    d->m_supportedInterfaces = supportedInterfaceTypes();
 }
 
 UDevManager::~UDevManager()
@@ -158,16 +207,25 @@ QSet<Solid::DeviceInterface::Type> UDevManager::supportedInterfaces() const
     return d->m_supportedInterfaces;
 }
 
+QSet<Solid::DeviceInterface::Type> UDevManager::supportedInterfaceTypes()
+{
+    return QSet<Solid::DeviceInterface::Type>() << Solid::DeviceInterface::GenericInterface
+                                                << Solid::DeviceInterface::Processor
+                                                << Solid::DeviceInterface::Camera
+                                                << Solid::DeviceInterface::PortableMediaPlayer
+                                                << Solid::DeviceInterface::Block;
+}
+
 QStringList UDevManager::allDevices()
 {
-    QStringList res;
-    const UdevQt::DeviceList deviceList = d->m_client->allDevices();
-    Q_FOREACH (const UdevQt::Device &device, deviceList) {
-        if (d->isOfInterest(udiPrefix() + device.sysfsPath(), device)) {
-            res << udiPrefix() + device.sysfsPath();
-        }
+    QMutexLocker locker(&d->m_devicesMutex);
+
+    if (!d->m_devicesEnumerated) {
+        d->m_devices = d->enumerateDevices();
+        d->m_devicesEnumerated = true;
     }
-    return res;
+
+    return d->m_devices.toList();
 }
 
 QStringList UDevManager::devicesFromQuery(const QString &parentUdi,
@@ -213,7 +271,8 @@ QObject *UDevManager::createDevice(const QString &udi_)
     const QString udi = udi_.right(udi_.size() - udiPrefix().size());
     UdevQt::Device device = d->m_client->deviceBySysfsPath(udi);
 
-    if (d->isOfInterest(udi_, device) || QFile::exists(udi)) {
+    QMutexLocker locker(&d->m_devicesMutex);
+    if (d->isOfInterest(device) || QFile::exists(udi)) {
         return new UDevDevice(device);
     }
 
@@ -222,15 +281,115 @@ QObject *UDevManager::createDevice(const QString &udi_)
 
 void UDevManager::slotDeviceAdded(const UdevQt::Device &device)
 {
-    if (d->isOfInterest(udiPrefix() + device.sysfsPath(), device)) {
-        emit deviceAdded(udiPrefix() + device.sysfsPath());
+    const QString udi = udiPrefix() + device.sysfsPath();
+
+    d->m_devicesMutex.lock();
+    const bool isOfInterest = d->isOfInterest(device);
+    if (isOfInterest && d->m_devicesEnumerated) {
+        d->m_devices.insert(udi);
+    }
+    d->m_devicesMutex.unlock();
+
+    if (isOfInterest && device.subsystem() == QLatin1String("cpu")) {
+        // Brought online: the shared table doesn't know about it yet
+        CpuInfo::instance()->refresh();
+    }
+
+    if (isOfInterest) {
+        emit deviceAdded(udi);
     }
 }
 
 void UDevManager::slotDeviceRemoved(const UdevQt::Device &device)
 {
-    if (d->isOfInterest(udiPrefix() + device.sysfsPath(), device)) {
-        emit deviceRemoved(udiPrefix() + device.sysfsPath());
-        d->m_devicesOfInterest.removeAll(udiPrefix() + device.sysfsPath());
+    const QString udi = udiPrefix() + device.sysfsPath();
+
+    d->m_devicesMutex.lock();
+    // From the verdict given while it was there, its sysfs entry is gone now
+    const bool isOfInterest = d->isOfInterest(device);
+    d->m_interest.remove(device.sysfsPath());
+    if (isOfInterest) {
+        d->m_devices.remove(udi);
+    }
+    d->m_devicesMutex.unlock();
+
+    if (isOfInterest) {
+        emit deviceRemoved(udi);
+    }
+}
+
+void UDevManager::slotDeviceChanged(const UdevQt::Device &device)
+{
+    const QString udi = udiPrefix() + device.sysfsPath();
+
+    // The properties the verdict was made of may be different now
+    d->m_devicesMutex.lock();
+    d->m_interest.remove(device.sysfsPath());
+    const bool isOfInterest = d->isOfInterest(device);
+
+    bool added = false;
+    bool removed = false;
+    if (d->m_devicesEnumerated) {
+        const bool wasListed = d->m_devices.contains(udi);
+        if (isOfInterest && !wasListed) {
+            d->m_devices.insert(udi);
+            added = true;
+        } else if (!isOfInterest && wasListed) {
+            d->m_devices.remove(udi);
+            removed = true;
+        }
+    }
+    d->m_devicesMutex.unlock();
+
+    if (added) {
+        emit deviceAdded(udi);
+    } else if (removed) {
+        emit deviceRemoved(udi);
+    } else if (isOfInterest) {
+        // Still there, but its properties may tell other interfaces
+        emit deviceChanged(udi);
+    }
+}
+
+void UDevManager::slotMonitorOverflowed()
+{
+    qWarning() << "Some udev events were lost, resynchronizing the devices";
+
+    d->m_devicesMutex.lock();
+
+    // The verdicts on the devices may have changed along with them
+    d->m_interest.clear();
+
+    if (!d->m_devicesEnumerated) {
+        // Nobody knows of any device yet, the first enumeration will be right
+        d->m_devicesMutex.unlock();
+        return;
+    }
+
+    const QSet<QString> devices = d->enumerateDevices();
+
+    QStringList removed;
+    Q_FOREACH (const QString &udi, d->m_devices) {
+        if (!devices.contains(udi)) {
+            removed << udi;
+        }
+    }
+
+    QStringList added;
+    Q_FOREACH (const QString &udi, devices) {
+        if (!d->m_devices.contains(udi)) {
+            added << udi;
+        }
+    }
+
+    d->m_devices = devices;
+    d->m_devicesMutex.unlock();
+
+    // Only what the lost events would have told
+    Q_FOREACH (const QString &udi, removed) {
+        emit deviceRemoved(udi);
+    }
+    Q_FOREACH (const QString &udi, added) {
+        emit deviceAdded(udi);
     }
 }
@@ -41,6 +41,10 @@ public:
 
     QString udiPrefix() const Q_DECL_OVERRIDE;
     QSet<Solid::DeviceInterface::Type> supportedInterfaces() const Q_DECL_OVERRIDE;
+    /**
+     * What supportedInterfaces() answers, known without constructing a manager
+     */
+    static QSet<Solid::DeviceInterface::Type> supportedInterfaceTypes();
 
     QStringList allDevices() Q_DECL_OVERRIDE;
 
@@ -52,6 +56,8 @@ public:
 private Q_SLOTS:
     void slotDeviceAdded(const UdevQt::Device &device);
     void slotDeviceRemoved(const UdevQt::Device &device);
+    void slotDeviceChanged(const UdevQt::Device &device);
+    void slotMonitorOverflowed();
 
 private:
     class Private;
@@ -0,0 +1,251 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "udiskscontenttypescache.h"
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QHash>
+#include <QtCore/QSystemSemaphore>
+#include <QtCore/QThread>
+
+using namespace Solid::Backends::UDisks2;
+
+// How many times a reader tries again when a slot changes under it
+static const int s_readAttempts = 8;
+// How many times, a millisecond apart, a writer finds a slot still odd before taking it over
+static const int s_abandonChecks = 100;
+
+/* Everything in the table is atomic, so that it can be read while being
+ * written; a zeroed table is an empty one */
+struct ContentTypesCache::Table {
+    enum Word {
+        DetectTimeLow,
+        DetectTimeHigh,
+        SizeLow,
+        SizeHigh,
+        LabelHash,
+        Content,
+        WordCount
+    };
+
+    struct Slot {
+        QBasicAtomicInt sequence;
+        QBasicAtomicInt stamp;  // 0 while empty, the insertion time otherwise
+        QBasicAtomicInt words[WordCount];
+    };
+
+    QBasicAtomicInt clock;
+    Slot slots[Sets * Ways];
+};
+
+typedef ContentTypesCache::Table Table;
+
+static QString sharedKey(const QString &name, const char *suffix)
+{
+    return QStringLiteral("%1-2-%2-%3%4").arg(name)
+           .arg(sizeof(ContentTypesCache::Table))
+           .arg(geteuid())
+           .arg(QLatin1String(suffix));
+}
+
+ContentTypesCache::ContentTypesCache(const QString &name)
+    : m_shmem(sharedKey(name, "mem")),
+      m_table(0),
+      m_localTable(0)
+{
+    /* The semaphore only guards the creation of the table against the other
+     * processes attaching to it: the memory comes zeroed, empty, from the system */
+    QSystemSemaphore semaphore(sharedKey(name, "sem"), 1);
+    if (semaphore.acquire()) {
+        if (m_shmem.attach() || m_shmem.create(sizeof(Table))) {
+            m_table = static_cast<Table *>(m_shmem.data());
+        }
+        semaphore.release();
+    }
+
+    if (!m_table) {
+        qWarning("Could not share the disc content cache: %s", qPrintable(m_shmem.errorString()));
+        m_localTable = new Table();
+        m_table = m_localTable;
+    }
+}
+
+ContentTypesCache::~ContentTypesCache()
+{
+    delete m_localTable;
+}
+
+bool ContentTypesCache::isShared() const
+{
+    return !m_localTable;
+}
+
+static void identityWords(const OpticalDisc::Identity &identity, int words[Table::WordCount])
+{
+    words[Table::DetectTimeLow] = int(identity.detectTime());
+    words[Table::DetectTimeHigh] = int(identity.detectTime() >> 32);
+    words[Table::SizeLow] = int(identity.size());
+    words[Table::SizeHigh] = int(identity.size() >> 32);
+    words[Table::LabelHash] = int(identity.labelHash());
+}
+
+static uint setOf(const int words[Table::WordCount])
+{
+    uint hash = 0;
+    for (int i = 0; i < Table::Content; ++i) {
+        hash = hash * 31 + uint(words[i]);
+    }
+    return qHash(hash) % ContentTypesCache::Sets;
+}
+
+/* A consistent copy of the slot, if the writers leave it alone long enough:
+ * the sequence didn't change, and wasn't odd, while the words were read */
+static bool readSlot(const Table::Slot &slot, int words[Table::WordCount])
+{
+    for (int attempt = 0; attempt < s_readAttempts; ++attempt) {
+        const int sequence = slot.sequence.loadAcquire();
+        if (sequence & 1) {
+            continue;
+        }
+        if (!slot.stamp.loadAcquire()) {
+            return false;
+        }
+        for (int i = 0; i < Table::WordCount; ++i) {
+            words[i] = slot.words[i].loadAcquire();
+        }
+        if (slot.sequence.load() == sequence) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool sameIdentity(const int a[Table::WordCount], const int b[Table::WordCount])
+{
+    for (int i = 0; i < Table::Content; ++i) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ContentTypesCache::find(const OpticalDisc::Identity &identity, Solid::OpticalDisc::ContentTypes *content) const
+{
+    int key[Table::WordCount];
+    identityWords(identity, key);
+
+    const Table::Slot *set = m_table->slots + setOf(key) * Ways;
+    for (int way = 0; way < Ways; ++way) {
+        int words[Table::WordCount];
+        if (readSlot(set[way], words) && sameIdentity(words, key)) {
+            *content = Solid::OpticalDisc::ContentTypes(words[Table::Content]);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* The slot of this disc if it is there already, else an empty one,
+ * else the one filled the longest ago */
+static Table::Slot *slotFor(Table *table, const int key[Table::WordCount], uint now)
+{
+    Table::Slot *set = table->slots + setOf(key) * ContentTypesCache::Ways;
+    Table::Slot *victim = 0;
+    quint64 victimAge = 0;
+    for (int way = 0; way < ContentTypesCache::Ways; ++way) {
+        int words[Table::WordCount];
+        if (readSlot(set[way], words) && sameIdentity(words, key)) {
+            return set + way;
+        }
+        /* The clock wraps around: the difference modulo 2^32 is the age
+         * all the same, an empty slot being older than any */
+        const uint stamp = uint(set[way].stamp.load());
+        const quint64 age = stamp ? quint64(now - stamp) : Q_UINT64_C(1) << 32;
+        if (!victim || age > victimAge) {
+            victim = set + way;
+            victimAge = age;
+        }
+    }
+
+    return victim;
+}
+
+/* Whether the writer of the slot is gone: a few stores don't take a tenth
+ * of a second, even to a writer scheduled out, unless it died in the middle */
+static bool isAbandoned(const Table::Slot &slot, int sequence)
+{
+    for (int check = 0; check < s_abandonChecks; ++check) {
+        QThread::msleep(1);
+        if (slot.sequence.loadAcquire() != sequence) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ContentTypesCache::insert(const OpticalDisc::Identity &identity, Solid::OpticalDisc::ContentTypes content)
+{
+    int key[Table::WordCount];
+    identityWords(identity, key);
+    key[Table::Content] = int(content);
+
+    const uint now = uint(m_table->clock.fetchAndAddRelaxed(1)) + 1;
+    Table::Slot *victim = slotFor(m_table, key, now);
+
+    // Someone else is writing there, their answer is as good as ours
+    const int sequence = victim->sequence.loadAcquire();
+    if ((sequence & 1) && !isAbandoned(*victim, sequence)) {
+        return;
+    }
+
+    // Odd while we write, taking over from a dead writer as well
+    const int claimed = (sequence & 1) ? sequence + 2 : sequence + 1;
+    if (!victim->sequence.testAndSetOrdered(sequence, claimed)) {
+        return;
+    }
+
+    for (int i = 0; i < Table::WordCount; ++i) {
+        victim->words[i].storeRelease(key[i]);
+    }
+    victim->stamp.storeRelease(int(now ? now : 1));
+
+    // Unless taken over meanwhile, the one who did will publish its own words
+    victim->sequence.testAndSetRelease(claimed, claimed + 1);
+}
+
+#ifdef SOLID_TESTING_BUILD
+void ContentTypesCache::abandonInsert(const OpticalDisc::Identity &identity)
+{
+    int key[Table::WordCount];
+    identityWords(identity, key);
+
+    const uint now = uint(m_table->clock.fetchAndAddRelaxed(1)) + 1;
+    Table::Slot *victim = slotFor(m_table, key, now);
+    const int sequence = victim->sequence.loadAcquire();
+    if (!(sequence & 1)) {
+        victim->sequence.testAndSetOrdered(sequence, sequence + 1);
+    }
+}
+#endif
@@ -0,0 +1,79 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UDISKS2CONTENTTYPESCACHE_H
+#define UDISKS2CONTENTTYPESCACHE_H
+
+#include <QtCore/QSharedMemory>
+#include <QtCore/QString>
+
+#include "udisksopticaldisc.h"
+
+namespace Solid
+{
+namespace Backends
+{
+namespace UDisks2
+{
+
+/**
+ * The content of the discs seen lately, shared by all the processes of a user.
+ *
+ * It is a fixed size hash table in shared memory. Every slot has its own
+ * sequence number, odd while a writer updates it: readers check it did
+ * not change around their read, and retry or give up instead of waiting.
+ * Writers claim a slot by making its sequence odd, and don't wait either:
+ * when two race for the same slot, one of the answers is not cached. A
+ * slot which stays odd for long is one whose writer died, and is taken over.
+ */
+class ContentTypesCache
+{
+public:
+    explicit ContentTypesCache(const QString &name = QStringLiteral("solid-disk-info"));
+    ~ContentTypesCache();
+
+    // false if the memory couldn't be shared, the cache then only serves this process
+    bool isShared() const;
+
+    bool find(const OpticalDisc::Identity &identity, Solid::OpticalDisc::ContentTypes *content) const;
+    void insert(const OpticalDisc::Identity &identity, Solid::OpticalDisc::ContentTypes content);
+
+#ifdef SOLID_TESTING_BUILD
+    // Claims the slot of the disc and leaves it at that, like a writer dying in the middle
+    void abandonInsert(const OpticalDisc::Identity &identity);
+#endif
+
+    // Number of slots a disc can be cached in, and number of those sets of slots
+    static const int Ways = 4;
+    static const int Sets = 64;
+
+    struct Table;
+
+private:
+    Q_DISABLE_COPY(ContentTypesCache)
+
+    QSharedMemory m_shmem;
+    Table *m_table;
+    Table *m_localTable;
+};
+
+}
+}
+}
+
+#endif // UDISKS2CONTENTTYPESCACHE_H
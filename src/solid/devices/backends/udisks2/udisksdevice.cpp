@@ -89,8 +89,14 @@ static QString formatByteSize(double size)
 Device::Device(const QString &udi)
     : Solid::Ifaces::Device()
     , m_backend(DeviceBackend::backendForUDI(udi))
+    , m_descriptionCached(false)
+    , m_iconCached(false)
 {
     if (m_backend) {
+        // First, so that whoever gets notified below sees the new values
+        connect(m_backend, SIGNAL(propertyChanged(QMap<QString,int>)), this, SLOT(clearDerivedCache()));
+        connect(m_backend, SIGNAL(interfacesChanged()), this, SLOT(clearDerivedCache()));
+
         connect(m_backend, SIGNAL(changed()), this, SIGNAL(changed()));
         connect(m_backend, SIGNAL(propertyChanged(QMap<QString,int>)), this, SIGNAL(propertyChanged(QMap<QString,int>)));
     } else {
@@ -238,6 +244,17 @@ QStringList Device::emblems() const
 }
 
 QString Device::description() const
+{
+    if (!m_descriptionCached) {
+        m_description = computeDescription();
+        m_descriptionCached = true;
+        watchDrive();
+    }
+
+    return m_description;
+}
+
+QString Device::computeDescription() const
 {
     const QString hintName = property("HintName").toString(); // non-cached
     if (!hintName.isEmpty()) {
@@ -585,6 +602,58 @@ QString Device::volumeDescription() const
 }
 
 QString Device::icon() const
+{
+    if (!m_iconCached) {
+        m_icon = computeIcon();
+        m_iconCached = true;
+        watchDrive();
+    }
+
+    return m_icon;
+}
+
+void Device::watchDrive() const
+{
+    if (isDrive()) {
+        return;
+    }
+
+    // What the drive says goes into the description and icon of its volumes
+    DeviceBackend *driveBackend = DeviceBackend::backendForUDI(drivePath(), false);
+    if (driveBackend && driveBackend != m_watchedDrive) {
+        if (m_watchedDrive) {
+            disconnect(m_watchedDrive, 0, this, SLOT(clearDerivedCache()));
+        }
+        connect(driveBackend, SIGNAL(propertyChanged(QMap<QString,int>)), this, SLOT(clearDerivedCache()));
+        m_watchedDrive = driveBackend;
+    }
+}
+
+void Device::notifyChanged(const QString &property)
+{
+    clearDerivedCache();
+
+    QMap<QString, int> changes;
+    changes.insert(property, Solid::GenericInterface::PropertyModified);
+    emit propertyChanged(changes);
+    emit changed();
+}
+
+void Device::slotContentDetected()
+{
+    // Reaches the applications through Solid::GenericInterface::propertyChanged()
+    notifyChanged(QStringLiteral("availableContent"));
+}
+
+void Device::clearDerivedCache()
+{
+    m_descriptionCached = false;
+    m_iconCached = false;
+    m_description.clear();
+    m_icon.clear();
+}
+
+QString Device::computeIcon() const
 {
     QString iconName = property("HintIconName").toString();   // non-cached
 
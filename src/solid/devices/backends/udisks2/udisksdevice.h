@@ -30,6 +30,7 @@
 
 #include <QtDBus/QDBusInterface>
 #include <QtDBus/QDBusObjectPath>
+#include <QtCore/QPointer>
 #include <QtCore/QStringList>
 
 namespace Solid
@@ -85,6 +86,12 @@ public:
 
     QString drivePath() const;
 
+    /**
+     * Announces a change found out by the device interfaces rather than
+     * told by UDisks2, like the content of a disc once probed.
+     */
+    void notifyChanged(const QString &property);
+
 Q_SIGNALS:
     void changed();
     void propertyChanged(const QMap<QString, int> &changes);
@@ -92,9 +99,24 @@ Q_SIGNALS:
 protected:
     QPointer<DeviceBackend> m_backend;
 
+private Q_SLOTS:
+    void clearDerivedCache();
+    void slotContentDetected();
+
 private:
+    QString computeDescription() const;
+    QString computeIcon() const;
     QString storageDescription() const;
     QString volumeDescription() const;
+    void watchDrive() const;
+
+    /* Derived from a good many properties, of the drive too, and asked for
+     * on every repaint: kept until one of these properties changes */
+    mutable QString m_description;
+    mutable QString m_icon;
+    mutable bool m_descriptionCached;
+    mutable bool m_iconCached;
+    mutable QPointer<DeviceBackend> m_watchedDrive;
 };
 
 }
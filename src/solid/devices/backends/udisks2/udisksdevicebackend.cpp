@@ -22,8 +22,14 @@
 
 #include "udisksdevicebackend.h"
 
+#include <QtCore/QCoreApplication>
+#include <QtDBus/QDBusArgument>
 #include <QtDBus/QDBusConnection>
 #include <QtDBus/QDBusInterface>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusMetaType>
+#include <QtDBus/QDBusPendingCall>
+#include <QtDBus/QDBusReply>
 #include <QtXml/QDomDocument>
 
 #include "solid/deviceinterface.h"
@@ -32,7 +38,134 @@
 using namespace Solid::Backends::UDisks2;
 
 /* Static cache for DeviceBackends for all UDIs */
-QMap<QString /* UDI */, DeviceBackend *> DeviceBackend::s_backends;
+QHash<QString /* UDI */, DeviceBackend *> DeviceBackend::s_backends;
+
+/* Enumerations can run in a worker thread while the dispatcher looks up backends */
+QMutex DeviceBackend::s_backendsMutex;
+
+/* Shared by all the backends, lives as long as there is at least one of them */
+DeviceBackendDispatcher *DeviceBackend::s_dispatcher = 0;
+
+/* Which cleartext device belongs to which LUKS container, fed by the
+ * dispatcher and the backends, so it is as current as they are */
+QHash<QString /* backing UDI */, QString /* cleartext UDI */> DeviceBackend::s_clearTextDevices;
+QHash<QString /* cleartext UDI */, QString /* backing UDI */> DeviceBackend::s_backingDevices;
+/* Whether the containers unlocked before the dispatcher existed were asked for */
+bool DeviceBackend::s_cryptoIndexSeeded = false;
+QMutex DeviceBackend::s_cryptoMutex;
+
+#ifdef SOLID_TESTING_BUILD
+QAtomicInt DeviceBackend::s_propertyLookups;
+#endif
+
+/* The rule QtDBus adds for a PropertiesChanged connection, with the path constraint given
+ * (none when empty): same fields, same order, so that RemoveMatch finds it */
+static QString propertiesChangedRule(const QString &pathConstraint = QString())
+{
+    QString rule = QStringLiteral("type='signal',sender='" UD2_DBUS_SERVICE "',");
+    if (!pathConstraint.isEmpty()) {
+        rule += pathConstraint + QLatin1Char(',');
+    }
+    rule += QStringLiteral("interface='" DBUS_INTERFACE_PROPS "',member='PropertiesChanged'");
+    return rule;
+}
+
+static QStringList devicePropertiesChangedRules()
+{
+    return QStringList() << propertiesChangedRule(QStringLiteral("path_namespace='/org/freedesktop/UDisks2/block_devices'"))
+                         << propertiesChangedRule(QStringLiteral("path_namespace='/org/freedesktop/UDisks2/drives'"));
+}
+
+static void sendMatchRule(const QString &method, const QString &rule)
+{
+    // No need to wait: the bus handles the calls of a connection in order
+    QDBusMessage call = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.DBus"), QStringLiteral("/org/freedesktop/DBus"),
+                                                       QStringLiteral("org.freedesktop.DBus"), method);
+    call << rule;
+    call.setNoReply(true);
+    QDBusConnection::systemBus().send(call);
+}
+
+DeviceBackendDispatcher::DeviceBackendDispatcher()
+{
+    /* One subscription per signal for the whole object tree instead of one per device.
+     * QtDBus can only dispatch a PropertiesChanged of any object to us by asking the bus
+     * for the changes of every one, the jobs and the manager too: keep its dispatching,
+     * but tell the bus about the devices only. */
+    QDBusConnection::systemBus().connect(UD2_DBUS_SERVICE, QString(), DBUS_INTERFACE_PROPS, "PropertiesChanged",
+                                         this, SLOT(slotPropertiesChanged(QDBusMessage)));
+    Q_FOREACH (const QString &rule, devicePropertiesChangedRules()) {
+        sendMatchRule(QStringLiteral("AddMatch"), rule);
+    }
+    sendMatchRule(QStringLiteral("RemoveMatch"), propertiesChangedRule());
+
+    QDBusConnection::systemBus().connect(UD2_DBUS_SERVICE, UD2_DBUS_PATH, DBUS_INTERFACE_MANAGER, "InterfacesAdded",
+                                         this, SLOT(slotInterfacesAdded(QDBusObjectPath,VariantMapMap)));
+    QDBusConnection::systemBus().connect(UD2_DBUS_SERVICE, UD2_DBUS_PATH, DBUS_INTERFACE_MANAGER, "InterfacesRemoved",
+                                         this, SLOT(slotInterfacesRemoved(QDBusObjectPath,QStringList)));
+}
+
+DeviceBackendDispatcher::~DeviceBackendDispatcher()
+{
+    Q_FOREACH (const QString &rule, devicePropertiesChangedRules()) {
+        sendMatchRule(QStringLiteral("RemoveMatch"), rule);
+    }
+    // Its own rule is gone already, QtDBus doesn't mind
+    QDBusConnection::systemBus().disconnect(UD2_DBUS_SERVICE, QString(), DBUS_INTERFACE_PROPS, "PropertiesChanged",
+                                            this, SLOT(slotPropertiesChanged(QDBusMessage)));
+    QDBusConnection::systemBus().disconnect(UD2_DBUS_SERVICE, UD2_DBUS_PATH, DBUS_INTERFACE_MANAGER, "InterfacesAdded",
+                                            this, SLOT(slotInterfacesAdded(QDBusObjectPath,VariantMapMap)));
+    QDBusConnection::systemBus().disconnect(UD2_DBUS_SERVICE, UD2_DBUS_PATH, DBUS_INTERFACE_MANAGER, "InterfacesRemoved",
+                                            this, SLOT(slotInterfacesRemoved(QDBusObjectPath,QStringList)));
+}
+
+void DeviceBackendDispatcher::slotInterfacesAdded(const QDBusObjectPath &object_path, const VariantMapMap &interfaces_and_properties)
+{
+    /* Unlocking a LUKS container makes its cleartext device appear, backend or not */
+    const QVariantMap blockProps = interfaces_and_properties.value(UD2_DBUS_INTERFACE_BLOCK);
+    if (blockProps.contains("CryptoBackingDevice")) {
+        DeviceBackend::updateCryptoBackingDevice(object_path.path(), blockProps.value("CryptoBackingDevice"));
+    }
+
+    DeviceBackend *backend = DeviceBackend::backendForUDI(object_path.path(), false);
+    if (backend) {
+        backend->slotInterfacesAdded(interfaces_and_properties);
+    }
+}
+
+void DeviceBackendDispatcher::slotInterfacesRemoved(const QDBusObjectPath &object_path, const QStringList &interfaces)
+{
+    if (interfaces.contains(UD2_DBUS_INTERFACE_BLOCK)) {
+        DeviceBackend::updateCryptoBackingDevice(object_path.path(), QVariant());
+    }
+
+    DeviceBackend *backend = DeviceBackend::backendForUDI(object_path.path(), false);
+    if (backend) {
+        backend->slotInterfacesRemoved(interfaces);
+    }
+}
+
+void DeviceBackendDispatcher::slotPropertiesChanged(const QDBusMessage &msg)
+{
+    if (msg.arguments().size() != 3) {
+        return;
+    }
+
+    const QString ifaceName = msg.arguments().at(0).toString();
+    const QVariantMap changedProps = qdbus_cast<QVariantMap>(msg.arguments().at(1));
+
+    if (ifaceName == QLatin1String(UD2_DBUS_INTERFACE_BLOCK) && changedProps.contains("CryptoBackingDevice")) {
+        DeviceBackend::updateCryptoBackingDevice(msg.path(), changedProps.value("CryptoBackingDevice"));
+    }
+
+    DeviceBackend *backend = DeviceBackend::backendForUDI(msg.path(), false);
+    if (!backend) {
+        return;
+    }
+
+    const QStringList invalidatedProps = msg.arguments().at(2).toStringList();
+    backend->slotPropertiesChanged(ifaceName, changedProps, invalidatedProps);
+}
 
 DeviceBackend *DeviceBackend::backendForUDI(const QString &udi, bool create)
 {
@@ -41,10 +174,34 @@ DeviceBackend *DeviceBackend::backendForUDI(const QString &udi, bool create)
         return backend;
     }
 
+    QMutexLocker locker(&s_backendsMutex);
+
     if (s_backends.contains(udi)) {
         backend = s_backends.value(udi);
     } else if (create) {
         backend = new DeviceBackend(udi);
+        backend->moveToDispatcherThread();
+        s_backends.insert(udi, backend);
+    }
+
+    return backend;
+}
+
+DeviceBackend *DeviceBackend::backendForUDI(const QString &udi, const VariantMapMap &interfacesAndProperties)
+{
+    DeviceBackend *backend = 0;
+    if (udi.isEmpty()) {
+        return backend;
+    }
+
+    QMutexLocker locker(&s_backendsMutex);
+
+    if (s_backends.contains(udi)) {
+        backend = s_backends.value(udi);
+        backend->setInterfacesAndProperties(interfacesAndProperties);
+    } else {
+        backend = new DeviceBackend(udi, interfacesAndProperties);
+        backend->moveToDispatcherThread();
         s_backends.insert(udi, backend);
     }
 
@@ -53,43 +210,175 @@ DeviceBackend *DeviceBackend::backendForUDI(const QString &udi, bool create)
 
 void DeviceBackend::destroyBackend(const QString &udi)
 {
+    QMutexLocker locker(&s_backendsMutex);
+
     if (s_backends.contains(udi)) {
         DeviceBackend *backend = s_backends.value(udi);
         s_backends.remove(udi);
         delete backend;
     }
+
+    if (s_backends.isEmpty()) {
+        delete s_dispatcher;
+        s_dispatcher = 0;
+
+        // Nothing keeps it current anymore
+        QMutexLocker cryptoLocker(&s_cryptoMutex);
+        s_clearTextDevices.clear();
+        s_backingDevices.clear();
+        s_cryptoIndexSeeded = false;
+    }
+}
+
+QString DeviceBackend::clearTextDevice(const QString &backingUdi)
+{
+    {
+        QMutexLocker locker(&s_cryptoMutex);
+        if (s_cryptoIndexSeeded || s_clearTextDevices.contains(backingUdi)) {
+            return s_clearTextDevices.value(backingUdi);
+        }
+    }
+
+    seedCryptoIndex();
+
+    QMutexLocker locker(&s_cryptoMutex);
+    return s_clearTextDevices.value(backingUdi);
+}
+
+void DeviceBackend::seedCryptoIndex()
+{
+    /* The signals only tell about the containers unlocked since the dispatcher
+     * exists, one look at the whole object tree gives the others */
+    qDBusRegisterMetaType<VariantMapMap>();
+    qDBusRegisterMetaType<DBUSManagerStruct>();
+
+    QDBusMessage call = QDBusMessage::createMethodCall(UD2_DBUS_SERVICE, UD2_DBUS_PATH, DBUS_INTERFACE_MANAGER, "GetManagedObjects");
+    QDBusReply<DBUSManagerStruct> reply = QDBusConnection::systemBus().call(call);
+    if (!reply.isValid()) {
+        qWarning() << "Failed looking up the cleartext devices:" << reply.error().name() << reply.error().message();
+        return;
+    }
+
+    const DBUSManagerStruct managedObjects = reply.value();
+    DBUSManagerStruct::ConstIterator it = managedObjects.constBegin();
+    for (; it != managedObjects.constEnd(); ++it) {
+        const QVariantMap blockProps = it.value().value(UD2_DBUS_INTERFACE_BLOCK);
+        if (blockProps.contains("CryptoBackingDevice")) {
+            updateCryptoBackingDevice(it.key().path(), blockProps.value("CryptoBackingDevice"));
+        }
+    }
+
+    /* Same order as destroyBackend(): the index only stays current while the dispatcher lives */
+    QMutexLocker locker(&s_backendsMutex);
+    QMutexLocker cryptoLocker(&s_cryptoMutex);
+    s_cryptoIndexSeeded = (s_dispatcher != 0);
+}
+
+void DeviceBackend::updateCryptoBackingDevice(const QString &udi, const QVariant &backingDevice)
+{
+    /* "/" stands for no backing device, as does an invalid QVariant */
+    QString backingUdi = backingDevice.value<QDBusObjectPath>().path();
+    if (backingUdi == QLatin1String("/")) {
+        backingUdi.clear();
+    }
+
+    QMutexLocker locker(&s_cryptoMutex);
+
+    const QString previous = s_backingDevices.value(udi);
+    if (previous == backingUdi) {
+        return;
+    }
+
+    if (!previous.isEmpty()) {
+        s_backingDevices.remove(udi);
+        if (s_clearTextDevices.value(previous) == udi) {
+            s_clearTextDevices.remove(previous);
+        }
+    }
+
+    if (!backingUdi.isEmpty()) {
+        s_backingDevices.insert(udi, backingUdi);
+        s_clearTextDevices.insert(backingUdi, udi);
+    }
 }
 
 DeviceBackend::DeviceBackend(const QString &udi)
-    : m_udi(udi)
+    : m_mutex(QMutex::Recursive)
+    , m_device(0)
+    , m_propertiesFetched(false)
+    , m_propertiesComplete(false)
+    , m_udi(udi)
 {
     //qDebug() << "Creating backend for device" << m_udi;
-    m_device = new QDBusInterface(UD2_DBUS_SERVICE, m_udi,
-                                  QString(), // no interface, we aggregate them
-                                  QDBusConnection::systemBus(), this);
-
-    if (m_device->isValid()) {
-        QDBusConnection::systemBus().connect(UD2_DBUS_SERVICE, m_udi, DBUS_INTERFACE_PROPS, "PropertiesChanged", this,
-                                             SLOT(slotPropertiesChanged(QString,QVariantMap,QStringList)));
-        QDBusConnection::systemBus().connect(UD2_DBUS_SERVICE, UD2_DBUS_PATH, DBUS_INTERFACE_MANAGER, "InterfacesAdded",
-                                             this, SLOT(slotInterfacesAdded(QDBusObjectPath,VariantMapMap)));
-        QDBusConnection::systemBus().connect(UD2_DBUS_SERVICE, UD2_DBUS_PATH, DBUS_INTERFACE_MANAGER, "InterfacesRemoved",
-                                             this, SLOT(slotInterfacesRemoved(QDBusObjectPath,QStringList)));
-
+    if (device()->isValid()) {
+        connectSignals();
         initInterfaces();
     }
 }
 
+DeviceBackend::DeviceBackend(const QString &udi, const VariantMapMap &interfacesAndProperties)
+    : m_mutex(QMutex::Recursive)
+    , m_device(0)
+    , m_propertiesFetched(false)
+    , m_propertiesComplete(false)
+    , m_udi(udi)
+{
+    /* The object is known to exist and its whole state is given to us already,
+     * typically from ObjectManager.GetManagedObjects(), so don't ask the bus again */
+    connectSignals();
+    setInterfacesAndProperties(interfacesAndProperties);
+}
+
 DeviceBackend::~DeviceBackend()
 {
     //qDebug() << "Destroying backend for device" << m_udi;
+    delete m_device;
+}
+
+void DeviceBackend::connectSignals()
+{
+    /* The signals reach us through the dispatcher, looked up by UDI in s_backends */
+    if (!s_dispatcher) {
+        s_dispatcher = new DeviceBackendDispatcher;
+
+        // The first backend might come from a query running in a worker thread
+        if (QCoreApplication::instance()) {
+            s_dispatcher->moveToThread(QCoreApplication::instance()->thread());
+        }
+    }
+}
+
+void DeviceBackend::moveToDispatcherThread()
+{
+    /* Created by whichever thread asked first, but fed by the dispatcher: a backend
+     * left in a pool thread would have its queued calls wait for that thread */
+    if (s_dispatcher && thread() != s_dispatcher->thread()) {
+        moveToThread(s_dispatcher->thread());
+    }
+}
+
+QDBusInterface *DeviceBackend::device() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    /* Creating it introspects the object, only do it when really needed. Any thread
+     * may ask for it, so it can't be a child of ours: deleted along with us instead */
+    if (!m_device) {
+        m_device = new QDBusInterface(UD2_DBUS_SERVICE, m_udi,
+                                      QString(), // no interface, we aggregate them
+                                      QDBusConnection::systemBus());
+    }
+
+    return m_device;
 }
 
 void DeviceBackend::initInterfaces()
 {
+    const QString xmlData = introspect();
+
+    QMutexLocker locker(&m_mutex);
     m_interfaces.clear();
 
-    const QString xmlData = introspect();
     if (xmlData.isEmpty()) {
         qDebug() << m_udi << "has no interfaces!";
         return;
@@ -113,6 +402,7 @@ void DeviceBackend::initInterfaces()
 
 QStringList DeviceBackend::interfaces() const
 {
+    QMutexLocker locker(&m_mutex);
     return m_interfaces;
 }
 
@@ -123,12 +413,14 @@ const QString &DeviceBackend::udi() const
 
 QVariant DeviceBackend::prop(const QString &key) const
 {
+    QMutexLocker locker(&m_mutex);
     checkCache(key);
     return m_propertyCache.value(key);
 }
 
 bool DeviceBackend::propertyExists(const QString &key) const
 {
+    QMutexLocker locker(&m_mutex);
     checkCache(key);
     /* checkCache() will put an invalid QVariant in cache when the property
      * does not exist, so check for validity, not for an actual presence. */
@@ -137,18 +429,40 @@ bool DeviceBackend::propertyExists(const QString &key) const
 
 QVariantMap DeviceBackend::allProperties() const
 {
+    QMutexLocker locker(&m_mutex);
+
     QDBusMessage call = QDBusMessage::createMethodCall(UD2_DBUS_SERVICE, m_udi, DBUS_INTERFACE_PROPS, "GetAll");
 
+    /* Send the requests for all the interfaces before waiting for any answer,
+     * so that they cost a single round trip instead of one each */
+    QList<QDBusPendingCall> pendingCalls;
     Q_FOREACH (const QString &iface, m_interfaces) {
         call.setArguments(QVariantList() << iface);
-        QDBusPendingReply<QVariantMap> reply = QDBusConnection::systemBus().call(call);
+        pendingCalls.append(QDBusConnection::systemBus().asyncCall(call));
+    }
+
+    bool complete = true;
+    Q_FOREACH (const QDBusPendingCall &pendingCall, pendingCalls) {
+        QDBusPendingReply<QVariantMap> reply = pendingCall;
+        reply.waitForFinished();
 
         if (reply.isValid()) {
-            m_propertyCache.unite(reply.value());
+            const QVariantMap props = reply.value();
+            for (QVariantMap::ConstIterator it = props.constBegin(); it != props.constEnd(); ++it) {
+                m_propertyCache.insert(it.key(), it.value());
+            }
         } else {
             qWarning() << "Error getting props:" << reply.error().name() << reply.error().message();
+            complete = false;
         }
-        //qDebug() << "After iface" << iface << ", cache now contains" << m_cache.size() << "items";
+    }
+
+    m_missingProperties.clear();
+    m_propertiesFetched = true;
+    m_propertiesComplete = complete;
+
+    if (complete) {
+        updateCryptoBackingDevice(m_udi, m_propertyCache.value("CryptoBackingDevice"));
     }
 
     return m_propertyCache;
@@ -156,7 +470,42 @@ QVariantMap DeviceBackend::allProperties() const
 
 void DeviceBackend::invalidateProperties()
 {
+    QMutexLocker locker(&m_mutex);
     m_propertyCache.clear();
+    m_missingProperties.clear();
+    m_propertiesFetched = false;
+    m_propertiesComplete = false;
+}
+
+void DeviceBackend::setInterfacesAndProperties(const VariantMapMap &interfacesAndProperties)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_interfaces.clear();
+    m_propertyCache.clear();
+    m_missingProperties.clear();
+
+    QMapIterator<QString, QVariantMap> i(interfacesAndProperties);
+    while (i.hasNext()) {
+        i.next();
+        /* Same filtering as in initInterfaces() */
+        if (!i.key().startsWith(UD2_DBUS_SERVICE)) {
+            continue;
+        }
+
+        m_interfaces.append(i.key());
+
+        QMapIterator<QString, QVariant> prop(i.value());
+        while (prop.hasNext()) {
+            prop.next();
+            m_propertyCache.insert(prop.key(), prop.value());
+        }
+    }
+
+    m_propertiesFetched = true;
+    m_propertiesComplete = true;
+
+    updateCryptoBackingDevice(m_udi, m_propertyCache.value("CryptoBackingDevice"));
 }
 
 QString DeviceBackend::introspect() const
@@ -172,24 +521,40 @@ QString DeviceBackend::introspect() const
     }
 }
 
+#ifdef SOLID_TESTING_BUILD
+int DeviceBackend::propertyLookups()
+{
+    return s_propertyLookups.load();
+}
+#endif
+
+// Call with m_mutex held
 void DeviceBackend::checkCache(const QString &key) const
 {
-    if (m_propertyCache.isEmpty()) { // recreate the cache
+#ifdef SOLID_TESTING_BUILD
+    s_propertyLookups.ref();
+#endif
+
+    if (!m_propertiesFetched) { // recreate the cache
         allProperties();
     }
 
-    if (m_propertyCache.contains(key)) {
+    if (m_propertyCache.contains(key) || m_missingProperties.contains(key)) {
         return;
     }
 
-    QVariant reply = m_device->property(key.toUtf8());
-    m_propertyCache.insert(key, reply);
+    /* Every interface told us about all its properties, so this one doesn't
+     * exist: remember it instead of asking the bus again and again */
+    if (m_propertiesComplete) {
+        m_missingProperties.insert(key);
+        return;
+    }
 
-    if (!reply.isValid()) {
-        /* Store the item in the cache anyway so next time we don't have to
-         * do the DBus call to find out it does not exist but just check whether
-         * prop(key).isValid() */
-//         qDebug() << m_udi << ": property" << key << "does not exist";
+    QVariant reply = device()->property(key.toUtf8());
+    if (reply.isValid()) {
+        m_propertyCache.insert(key, reply);
+    } else {
+        m_missingProperties.insert(key);
     }
 }
 
@@ -202,46 +567,70 @@ void DeviceBackend::slotPropertiesChanged(const QString &ifaceName, const QVaria
 
     QMap<QString, int> changeMap;
 
+    m_mutex.lock();
+
     Q_FOREACH (const QString &key, invalidatedProps) {
         m_propertyCache.remove(key);
         changeMap.insert(key, Solid::GenericInterface::PropertyModified);
         //qDebug() << "\t invalidated:" << key;
     }
 
+    // The new values have to be asked for
+    if (!invalidatedProps.isEmpty()) {
+        m_propertiesFetched = false;
+    }
+
     QMapIterator<QString, QVariant> i(changedProps);
     while (i.hasNext()) {
         i.next();
         const QString key = i.key();
         m_propertyCache.insert(key, i.value());  // replace the value
+        m_missingProperties.remove(key);
         changeMap.insert(key, Solid::GenericInterface::PropertyModified);
         //qDebug() << "\t modified:" << key << ":" << m_propertyCache.value(key);
     }
 
+    m_mutex.unlock();
+
     emit propertyChanged(changeMap);
     emit changed();
 }
 
-void DeviceBackend::slotInterfacesAdded(const QDBusObjectPath &object_path, const VariantMapMap &interfaces_and_properties)
+void DeviceBackend::slotInterfacesAdded(const VariantMapMap &interfaces_and_properties)
 {
-    if (object_path.path() != m_udi) {
-        return;
-    }
+    m_mutex.lock();
 
-    Q_FOREACH (const QString &iface, interfaces_and_properties.keys()) {
+    QMapIterator<QString, QVariantMap> i(interfaces_and_properties);
+    while (i.hasNext()) {
+        i.next();
         /* Don't store generic DBus interfaces */
-        if (iface.startsWith(UD2_DBUS_SERVICE)) {
-            m_interfaces.append(iface);
+        if (!i.key().startsWith(UD2_DBUS_SERVICE)) {
+            continue;
+        }
+
+        m_interfaces.append(i.key());
+
+        /* The new properties come along, they may have been missing so far */
+        QMapIterator<QString, QVariant> prop(i.value());
+        while (prop.hasNext()) {
+            prop.next();
+            m_propertyCache.insert(prop.key(), prop.value());
+            m_missingProperties.remove(prop.key());
         }
     }
+
+    m_mutex.unlock();
+
+    emit interfacesChanged();
 }
 
-void DeviceBackend::slotInterfacesRemoved(const QDBusObjectPath &object_path, const QStringList &interfaces)
+void DeviceBackend::slotInterfacesRemoved(const QStringList &interfaces)
 {
-    if (object_path.path() != m_udi) {
-        return;
-    }
-
+    m_mutex.lock();
     Q_FOREACH (const QString &iface, interfaces) {
         m_interfaces.removeAll(iface);
     }
+    m_mutex.unlock();
+
+    emit interfacesChanged();
 }
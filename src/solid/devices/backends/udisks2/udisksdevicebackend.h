@@ -24,7 +24,12 @@
 #define UDISKSDEVICEBACKEND_H
 
 #include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QSet>
 #include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
 #include <QtDBus/QDBusObjectPath>
 #include <QtDBus/QDBusInterface>
 #include <QStringList>
@@ -38,6 +43,25 @@ namespace Backends
 namespace UDisks2
 {
 
+/**
+ * Receives the UDisks2 change signals once for all devices and hands each
+ * of them to the backend of the object it is about.
+ */
+class DeviceBackendDispatcher: public QObject
+{
+
+    Q_OBJECT
+
+public:
+    DeviceBackendDispatcher();
+    ~DeviceBackendDispatcher();
+
+private Q_SLOTS:
+    void slotInterfacesAdded(const QDBusObjectPath &object_path, const VariantMapMap &interfaces_and_properties);
+    void slotInterfacesRemoved(const QDBusObjectPath &object_path, const QStringList &interfaces);
+    void slotPropertiesChanged(const QDBusMessage &msg);
+};
+
 class DeviceBackend: public QObject
 {
 
@@ -45,9 +69,28 @@ class DeviceBackend: public QObject
 
 public:
     static DeviceBackend *backendForUDI(const QString &udi, bool create = true);
+    static DeviceBackend *backendForUDI(const QString &udi, const VariantMapMap &interfacesAndProperties);
     static void destroyBackend(const QString &udi);
 
+    /**
+     * The cleartext device unlocked from the given LUKS container, if any.
+     * Answered from an index kept current from the bus signals, no bus call
+     * but for the first miss, which asks the service for the containers
+     * unlocked before any backend was there to follow the signals.
+     */
+    static QString clearTextDevice(const QString &backingUdi);
+
+#ifdef SOLID_TESTING_BUILD
+    /**
+     * How many times a property was looked up in any backend, lets the
+     * tests and benchmarks check what is computed from the properties.
+     * Only counted in the library built for them.
+     */
+    static int propertyLookups();
+#endif
+
     DeviceBackend(const QString &udi);
+    DeviceBackend(const QString &udi, const VariantMapMap &interfacesAndProperties);
     ~DeviceBackend();
 
     QVariant prop(const QString &key) const;
@@ -58,27 +101,56 @@ public:
     const QString &udi() const;
 
     void invalidateProperties();
+    void setInterfacesAndProperties(const VariantMapMap &interfacesAndProperties);
 Q_SIGNALS:
     void propertyChanged(const QMap<QString, int> &changeMap);
     void changed();
+    void interfacesChanged();
 
-private Q_SLOTS:
-    void slotInterfacesAdded(const QDBusObjectPath &object_path, const VariantMapMap &interfaces_and_properties);
-    void slotInterfacesRemoved(const QDBusObjectPath &object_path, const QStringList &interfaces);
+private:
+    friend class DeviceBackendDispatcher;
+
+    void slotInterfacesAdded(const VariantMapMap &interfaces_and_properties);
+    void slotInterfacesRemoved(const QStringList &interfaces);
     void slotPropertiesChanged(const QString &ifaceName, const QVariantMap &changedProps, const QStringList &invalidatedProps);
 
-private:
+    void connectSignals();
+    void moveToDispatcherThread();
+    static void updateCryptoBackingDevice(const QString &udi, const QVariant &backingDevice);
+    static void seedCryptoIndex();
     void initInterfaces();
     QString introspect() const;
     void checkCache(const QString &key) const;
+    QDBusInterface *device() const;
+
+    /* Guards the device, caches and interfaces below: queries may run in worker threads while
+     * the bus signals come in the thread of the dispatcher */
+    mutable QMutex m_mutex;
 
-    QDBusInterface *m_device;
+    mutable QDBusInterface *m_device;
 
     mutable QVariantMap m_propertyCache;
+    /* Properties known not to exist, so that asking again doesn't go to the bus */
+    mutable QSet<QString> m_missingProperties;
+    /* Whether m_propertyCache holds what all the interfaces had to say */
+    mutable bool m_propertiesFetched;
+    mutable bool m_propertiesComplete;
     QStringList m_interfaces;
     QString m_udi;
 
-    static QMap<QString, DeviceBackend *> s_backends;
+    static QHash<QString, DeviceBackend *> s_backends;
+    static QMutex s_backendsMutex;
+    static DeviceBackendDispatcher *s_dispatcher;
+
+    /* Backing device -> cleartext device, and the other way round for removals */
+    static QHash<QString, QString> s_clearTextDevices;
+    static QHash<QString, QString> s_backingDevices;
+    static bool s_cryptoIndexSeeded;
+    static QMutex s_cryptoMutex;
+
+#ifdef SOLID_TESTING_BUILD
+    static QAtomicInt s_propertyLookups;
+#endif
 
 };
 
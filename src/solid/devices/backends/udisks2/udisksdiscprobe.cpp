@@ -0,0 +1,145 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "udisksdiscprobe.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <QtCore/QDebug>
+#include <QtCore/QtEndian>
+
+using namespace Solid::Backends::UDisks2;
+
+// The primary volume descriptor is in the 17th 2048 byte sector
+static const off_t s_descriptorOffset = 0x8000;
+static const int s_descriptorSize = 2048;
+
+Solid::OpticalDisc::ContentType DiscProbe::detectContent(const QByteArray &deviceFile)
+{
+    const int fd = open(deviceFile.constData(), O_RDONLY);
+    if (fd < 0) {
+        qDebug("Advanced probing on %s failed while opening it", deviceFile.constData());
+        return Solid::OpticalDisc::NoContent;
+    }
+
+    const Solid::OpticalDisc::ContentType result = detectContent(fd);
+    close(fd);
+
+    switch (result) {
+    case Solid::OpticalDisc::VideoDvd:
+        qDebug("Disc in %s is a Video DVD", deviceFile.constData());
+        break;
+    case Solid::OpticalDisc::VideoBluRay:
+        qDebug("Disc in %s is a Blu-ray video disc", deviceFile.constData());
+        break;
+    case Solid::OpticalDisc::VideoCd:
+        qDebug("Disc in %s is a Video CD", deviceFile.constData());
+        break;
+    case Solid::OpticalDisc::SuperVideoCd:
+        qDebug("Disc in %s is a Super Video CD", deviceFile.constData());
+        break;
+    default:
+        break;
+    }
+
+    return result;
+}
+
+// inspired by http://cgit.freedesktop.org/hal/tree/hald/linux/probing/probe-volume.c
+Solid::OpticalDisc::ContentType DiscProbe::detectContent(int fd, ReadFunction readAt)
+{
+    if (!readAt) {
+        readAt = ::pread;
+    }
+
+    /* Each read costs a seek on a slow optical drive: take the whole
+     * descriptor at once, then the path table, and parse them in memory */
+    uchar descriptor[s_descriptorSize];
+    if (readAt(fd, descriptor, s_descriptorSize, s_descriptorOffset) != s_descriptorSize) {
+        qDebug("Advanced probing failed while reading the volume descriptor");
+        return Solid::OpticalDisc::NoContent;
+    }
+
+    if (descriptor[0] != 1 || memcmp(descriptor + 1, "CD001", 5) != 0) {
+        qDebug("Advanced probing found no ISO9660 primary volume descriptor");
+        return Solid::OpticalDisc::NoContent;
+    }
+
+    /* the discs block size, the path table size and location (in blocks),
+     * in their little endian variant */
+    const quint16 blockSize = qFromLittleEndian<quint16>(descriptor + 128);
+    const quint32 tableSize = qMin<quint32>(qFromLittleEndian<quint32>(descriptor + 132), MaxPathTableSize);
+    const quint32 tableBlock = qFromLittleEndian<quint32>(descriptor + 140);
+
+    if (blockSize == 0 || tableSize == 0) {
+        qDebug("Advanced probing found an empty path table");
+        return Solid::OpticalDisc::NoContent;
+    }
+
+    QByteArray table(tableSize, Qt::Uninitialized);
+    const ssize_t tableRead = readAt(fd, table.data(), tableSize, off_t(blockSize) * tableBlock);
+    if (tableRead <= 0) {
+        qDebug("Advanced probing failed while reading the path table");
+        return Solid::OpticalDisc::NoContent;
+    }
+
+    const uchar *data = reinterpret_cast<const uchar *>(table.constData());
+    const int size = tableRead;
+    int pos = 0;
+
+    /* loop through the path table entries: the root first, then its
+     * subdirectories, then theirs and so on */
+    while (pos + 8 <= size) {
+        /* length of the directory name, and the number of the parent
+         * directory's entry, the 1st entry being the top directory */
+        const int nameLength = data[pos];
+        const quint16 parent = qFromLittleEndian<quint16>(data + pos + 6);
+
+        if (nameLength == 0 || pos + 8 + nameLength > size) {
+            break;
+        }
+
+        /* past the directories at the root, there is nothing to look for */
+        if (parent > 1) {
+            break;
+        }
+
+        /* if we found a folder that has the root as a parent, and the directory name matches
+           one of the special directories then set the properties accordingly */
+        if (parent == 1) {
+            const char *name = reinterpret_cast<const char *>(data + pos + 8);
+
+            if (nameLength == 8 && qstrnicmp(name, "VIDEO_TS", 8) == 0) {
+                return Solid::OpticalDisc::VideoDvd;
+            } else if (nameLength == 4 && qstrnicmp(name, "BDMV", 4) == 0) {
+                return Solid::OpticalDisc::VideoBluRay;
+            } else if (nameLength == 3 && qstrnicmp(name, "VCD", 3) == 0) {
+                return Solid::OpticalDisc::VideoCd;
+            } else if (nameLength == 4 && qstrnicmp(name, "SVCD", 4) == 0) {
+                return Solid::OpticalDisc::SuperVideoCd;
+            }
+        }
+
+        /* all path table entries are padded to be even */
+        pos += 8 + nameLength + (nameLength % 2);
+    }
+
+    return Solid::OpticalDisc::NoContent;
+}
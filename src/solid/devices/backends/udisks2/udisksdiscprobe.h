@@ -0,0 +1,55 @@
+/*
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef UDISKS2DISCPROBE_H
+#define UDISKS2DISCPROBE_H
+
+#include <sys/types.h>
+
+#include <QtCore/QByteArray>
+
+#include <solid/opticaldisc.h>
+
+namespace Solid
+{
+namespace Backends
+{
+namespace UDisks2
+{
+
+/**
+ * Finds out what an ISO9660 disc holds from the directories at its root,
+ * in two reads: the primary volume descriptor, then the path table.
+ */
+class DiscProbe
+{
+public:
+    typedef ssize_t (*ReadFunction)(int fd, void *buffer, size_t count, off_t offset);
+
+    static Solid::OpticalDisc::ContentType detectContent(const QByteArray &deviceFile);
+    static Solid::OpticalDisc::ContentType detectContent(int fd, ReadFunction readAt = 0);
+
+    /* Bound for the path table read, the root directories come first in it */
+    static const int MaxPathTableSize = 64 * 1024;
+};
+
+}
+}
+}
+
+#endif // UDISKS2DISCPROBE_H
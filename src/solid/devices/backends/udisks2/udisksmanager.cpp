@@ -23,7 +23,6 @@
 
 #include <QtCore/QDebug>
 #include <QtDBus>
-#include <QtXml/QDomDocument>
 
 #include "../shared/rootdevice.h"
 
@@ -34,16 +33,18 @@ Manager::Manager(QObject *parent)
     : Solid::Ifaces::DeviceManager(parent),
       m_manager(UD2_DBUS_SERVICE,
                 UD2_DBUS_PATH,
-                QDBusConnection::systemBus())
+                QDBusConnection::systemBus()),
+      m_serviceWatcher(UD2_DBUS_SERVICE,
+                       QDBusConnection::systemBus(),
+                       QDBusServiceWatcher::WatchForRegistration),
+      m_deviceCacheValid(false)
 {
-    m_supportedInterfaces
-            << Solid::DeviceInterface::GenericInterface
-            << Solid::DeviceInterface::Block
-            << Solid::DeviceInterface::StorageAccess
-            << Solid::DeviceInterface::StorageDrive
-            << Solid::DeviceInterface::OpticalDrive
-            << Solid::DeviceInterface::OpticalDisc
-            << Solid::DeviceInterface::StorageVolume;
+    // Loaded by a worker thread, the manager is moved to the frontend's:
+    // what it listens through has to follow it there
+    m_manager.setParent(this);
+    m_serviceWatcher.setParent(this);
+
+    m_supportedInterfaces = supportedInterfaceTypes();
 
     qDBusRegisterMetaType<QList<QDBusObjectPath> >();
     qDBusRegisterMetaType<QVariantMap>();
@@ -51,33 +52,25 @@ Manager::Manager(QObject *parent)
     qDBusRegisterMetaType<ByteArrayList>();
     qDBusRegisterMetaType<DBUSManagerStruct>();
 
-    bool serviceFound = m_manager.isValid();
-    if (!serviceFound) {
-        // find out whether it will be activated automatically
-        QDBusMessage message = QDBusMessage::createMethodCall("org.freedesktop.DBus",
-                               "/org/freedesktop/DBus",
-                               "org.freedesktop.DBus",
-                               "ListActivatableNames");
-
-        QDBusReply<QStringList> reply = QDBusConnection::systemBus().call(message);
-        if (reply.isValid() && reply.value().contains(UD2_DBUS_SERVICE)) {
-            QDBusConnection::systemBus().interface()->startService(UD2_DBUS_SERVICE);
-            serviceFound = true;
-        }
-    }
+    connect(&m_manager, SIGNAL(InterfacesAdded(QDBusObjectPath,VariantMapMap)),
+            this, SLOT(slotInterfacesAdded(QDBusObjectPath,VariantMapMap)));
+    connect(&m_manager, SIGNAL(InterfacesRemoved(QDBusObjectPath,QStringList)),
+            this, SLOT(slotInterfacesRemoved(QDBusObjectPath,QStringList)));
 
-    if (serviceFound) {
-        connect(&m_manager, SIGNAL(InterfacesAdded(QDBusObjectPath,VariantMapMap)),
-                this, SLOT(slotInterfacesAdded(QDBusObjectPath,VariantMapMap)));
-        connect(&m_manager, SIGNAL(InterfacesRemoved(QDBusObjectPath,QStringList)),
-                this, SLOT(slotInterfacesRemoved(QDBusObjectPath,QStringList)));
-    }
+    // UDisks2 may be started, or restarted, later on: enumerate it again then
+    connect(&m_serviceWatcher, SIGNAL(serviceRegistered(QString)),
+            this, SLOT(slotStartEnumeration()));
+
+    /* Don't wait for the service here, the first method call activates it if needed
+     * and the devices allDevices() didn't return yet get announced as they are
+     * discovered. This is queued so that the answer comes to the thread the manager
+     * ends up living in */
+    QMetaObject::invokeMethod(this, "slotStartEnumeration", Qt::QueuedConnection);
 }
 
 Manager::~Manager()
 {
-    while (!m_deviceCache.isEmpty()) {
-        QString udi = m_deviceCache.takeFirst();
+    Q_FOREACH (const QString &udi, m_deviceCache) {
         DeviceBackend::destroyBackend(udi);
     }
 }
@@ -92,7 +85,7 @@ QObject *Manager::createDevice(const QString &udi)
         root->setIcon("server-database"); // Obviously wasn't meant for that, but maps nicely in oxygen icon set :-p
 
         return root;
-    } else if (deviceCache().contains(udi)) {
+    } else if (isCached(udi)) {
         return new Device(udi);
     } else {
         return 0;
@@ -104,23 +97,16 @@ QStringList Manager::devicesFromQuery(const QString &parentUdi, Solid::DeviceInt
     QStringList result;
 
     if (!parentUdi.isEmpty()) {
-        Q_FOREACH (const QString &udi, deviceCache()) {
+        Q_FOREACH (const QString &udi, deviceCache(type)) {
             Device device(udi);
-            if (device.queryDeviceInterface(type) && device.parentUdi() == parentUdi) {
+            if (device.parentUdi() == parentUdi) {
                 result << udi;
             }
         }
 
         return result;
     } else if (type != Solid::DeviceInterface::Unknown) {
-        Q_FOREACH (const QString &udi, deviceCache()) {
-            Device device(udi);
-            if (device.queryDeviceInterface(type)) {
-                result << udi;
-            }
-        }
-
-        return result;
+        return deviceCache(type);
     }
 
     return deviceCache();
@@ -128,44 +114,74 @@ QStringList Manager::devicesFromQuery(const QString &parentUdi, Solid::DeviceInt
 
 QStringList Manager::allDevices()
 {
-    introspect("/org/freedesktop/UDisks2/block_devices", true /*checkOptical*/);
-    introspect("/org/freedesktop/UDisks2/drives");
+    /* One call gives us every object along with its interfaces and properties,
+     * use it to prime the backends instead of introspecting them one by one */
+    QDBusPendingReply<DBUSManagerStruct> reply = m_manager.GetManagedObjects();
+    reply.waitForFinished();
+
+    if (!reply.isValid()) {
+        qWarning() << "Failed enumerating UDisks2 objects:" << reply.error().name() << "\n" << reply.error().message();
+        QMutexLocker locker(&m_deviceCacheMutex);
+        m_deviceCache.clear();
+        m_typeCache.clear();
+        m_deviceCacheValid = false;
+        return QStringList();
+    }
+
+    const QStringList devices = processManagedObjects(reply.value());
+
+    QHash<Solid::DeviceInterface::Type, QSet<QString> > typeCache;
+    Q_FOREACH (const QString &udi, devices) {
+        Q_FOREACH (Solid::DeviceInterface::Type type, deviceTypes(udi)) {
+            typeCache[type].insert(udi);
+        }
+    }
 
-    return m_deviceCache;
+    QMutexLocker locker(&m_deviceCacheMutex);
+    m_deviceCache = devices.toSet();
+    m_typeCache = typeCache;
+    m_deviceCacheValid = true;
+    return devices;
 }
 
-void Manager::introspect(const QString &path, bool checkOptical)
+QStringList Manager::processManagedObjects(const DBUSManagerStruct &managedObjects)
 {
-    QDBusMessage call = QDBusMessage::createMethodCall(UD2_DBUS_SERVICE, path,
-                        DBUS_INTERFACE_INTROSPECT, "Introspect");
-    QDBusPendingReply<QString> reply = QDBusConnection::systemBus().call(call);
-
-    if (reply.isValid()) {
-        QDomDocument dom;
-        dom.setContent(reply.value());
-        QDomNodeList nodeList = dom.documentElement().elementsByTagName("node");
-        for (int i = 0; i < nodeList.count(); i++) {
-            QDomElement nodeElem = nodeList.item(i).toElement();
-            if (!nodeElem.isNull() && nodeElem.hasAttribute("name")) {
-                const QString udi = path + "/" + nodeElem.attribute("name");
-
-                if (checkOptical) {
-                    Device device(udi);
-                    if (device.mightBeOpticalDisc()) {
-                        QDBusConnection::systemBus().connect(UD2_DBUS_SERVICE, udi, DBUS_INTERFACE_PROPS, "PropertiesChanged", this,
-                                                             SLOT(slotMediaChanged(QDBusMessage)));
-                        if (!device.isOpticalDisc()) { // skip empty CD disc
-                            continue;
-                        }
-                    }
-                }
-
-                m_deviceCache.append(udi);
+    QStringList devices;
+    QStringList blockDevices;
+    QStringList drives;
+
+    DBUSManagerStruct::ConstIterator it = managedObjects.constBegin();
+    DBUSManagerStruct::ConstIterator end = managedObjects.constEnd();
+    for (; it != end; ++it) {
+        const QString udi = it.key().path();
+
+        if (udi.startsWith(UD2_DBUS_PATH_BLOCKDEVICES)) {
+            blockDevices << udi;
+        } else if (udi.startsWith(UD2_DBUS_PATH_DRIVES)) {
+            drives << udi;
+        } else {
+            continue;
+        }
+
+        watchBackend(DeviceBackend::backendForUDI(udi, it.value()));
+    }
+
+    /* Only look at the drives once all of them are known */
+    Q_FOREACH (const QString &udi, blockDevices) {
+        Device device(udi);
+        if (device.mightBeOpticalDisc()) {
+            QDBusConnection::systemBus().connect(UD2_DBUS_SERVICE, udi, DBUS_INTERFACE_PROPS, "PropertiesChanged", this,
+                                                 SLOT(slotMediaChanged(QDBusMessage)));
+            if (!device.isOpticalDisc()) { // skip empty CD disc
+                continue;
             }
         }
-    } else {
-        qWarning() << "Failed enumerating UDisks2 objects:" << reply.error().name() << "\n" << reply.error().message();
+
+        devices.append(udi);
     }
+
+    devices += drives;
+    return devices;
 }
 
 QSet< Solid::DeviceInterface::Type > Manager::supportedInterfaces() const
@@ -173,11 +189,28 @@ QSet< Solid::DeviceInterface::Type > Manager::supportedInterfaces() const
     return m_supportedInterfaces;
 }
 
+QSet<Solid::DeviceInterface::Type> Manager::supportedInterfaceTypes()
+{
+    return QSet<Solid::DeviceInterface::Type>()
+            << Solid::DeviceInterface::GenericInterface
+            << Solid::DeviceInterface::Block
+            << Solid::DeviceInterface::StorageAccess
+            << Solid::DeviceInterface::StorageDrive
+            << Solid::DeviceInterface::OpticalDrive
+            << Solid::DeviceInterface::OpticalDisc
+            << Solid::DeviceInterface::StorageVolume;
+}
+
 QString Manager::udiPrefix() const
 {
     return UD2_UDI_DISKS_PREFIX;
 }
 
+bool Manager::isEnumerationThreadSafe() const
+{
+    return true;
+}
+
 void Manager::slotInterfacesAdded(const QDBusObjectPath &object_path, const VariantMapMap &interfaces_and_properties)
 {
     const QString udi = object_path.path();
@@ -191,14 +224,18 @@ void Manager::slotInterfacesAdded(const QDBusObjectPath &object_path, const Vari
 
     updateBackend(udi);
 
+    // Also files known devices under the types their new interfaces give them
+    const bool known = !cacheDevice(udi);
+
     // new device, we don't know it yet
-    if (!m_deviceCache.contains(udi)) {
-        m_deviceCache.append(udi);
+    if (!known) {
         emit deviceAdded(udi);
     }
     // re-emit in case of 2-stage devices like N9 or some Android phones
-    else if (m_deviceCache.contains(udi) && interfaces_and_properties.keys().contains(UD2_DBUS_INTERFACE_FILESYSTEM)) {
+    else if (interfaces_and_properties.keys().contains(UD2_DBUS_INTERFACE_FILESYSTEM)) {
         emit deviceAdded(udi);
+    } else {
+        emit deviceChanged(udi);
     }
 }
 
@@ -217,10 +254,25 @@ void Manager::slotInterfacesRemoved(const QDBusObjectPath &object_path, const QS
 
     Device device(udi);
 
-    if (!udi.isEmpty() && (interfaces.isEmpty() || device.interfaces().isEmpty())) {
+    // The dispatcher may not have told the backend yet
+    QStringList remaining = device.interfaces();
+    Q_FOREACH (const QString &iface, interfaces) {
+        remaining.removeAll(iface);
+    }
+
+    if (!udi.isEmpty() && (interfaces.isEmpty() || remaining.isEmpty())) {
         emit deviceRemoved(udi);
-        m_deviceCache.removeAll(udi);
+        uncacheDevice(udi);
         DeviceBackend::destroyBackend(udi);
+    } else {
+        m_deviceCacheMutex.lock();
+        const bool known = m_deviceCache.contains(udi);
+        m_deviceCacheMutex.unlock();
+
+        if (known) {
+            cacheDevice(udi); // refile it under the types it has left
+            emit deviceChanged(udi);
+        }
     }
 }
 
@@ -237,25 +289,170 @@ void Manager::slotMediaChanged(const QDBusMessage &msg)
     qulonglong size = properties.value("Size").toULongLong();
     qDebug() << "MEDIA CHANGED in" << udi << "; size is:" << size;
 
-    if (!m_deviceCache.contains(udi) && size > 0) { // we don't know the optdisc, got inserted
-        m_deviceCache.append(udi);
+    m_deviceCacheMutex.lock();
+    const bool known = m_deviceCache.contains(udi);
+    m_deviceCacheMutex.unlock();
+
+    if (!known && size > 0) { // we don't know the optdisc, got inserted
+        cacheDevice(udi);
         emit deviceAdded(udi);
     }
 
-    if (m_deviceCache.contains(udi) && size == 0) {  // we know the optdisc, got removed
+    if (known && size == 0) {  // we know the optdisc, got removed
         emit deviceRemoved(udi);
-        m_deviceCache.removeAll(udi);
+        uncacheDevice(udi);
         DeviceBackend::destroyBackend(udi);
     }
 }
 
-const QStringList &Manager::deviceCache()
+void Manager::slotBackendPropertyChanged(const QMap<QString, int> &changes)
+{
+    // Besides the interfaces, these decide the types, see Device::queryDeviceInterface()
+    if (!changes.contains("Drive") && !changes.contains("MediaCompatibility")) {
+        return;
+    }
+
+    DeviceBackend *backend = qobject_cast<DeviceBackend *>(sender());
+    if (!backend) {
+        return;
+    }
+
+    const QString udi = backend->udi();
+
+    m_deviceCacheMutex.lock();
+    const bool known = m_deviceCache.contains(udi);
+    m_deviceCacheMutex.unlock();
+
+    if (known) {
+        cacheDevice(udi);
+        emit deviceChanged(udi);
+    }
+}
+
+void Manager::slotStartEnumeration()
+{
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(m_manager.GetManagedObjects(), this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(slotManagedObjectsReceived(QDBusPendingCallWatcher*)));
+}
+
+void Manager::slotManagedObjectsReceived(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<DBUSManagerStruct> reply = *watcher;
+    watcher->deleteLater();
+
+    if (reply.isError()) {
+        // Not there yet, m_serviceWatcher tells us when it is
+        qDebug() << "UDisks2 not available:" << reply.error().name() << reply.error().message();
+        return;
+    }
+
+    const QStringList devices = processManagedObjects(reply.value());
+    QStringList added;
+
+    Q_FOREACH (const QString &udi, devices) {
+        if (cacheDevice(udi)) {
+            added.append(udi);
+        }
+    }
+
+    m_deviceCacheMutex.lock();
+    m_deviceCacheValid = true;
+    m_deviceCacheMutex.unlock();
+
+    // Whatever allDevices() didn't return is news, even if it was there all along
+    Q_FOREACH (const QString &udi, added) {
+        emit deviceAdded(udi);
+    }
+}
+
+QStringList Manager::deviceCache()
+{
+    {
+        QMutexLocker locker(&m_deviceCacheMutex);
+        if (m_deviceCacheValid) {
+            return m_deviceCache.toList();
+        }
+    }
+
+    return allDevices();
+}
+
+QStringList Manager::deviceCache(Solid::DeviceInterface::Type type)
+{
+    {
+        QMutexLocker locker(&m_deviceCacheMutex);
+        if (m_deviceCacheValid) {
+            return m_typeCache.value(type).toList();
+        }
+    }
+
+    allDevices();
+
+    QMutexLocker locker(&m_deviceCacheMutex);
+    return m_typeCache.value(type).toList();
+}
+
+bool Manager::isCached(const QString &udi)
+{
+    {
+        QMutexLocker locker(&m_deviceCacheMutex);
+        if (m_deviceCacheValid) {
+            return m_deviceCache.contains(udi);
+        }
+    }
+
+    return allDevices().contains(udi);
+}
+
+bool Manager::cacheDevice(const QString &udi)
+{
+    const QSet<Solid::DeviceInterface::Type> types = deviceTypes(udi);
+
+    QMutexLocker locker(&m_deviceCacheMutex);
+
+    const bool added = !m_deviceCache.contains(udi);
+    m_deviceCache.insert(udi);
+
+    Q_FOREACH (Solid::DeviceInterface::Type type, m_supportedInterfaces) {
+        if (types.contains(type)) {
+            m_typeCache[type].insert(udi);
+        } else if (!added) {
+            m_typeCache[type].remove(udi);
+        }
+    }
+
+    return added;
+}
+
+bool Manager::uncacheDevice(const QString &udi)
+{
+    QMutexLocker locker(&m_deviceCacheMutex);
+
+    if (!m_deviceCache.remove(udi)) {
+        return false;
+    }
+
+    QHash<Solid::DeviceInterface::Type, QSet<QString> >::Iterator it = m_typeCache.begin();
+    for (; it != m_typeCache.end(); ++it) {
+        it->remove(udi);
+    }
+
+    return true;
+}
+
+QSet<Solid::DeviceInterface::Type> Manager::deviceTypes(const QString &udi) const
 {
-    if (m_deviceCache.isEmpty()) {
-        allDevices();
+    QSet<Solid::DeviceInterface::Type> types;
+
+    Device device(udi);
+    Q_FOREACH (Solid::DeviceInterface::Type type, m_supportedInterfaces) {
+        if (device.queryDeviceInterface(type)) {
+            types.insert(type);
+        }
     }
 
-    return m_deviceCache;
+    return types;
 }
 
 void Manager::updateBackend(const QString &udi)
@@ -265,6 +462,8 @@ void Manager::updateBackend(const QString &udi)
         return;
     }
 
+    watchBackend(backend);
+
     //This doesn't emit "changed" signals. Signals are emitted later by DeviceBackend's slots
     backend->allProperties();
 
@@ -281,3 +480,11 @@ void Manager::updateBackend(const QString &udi)
 
     driveBackend->invalidateProperties();
 }
+
+void Manager::watchBackend(DeviceBackend *backend)
+{
+    if (backend) {
+        connect(backend, SIGNAL(propertyChanged(QMap<QString,int>)),
+                this, SLOT(slotBackendPropertyChanged(QMap<QString,int>)), Qt::UniqueConnection);
+    }
+}
@@ -29,6 +29,9 @@
 #include <solid/devices/ifaces/devicemanager.h>
 
 #include <QtDBus/QDBusInterface>
+#include <QtDBus/QDBusServiceWatcher>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 #include <QtCore/QSet>
 
 namespace Solid
@@ -48,21 +51,40 @@ public:
     QStringList devicesFromQuery(const QString &parentUdi, Solid::DeviceInterface::Type type) Q_DECL_OVERRIDE;
     QStringList allDevices() Q_DECL_OVERRIDE;
     QSet< Solid::DeviceInterface::Type > supportedInterfaces() const Q_DECL_OVERRIDE;
+    /**
+     * What supportedInterfaces() answers, known without constructing a manager
+     */
+    static QSet<Solid::DeviceInterface::Type> supportedInterfaceTypes();
     QString udiPrefix() const Q_DECL_OVERRIDE;
+    bool isEnumerationThreadSafe() const Q_DECL_OVERRIDE;
     virtual ~Manager();
 
 private Q_SLOTS:
     void slotInterfacesAdded(const QDBusObjectPath &object_path, const VariantMapMap &interfaces_and_properties);
     void slotInterfacesRemoved(const QDBusObjectPath &object_path, const QStringList &interfaces);
     void slotMediaChanged(const QDBusMessage &msg);
+    void slotBackendPropertyChanged(const QMap<QString, int> &changes);
+    void slotStartEnumeration();
+    void slotManagedObjectsReceived(QDBusPendingCallWatcher *watcher);
 
 private:
-    const QStringList &deviceCache();
-    void introspect(const QString &path, bool checkOptical = false);
+    QStringList deviceCache();
+    QStringList deviceCache(Solid::DeviceInterface::Type type);
+    bool isCached(const QString &udi);
+    bool cacheDevice(const QString &udi);
+    bool uncacheDevice(const QString &udi);
+    QSet<Solid::DeviceInterface::Type> deviceTypes(const QString &udi) const;
+    QStringList processManagedObjects(const DBUSManagerStruct &managedObjects);
     void updateBackend(const QString &udi);
+    void watchBackend(DeviceBackend *backend);
     QSet<Solid::DeviceInterface::Type> m_supportedInterfaces;
     org::freedesktop::DBus::ObjectManager m_manager;
-    QStringList m_deviceCache;
+    QDBusServiceWatcher m_serviceWatcher;
+    /* The known devices, and the same again filed under each of their types */
+    QSet<QString> m_deviceCache;
+    QHash<Solid::DeviceInterface::Type, QSet<QString> > m_typeCache;
+    bool m_deviceCacheValid;
+    QMutex m_deviceCacheMutex;
 };
 
 }
@@ -24,6 +24,9 @@
 
 #include <solid/devices/ifaces/opticaldisc.h>
 
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QHash>
+
 #include "../shared/udevqt.h"
 
 #include "udisksstoragevolume.h"
@@ -57,14 +60,22 @@ public:
     public:
         Identity();
         Identity(const Device &device, const Device &drive);
+        Identity(long long detectTime, long long size, uint labelHash);
         bool operator ==(const Identity &) const;
 
+        long long detectTime() const;
+        long long size() const;
+        uint labelHash() const;
+
     private:
         long long m_detectTime;
         long long m_size;
         uint m_labelHash;
     };
 
+private Q_SLOTS:
+    void slotContentDetected(Solid::OpticalDisc::ContentTypes content);
+
 private:
 
     mutable Identity m_identity;
@@ -74,6 +85,34 @@ private:
     UdevQt::Device m_udevDevice;
 };
 
+/**
+ * Probes the content of a disc in a worker thread, one at a time per drive.
+ */
+class ContentDetection : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ContentDetection *start(const OpticalDisc::Identity &identity, const QByteArray &deviceFile);
+
+    const OpticalDisc::Identity &identity() const;
+
+Q_SIGNALS:
+    void finished(Solid::OpticalDisc::ContentTypes content);
+
+private Q_SLOTS:
+    void slotFinished();
+
+private:
+    ContentDetection(const OpticalDisc::Identity &identity, const QByteArray &deviceFile);
+
+    OpticalDisc::Identity m_identity;
+    QByteArray m_deviceFile;
+    QFutureWatcher<Solid::OpticalDisc::ContentTypes> m_watcher;
+
+    static QHash<QByteArray, ContentDetection *> s_running;
+};
+
 }
 }
 }
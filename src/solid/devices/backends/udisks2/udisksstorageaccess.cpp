@@ -21,8 +21,8 @@
 
 #include "udisksstorageaccess.h"
 #include "udisks2.h"
+#include "udisksdevicebackend.h"
 
-#include <QDomDocument>
 #include <QDBusConnection>
 #include <QApplication>
 #include <QWidget>
@@ -289,31 +289,7 @@ QString StorageAccess::generateReturnObjectPath()
 
 QString StorageAccess::clearTextPath() const
 {
-    const QString prefix = "/org/freedesktop/UDisks2/block_devices";
-    QDBusMessage call = QDBusMessage::createMethodCall(UD2_DBUS_SERVICE, prefix,
-                        DBUS_INTERFACE_INTROSPECT, "Introspect");
-    QDBusPendingReply<QString> reply = QDBusConnection::systemBus().asyncCall(call);
-    reply.waitForFinished();
-
-    if (reply.isValid()) {
-        QDomDocument dom;
-        dom.setContent(reply.value());
-        QDomNodeList nodeList = dom.documentElement().elementsByTagName("node");
-        for (int i = 0; i < nodeList.count(); i++) {
-            QDomElement nodeElem = nodeList.item(i).toElement();
-            if (!nodeElem.isNull() && nodeElem.hasAttribute("name")) {
-                const QString udi = prefix + "/" + nodeElem.attribute("name");
-                Device holderDevice(udi);
-
-                if (m_device->udi() == holderDevice.prop("CryptoBackingDevice").value<QDBusObjectPath>().path()) {
-                    //qDebug() << Q_FUNC_INFO << "CLEARTEXT device path: " << udi;
-                    return udi;
-                }
-            }
-        }
-    }
-
-    return QString();
+    return DeviceBackend::clearTextDevice(m_device->udi());
 }
 
 bool StorageAccess::requestPassphrase()
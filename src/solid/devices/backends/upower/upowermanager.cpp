@@ -23,59 +23,50 @@
 #include "upowerdevice.h"
 #include "upower.h"
 
-#include <QtDBus/QDBusReply>
+#include <QtDBus/QDBusPendingReply>
 #include <QtCore/QDebug>
 #include <QtDBus/QDBusMetaType>
-#include <QtDBus/QDBusConnectionInterface>
 
 #include "../shared/rootdevice.h"
 
 using namespace Solid::Backends::UPower;
 using namespace Solid::Backends::Shared;
 
+static QDBusMessage enumerateDevicesCall()
+{
+    return QDBusMessage::createMethodCall(UP_DBUS_SERVICE, UP_DBUS_PATH, UP_DBUS_INTERFACE, "EnumerateDevices");
+}
+
 UPowerManager::UPowerManager(QObject *parent)
     : Solid::Ifaces::DeviceManager(parent),
-      m_manager(UP_DBUS_SERVICE,
-                UP_DBUS_PATH,
-                UP_DBUS_INTERFACE,
-                QDBusConnection::systemBus())
+      m_serviceWatcher(UP_DBUS_SERVICE,
+                       QDBusConnection::systemBus(),
+                       QDBusServiceWatcher::WatchForRegistration)
 {
-    m_supportedInterfaces
-            << Solid::DeviceInterface::GenericInterface
-            << Solid::DeviceInterface::Battery;
+    m_supportedInterfaces = supportedInterfaceTypes();
 
     qDBusRegisterMetaType<QList<QDBusObjectPath> >();
     qDBusRegisterMetaType<QVariantMap>();
 
-    bool serviceFound = m_manager.isValid();
-    if (!serviceFound) {
-        // find out whether it will be activated automatically
-        QDBusMessage message = QDBusMessage::createMethodCall("org.freedesktop.DBus",
-                               "/org/freedesktop/DBus",
-                               "org.freedesktop.DBus",
-                               "ListActivatableNames");
-
-        QDBusReply<QStringList> reply = QDBusConnection::systemBus().call(message);
-        if (reply.isValid() && reply.value().contains(UP_DBUS_SERVICE)) {
-            QDBusConnection::systemBus().interface()->startService(UP_DBUS_SERVICE);
-            serviceFound = true;
-        }
-    }
-
-    if (serviceFound) {
-        if (m_manager.metaObject()->indexOfSignal("DeviceAdded(QDBusObjectPath)") != -1) {
-            // for UPower >= 0.99.0, changed signature :o/
-            connect(&m_manager, SIGNAL(DeviceAdded(QDBusObjectPath)),
-                    this, SLOT(onDeviceAdded(QDBusObjectPath)));
-            connect(&m_manager, SIGNAL(DeviceRemoved(QDBusObjectPath)),
-                    this, SLOT(onDeviceRemoved(QDBusObjectPath)));
-        } else {
-            connect(&m_manager, SIGNAL(DeviceAdded(QString)),
-                    this, SIGNAL(deviceAdded(QString)));
-            connect(&m_manager, SIGNAL(DeviceRemoved(QString)),
-                    this, SIGNAL(deviceRemoved(QString)));
-        }
-    }
+    m_serviceWatcher.setParent(this);
+
+    /* No introspection to find out which UPower this is: UPower >= 0.99.0 passes
+     * object paths along with its signals, older ones strings, each signature only
+     * reaches the matching slot */
+    QDBusConnection::systemBus().connect(UP_DBUS_SERVICE, UP_DBUS_PATH, UP_DBUS_INTERFACE, "DeviceAdded",
+                                         this, SLOT(onDeviceAdded(QDBusObjectPath)));
+    QDBusConnection::systemBus().connect(UP_DBUS_SERVICE, UP_DBUS_PATH, UP_DBUS_INTERFACE, "DeviceRemoved",
+                                         this, SLOT(onDeviceRemoved(QDBusObjectPath)));
+    QDBusConnection::systemBus().connect(UP_DBUS_SERVICE, UP_DBUS_PATH, UP_DBUS_INTERFACE, "DeviceAdded",
+                                         this, SLOT(onDeviceAdded(QString)));
+    QDBusConnection::systemBus().connect(UP_DBUS_SERVICE, UP_DBUS_PATH, UP_DBUS_INTERFACE, "DeviceRemoved",
+                                         this, SLOT(onDeviceRemoved(QString)));
+
+    connect(&m_serviceWatcher, SIGNAL(serviceRegistered(QString)),
+            this, SLOT(startEnumeration()));
+
+    // The first call activates UPower if needed, without waiting for it here
+    QMetaObject::invokeMethod(this, "startEnumeration", Qt::QueuedConnection);
 }
 
 UPowerManager::~UPowerManager()
@@ -93,7 +84,7 @@ QObject *UPowerManager::createDevice(const QString &udi)
 
         return root;
 
-    } else if (allDevices().contains(udi)) {
+    } else if (isKnown(udi)) {
         return new UPowerDevice(udi);
 
     } else {
@@ -139,40 +130,110 @@ QStringList UPowerManager::devicesFromQuery(const QString &parentUdi, Solid::Dev
 
 QStringList UPowerManager::allDevices()
 {
-    QDBusReply<QList<QDBusObjectPath> > reply = m_manager.call("EnumerateDevices");
-
-    if (!reply.isValid()) {
-        qWarning() << Q_FUNC_INFO << " error: " << reply.error().name();
-        return QStringList();
-    }
-
+    /* Never wait for UPower here: the enumeration started along with the manager
+     * and the hotplug signals keep m_knownDevices current, and what the enumeration
+     * brings after this call gets announced */
     QStringList retList;
     retList << udiPrefix();
 
-    Q_FOREACH (const QDBusObjectPath &path, reply.value()) {
-        retList << path.path();
-    }
-
+    QMutexLocker locker(&m_knownDevicesMutex);
+    retList += m_knownDevices.toList();
     return retList;
 }
 
+bool UPowerManager::isKnown(const QString &udi)
+{
+    QMutexLocker locker(&m_knownDevicesMutex);
+    return m_knownDevices.contains(udi);
+}
+
 QSet< Solid::DeviceInterface::Type > UPowerManager::supportedInterfaces() const
 {
     return m_supportedInterfaces;
 }
 
+QSet<Solid::DeviceInterface::Type> UPowerManager::supportedInterfaceTypes()
+{
+    return QSet<Solid::DeviceInterface::Type>()
+            << Solid::DeviceInterface::GenericInterface
+            << Solid::DeviceInterface::Battery;
+}
+
 QString UPowerManager::udiPrefix() const
 {
     return UP_UDI_PREFIX;
 }
 
+bool UPowerManager::isEnumerationThreadSafe() const
+{
+    // Everything comes from the bus, what was already reported is guarded
+    return true;
+}
+
 void UPowerManager::onDeviceAdded(const QDBusObjectPath &path)
 {
-    emit deviceAdded(path.path());
+    onDeviceAdded(path.path());
 }
 
 void UPowerManager::onDeviceRemoved(const QDBusObjectPath &path)
 {
-    emit deviceRemoved(path.path());
+    onDeviceRemoved(path.path());
+}
+
+void UPowerManager::onDeviceAdded(const QString &udi)
+{
+    m_knownDevicesMutex.lock();
+    m_knownDevices.insert(udi);
+    m_knownDevicesMutex.unlock();
+
+    emit deviceAdded(udi);
+}
+
+void UPowerManager::onDeviceRemoved(const QString &udi)
+{
+    m_knownDevicesMutex.lock();
+    m_knownDevices.remove(udi);
+    m_knownDevicesMutex.unlock();
+
+    emit deviceRemoved(udi);
+}
+
+void UPowerManager::startEnumeration()
+{
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(enumerateDevicesCall()), this);
+    connect(watcher, SIGNAL(finished(QDBusPendingCallWatcher*)),
+            this, SLOT(onDevicesEnumerated(QDBusPendingCallWatcher*)));
 }
 
+void UPowerManager::onDevicesEnumerated(QDBusPendingCallWatcher *watcher)
+{
+    QDBusPendingReply<QList<QDBusObjectPath> > reply = *watcher;
+    watcher->deleteLater();
+
+    if (reply.isError()) {
+        // Not there yet, m_serviceWatcher tells us when it is
+        qDebug() << "UPower not available:" << reply.error().name() << reply.error().message();
+        return;
+    }
+
+    QSet<QString> devices;
+    Q_FOREACH (const QDBusObjectPath &path, reply.value()) {
+        devices.insert(path.path());
+    }
+
+    // What allDevices() didn't return yet is news, even if it was there all along;
+    // a restarted service may also have lost some
+    m_knownDevicesMutex.lock();
+    const QSet<QString> added = devices - m_knownDevices;
+    const QSet<QString> removed = m_knownDevices - devices;
+    m_knownDevices = devices;
+    m_knownDevicesMutex.unlock();
+
+    Q_FOREACH (const QString &udi, removed) {
+        emit deviceRemoved(udi);
+    }
+
+    Q_FOREACH (const QString &udi, added) {
+        emit deviceAdded(udi);
+    }
+}
@@ -25,7 +25,10 @@
 
 #include "solid/devices/ifaces/devicemanager.h"
 
-#include <QtDBus/QDBusInterface>
+#include <QtDBus/QDBusObjectPath>
+#include <QtDBus/QDBusPendingCallWatcher>
+#include <QtDBus/QDBusServiceWatcher>
+#include <QtCore/QMutex>
 #include <QtCore/QSet>
 
 namespace Solid
@@ -46,15 +49,29 @@ public:
     QStringList devicesFromQuery(const QString &parentUdi, Solid::DeviceInterface::Type type) Q_DECL_OVERRIDE;
     QStringList allDevices() Q_DECL_OVERRIDE;
     QSet< Solid::DeviceInterface::Type > supportedInterfaces() const Q_DECL_OVERRIDE;
+    /**
+     * What supportedInterfaces() answers, known without constructing a manager
+     */
+    static QSet<Solid::DeviceInterface::Type> supportedInterfaceTypes();
     QString udiPrefix() const Q_DECL_OVERRIDE;
+    bool isEnumerationThreadSafe() const Q_DECL_OVERRIDE;
 
 private Q_SLOTS:
     void onDeviceAdded(const QDBusObjectPath &path);
     void onDeviceRemoved(const QDBusObjectPath &path);
+    void onDeviceAdded(const QString &udi);
+    void onDeviceRemoved(const QString &udi);
+    void startEnumeration();
+    void onDevicesEnumerated(QDBusPendingCallWatcher *watcher);
 
 private:
+    bool isKnown(const QString &udi);
+
     QSet<Solid::DeviceInterface::Type> m_supportedInterfaces;
-    QDBusInterface m_manager;
+    QDBusServiceWatcher m_serviceWatcher;
+    // The devices allDevices() answers with, or announced with deviceAdded()
+    QSet<QString> m_knownDevices;
+    QMutex m_knownDevicesMutex;
 };
 
 }
@@ -53,6 +53,8 @@
 #include <solid/battery.h>
 #include <solid/devices/ifaces/battery.h>
 
+#include <QtCore/QThread>
+
 Solid::Device::Device(const QString &udi)
 {
     DeviceManagerPrivate *manager
@@ -60,6 +62,21 @@ Solid::Device::Device(const QString &udi)
     d = manager->findRegisteredDevice(udi);
 }
 
+static void release(QExplicitlySharedDataPointer<Solid::DevicePrivate> &d)
+{
+    /* A device found by a worker thread lives in the manager's thread along with its
+     * backend object, which may be in the middle of delivering a signal there: when the
+     * worker drops the last reference, the deletion has to happen over there too */
+    Solid::DevicePrivate *data = d.data();
+    if (data && QThread::currentThread() != data->thread()) {
+        data->ref.ref();
+        d.reset();
+        if (!data->ref.deref()) {
+            data->deleteLater();
+        }
+    }
+}
+
 Solid::Device::Device(const Device &device)
     : d(device.d)
 {
@@ -67,11 +84,15 @@ Solid::Device::Device(const Device &device)
 
 Solid::Device::~Device()
 {
+    release(d);
 }
 
 Solid::Device &Solid::Device::operator=(const Solid::Device &device)
 {
-    d = device.d;
+    if (d != device.d) {
+        release(d);
+        d = device.d;
+    }
     return *this;
 }
 
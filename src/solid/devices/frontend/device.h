@@ -22,6 +22,7 @@
 #define SOLID_DEVICE_H
 
 #include <QtCore/QVariant>
+#include <QtCore/QFuture>
 
 #include <QtCore/QMap>
 #include <QtCore/QList>
@@ -92,6 +93,42 @@ public:
     static QList<Device> listFromQuery(const QString &predicate,
                                        const QString &parentUdi = QString());
 
+    /**
+     * Asynchronous version of allDevices().
+     *
+     * The backends are queried from a worker thread, the calling thread is
+     * never blocked waiting on them. Use a QFutureWatcher to be notified in
+     * the calling thread when the list is ready.
+     *
+     * @return a future holding the list of the devices available
+     * @since 5.25
+     */
+    static QFuture<QList<Device> > allDevicesAsync();
+
+    /**
+     * Asynchronous version of listFromType(), see allDevicesAsync().
+     *
+     * @since 5.25
+     */
+    static QFuture<QList<Device> > listFromTypeAsync(const DeviceInterface::Type &type,
+                                                     const QString &parentUdi = QString());
+
+    /**
+     * Asynchronous version of listFromQuery(), see allDevicesAsync().
+     *
+     * @since 5.25
+     */
+    static QFuture<QList<Device> > listFromQueryAsync(const Predicate &predicate,
+                                                      const QString &parentUdi = QString());
+
+    /**
+     * Convenience function see above.
+     *
+     * @since 5.25
+     */
+    static QFuture<QList<Device> > listFromQueryAsync(const QString &predicate,
+                                                      const QString &parentUdi = QString());
+
     /**
      * Constructs a device for a given Universal Device Identifier (UDI).
      *
@@ -24,61 +24,79 @@
 #include "device.h"
 #include "device_p.h"
 #include "predicate.h"
+#include "predicate_p.h"
+#include "queryplan_p.h"
 
 #include "ifaces/devicemanager.h"
 #include "ifaces/device.h"
 
 #include "soliddefs_p.h"
 
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMetaMethod>
+#include <QtCore/QThread>
+#include <QtConcurrent/QtConcurrentRun>
+
 Q_GLOBAL_STATIC(Solid::DeviceManagerStorage, globalDeviceStorage)
 
 Solid::DeviceManagerPrivate::DeviceManagerPrivate()
-    : m_nullDevice(new DevicePrivate(QString()))
+    : m_nullDevice(new DevicePrivate(QString())),
+      m_batchTimer(new QTimer(this))
 {
-    loadBackends();
+    m_batchTimer->setSingleShot(true);
+    m_batchTimer->setInterval(0);
+    connect(m_batchTimer, SIGNAL(timeout()), this, SLOT(_k_flushBatch()));
 
-    QList<QObject *> backends = managerBackends();
-    Q_FOREACH (QObject *backend, backends) {
-        connect(backend, SIGNAL(deviceAdded(QString)),
-                this, SLOT(_k_deviceAdded(QString)));
-        connect(backend, SIGNAL(deviceRemoved(QString)),
-                this, SLOT(_k_deviceRemoved(QString)));
-    }
+    loadBackends();
 }
 
 Solid::DeviceManagerPrivate::~DeviceManagerPrivate()
 {
-    QList<QObject *> backends = managerBackends();
+    QList<QObject *> backends = loadedBackends();
     Q_FOREACH (QObject *backend, backends) {
         disconnect(backend, 0, this, 0);
     }
 
-    Q_FOREACH (QPointer<DevicePrivate> dev, m_devicesMap) {
-        if (!dev.data()->ref.deref()) {
-            delete dev.data();
+    Q_FOREACH (DevicePrivate *dev, m_devicesMap) {
+        if (!dev->ref.deref()) {
+            delete dev;
         }
     }
 
     m_devicesMap.clear();
 }
 
-QList<Solid::Device> Solid::Device::allDevices()
+static QStringList backendDevices(QObject *backendObj)
 {
-    QList<Device> list;
-    QList<QObject *> backends = globalDeviceStorage->managerBackends();
+    Solid::Ifaces::DeviceManager *backend = qobject_cast<Solid::Ifaces::DeviceManager *>(backendObj);
 
-    Q_FOREACH (QObject *backendObj, backends) {
-        Ifaces::DeviceManager *backend = qobject_cast<Ifaces::DeviceManager *>(backendObj);
+    if (backend == 0) {
+        return QStringList();
+    }
 
-        if (backend == 0) {
-            continue;
-        }
+    return backend->allDevices();
+}
 
-        QStringList udis = backend->allDevices();
+static QStringList allBackendDevices()
+{
+    QStringList udis;
+    Solid::DeviceManagerPrivate *manager = globalDeviceStorage->manager();
+    const QList<QStringList> perBackend = manager->fanOut(manager->managerBackends(), &backendDevices);
 
-        Q_FOREACH (const QString &udi, udis) {
-            list.append(Device(udi));
-        }
+    Q_FOREACH (const QStringList &backendUdis, perBackend) {
+        udis += backendUdis;
+    }
+
+    return udis;
+}
+
+QList<Solid::Device> Solid::Device::allDevices()
+{
+    QList<Device> list;
+    const QStringList udis = allBackendDevices();
+
+    Q_FOREACH (const QString &udi, udis) {
+        list.append(Device(udi));
     }
 
     return list;
@@ -100,23 +118,13 @@ QList<Solid::Device> Solid::Device::listFromType(const DeviceInterface::Type &ty
         const QString &parentUdi)
 {
     QList<Device> list;
-    QList<QObject *> backends = globalDeviceStorage->managerBackends();
-
-    Q_FOREACH (QObject *backendObj, backends) {
-        Ifaces::DeviceManager *backend = qobject_cast<Ifaces::DeviceManager *>(backendObj);
-
-        if (backend == 0) {
-            continue;
-        }
-        if (!backend->supportedInterfaces().contains(type)) {
-            continue;
-        }
+    QSet<DeviceInterface::Type> types;
+    types << type;
 
-        QStringList udis = backend->devicesFromQuery(parentUdi, type);
+    const QStringList udis = globalDeviceStorage->manager()->indexedDevices(types, parentUdi);
 
-        Q_FOREACH (const QString &udi, udis) {
-            list.append(Device(udi));
-        }
+    Q_FOREACH (const QString &udi, udis) {
+        list.append(Device(udi));
     }
 
     return list;
@@ -126,178 +134,738 @@ QList<Solid::Device> Solid::Device::listFromQuery(const Predicate &predicate,
         const QString &parentUdi)
 {
     QList<Device> list;
-    QList<QObject *> backends = globalDeviceStorage->managerBackends();
-    QSet<DeviceInterface::Type> usedTypes = predicate.usedTypes();
+    QStringList udis;
 
-    Q_FOREACH (QObject *backendObj, backends) {
-        Ifaces::DeviceManager *backend = qobject_cast<Ifaces::DeviceManager *>(backendObj);
+    bool exact = false;
 
-        if (backend == 0) {
+    if (predicate.isValid()) {
+        udis = globalDeviceStorage->manager()->plannedDevices(predicate, parentUdi, &exact);
+    } else {
+        udis = allBackendDevices();
+    }
+
+    const CompiledPredicate program(predicate);
+
+    QSet<QString> seen;
+    Q_FOREACH (const QString &udi, udis) {
+        if (seen.contains(udi)) {
             continue;
         }
+        seen.insert(udi);
+        Device dev(udi);
 
-        QStringList udis;
-        if (predicate.isValid()) {
-            QSet<DeviceInterface::Type> supportedTypes = backend->supportedInterfaces();
-            if (supportedTypes.intersect(usedTypes).isEmpty()) {
-                continue;
-            }
+        bool matches = false;
 
-            Q_FOREACH (DeviceInterface::Type type, supportedTypes) {
-                udis += backend->devicesFromQuery(parentUdi, type);
-            }
+        if (!predicate.isValid() || exact) {
+            matches = true;
         } else {
-            udis += backend->allDevices();
+            matches = program.matches(dev);
         }
 
-        QSet<QString> seen;
-        Q_FOREACH (const QString &udi, udis) {
-            if (seen.contains(udi)) {
-                continue;
-            }
-            seen.insert(udi);
-            Device dev(udi);
-
-            bool matches = false;
-
-            if (!predicate.isValid()) {
-                matches = true;
-            } else {
-                matches = predicate.matches(dev);
-            }
-
-            if (matches) {
-                list.append(dev);
-            }
+        if (matches) {
+            list.append(dev);
         }
     }
 
     return list;
 }
 
+QString Solid::explainQuery(const QString &predicate, const QString &parentUdi)
+{
+    return globalDeviceStorage->manager()->explainQuery(predicate, parentUdi);
+}
+
+QFuture<QList<Solid::Device> > Solid::Device::allDevicesAsync()
+{
+    return QtConcurrent::run(&Device::allDevices);
+}
+
+QFuture<QList<Solid::Device> > Solid::Device::listFromTypeAsync(const DeviceInterface::Type &type,
+        const QString &parentUdi)
+{
+    return QtConcurrent::run(&Device::listFromType, type, parentUdi);
+}
+
+QFuture<QList<Solid::Device> > Solid::Device::listFromQueryAsync(const Predicate &predicate,
+        const QString &parentUdi)
+{
+    QList<Device> (*query)(const Predicate &, const QString &) = &Device::listFromQuery;
+    return QtConcurrent::run(query, predicate, parentUdi);
+}
+
+QFuture<QList<Solid::Device> > Solid::Device::listFromQueryAsync(const QString &predicate,
+        const QString &parentUdi)
+{
+    QList<Device> (*query)(const QString &, const QString &) = &Device::listFromQuery;
+    return QtConcurrent::run(query, predicate, parentUdi);
+}
+
 Solid::DeviceNotifier *Solid::DeviceNotifier::instance()
 {
     return globalDeviceStorage->notifier();
 }
 
+// Takes a reference on dev, unless another thread is already dropping the last one
+static bool tryRef(Solid::DevicePrivate *dev)
+{
+    int count = dev->ref.load();
+
+    while (count > 0) {
+        if (dev->ref.testAndSetOrdered(count, count + 1)) {
+            return true;
+        }
+        count = dev->ref.load();
+    }
+
+    return false;
+}
+
+QExplicitlySharedDataPointer<Solid::DevicePrivate> Solid::DeviceManagerPrivate::registeredDevice(const QString &udi) const
+{
+    // Must be called with m_devicesLock held
+    QExplicitlySharedDataPointer<DevicePrivate> result;
+    DevicePrivate *dev = m_devicesMap.value(udi);
+
+    if (dev && tryRef(dev)) {
+        result = dev;
+        dev->ref.deref();
+    }
+
+    return result;
+}
+
 void Solid::DeviceManagerPrivate::_k_deviceAdded(const QString &udi)
 {
-    if (m_devicesMap.contains(udi)) {
-        DevicePrivate *dev = m_devicesMap[udi].data();
+    m_devicesLock.lockForRead();
+    QExplicitlySharedDataPointer<DevicePrivate> dev = registeredDevice(udi);
+    m_devicesLock.unlock();
 
-        // Ok, this one was requested somewhere was invalid
-        // and now becomes magically valid!
+    // Ok, this one was requested somewhere was invalid
+    // and now becomes magically valid!
 
-        if (dev && dev->backendObject() == 0) {
-            dev->setBackendObject(createBackendObject(udi));
-            Q_ASSERT(dev->backendObject() != 0);
-        }
+    if (dev && dev->backendObject() == 0) {
+        dev->setBackendObject(createBackendObject(udi));
+        Q_ASSERT(dev->backendObject() != 0);
+    }
+
+    const bool indexReady = isIndexed(sender(), udi);
+
+    // Also covers known devices which got new interfaces
+    IndexEntry entry;
+    bool described = false;
+    if (indexReady) {
+        QMutexLocker locker(backendMutex(sender()));
+        described = describeDevice(sender(), udi, &entry);
+    }
+
+    if (described) {
+        QWriteLocker locker(&m_indexLock);
+        removeIndexEntry(udi);
+        insertIndexEntry(udi, entry);
     }
 
     emit deviceAdded(udi);
+    queueBatchedChange(udi, true);
 }
 
 void Solid::DeviceManagerPrivate::_k_deviceRemoved(const QString &udi)
 {
-    if (m_devicesMap.contains(udi)) {
-        DevicePrivate *dev = m_devicesMap[udi].data();
+    m_devicesLock.lockForRead();
+    QExplicitlySharedDataPointer<DevicePrivate> dev = registeredDevice(udi);
+    m_devicesLock.unlock();
 
-        // Ok, this one was requested somewhere was valid
-        // and now becomes magically invalid!
+    // Ok, this one was requested somewhere was valid
+    // and now becomes magically invalid!
 
-        if (dev) {
-            Q_ASSERT(dev->backendObject() != 0);
-            dev->setBackendObject(0);
-            Q_ASSERT(dev->backendObject() == 0);
-        }
+    if (dev) {
+        Q_ASSERT(dev->backendObject() != 0);
+        dev->setBackendObject(0);
+        Q_ASSERT(dev->backendObject() == 0);
     }
 
+    // Noted as well if its backend is being described for the index
+    isIndexed(sender(), udi);
+
+    m_indexLock.lockForWrite();
+    removeIndexEntry(udi);
+    m_indexLock.unlock();
+
     emit deviceRemoved(udi);
+    queueBatchedChange(udi, false);
+}
+
+void Solid::DeviceManagerPrivate::_k_deviceChanged(const QString &udi)
+{
+    if (isIndexed(sender(), udi)) {
+        reindexDevice(sender(), udi);
+    }
+}
+
+void Solid::DeviceManagerPrivate::reindexDevice(QObject *backend, const QString &udi)
+{
+    // File it again under the interfaces it provides now
+    IndexEntry entry;
+    bool described = false;
+    {
+        QMutexLocker locker(backendMutex(backend));
+        described = describeDevice(backend, udi, &entry);
+    }
+
+    QWriteLocker locker(&m_indexLock);
+    removeIndexEntry(udi);
+    if (described) {
+        insertIndexEntry(udi, entry);
+    }
+}
+
+bool Solid::DeviceManagerPrivate::isIndexed(QObject *backend, const QString &udi)
+{
+    QWriteLocker locker(&m_indexLock);
+
+    if (m_indexedBackends.contains(backend)) {
+        return true;
+    }
+
+    // What the backend's description may have missed is looked at again once it is merged
+    QHash<QObject *, QSet<QString> >::iterator it = m_indexingChanges.find(backend);
+    if (it != m_indexingChanges.end()) {
+        it->insert(udi);
+    }
+
+    return false;
+}
+
+void Solid::DeviceManagerPrivate::queueBatchedChange(const QString &udi, bool added)
+{
+    static const QMetaMethod devicesChangedSignal = QMetaMethod::fromSignal(&DeviceNotifier::devicesChanged);
+
+    if (!isSignalConnected(devicesChangedSignal)) {
+        return;
+    }
+
+    if (added) {
+        if (!m_batchAddedSet.contains(udi)) {
+            m_batchAddedSet.insert(udi);
+            m_batchAdded << udi;
+        }
+    } else {
+        // Whatever happened before, the last word is that it's gone.
+        // Dropped from the set only, the list is filtered when flushed
+        m_batchAddedSet.remove(udi);
+        if (!m_batchRemovedSet.contains(udi)) {
+            m_batchRemovedSet.insert(udi);
+            m_batchRemoved << udi;
+        }
+    }
+
+    if (!m_batchTimer->isActive()) {
+        m_batchTimer->start();
+    }
+}
+
+void Solid::DeviceManagerPrivate::_k_flushBatch()
+{
+    QStringList added;
+    QStringList removed;
+
+    // In the order they came, once each, unless they went away since
+    Q_FOREACH (const QString &udi, m_batchAdded) {
+        if (m_batchAddedSet.remove(udi)) {
+            added << udi;
+        }
+    }
+    m_batchAdded.clear();
+
+    removed.swap(m_batchRemoved);
+    m_batchRemovedSet.clear();
+
+    if (!added.isEmpty() || !removed.isEmpty()) {
+        emit devicesChanged(added, removed);
+    }
+}
+
+void Solid::DeviceManagerPrivate::setBatchInterval(int msec)
+{
+    m_batchTimer->setInterval(qMax(0, msec));
+}
+
+int Solid::DeviceManagerPrivate::batchInterval() const
+{
+    return m_batchTimer->interval();
+}
+
+void Solid::DeviceNotifier::setBatchInterval(int msec)
+{
+    // The notifier is always the device manager, see instance()
+    static_cast<DeviceManagerPrivate *>(this)->setBatchInterval(msec);
+}
+
+int Solid::DeviceNotifier::batchInterval() const
+{
+    return static_cast<const DeviceManagerPrivate *>(this)->batchInterval();
 }
 
 void Solid::DeviceManagerPrivate::_k_destroyed(QObject *object)
 {
+    QWriteLocker locker(&m_devicesLock);
     QString udi = m_reverseMap.take(object);
 
-    if (!udi.isEmpty()) {
+    // Another thread might already have registered a replacement
+    if (!udi.isEmpty() && m_devicesMap.value(udi) == object) {
         m_devicesMap.remove(udi);
     }
 }
 
-Solid::DevicePrivate *Solid::DeviceManagerPrivate::findRegisteredDevice(const QString &udi)
+QExplicitlySharedDataPointer<Solid::DevicePrivate> Solid::DeviceManagerPrivate::findRegisteredDevice(const QString &udi)
 {
     if (udi.isEmpty()) {
-        return m_nullDevice.data();
-    } else if (m_devicesMap.contains(udi)) {
-        return m_devicesMap[udi].data();
+        return m_nullDevice;
+    }
+
+    {
+        QReadLocker locker(&m_devicesLock);
+        QExplicitlySharedDataPointer<DevicePrivate> dev = registeredDevice(udi);
+        if (dev) {
+            return dev;
+        }
+    }
+
+    // Don't keep the other threads waiting while the backend does its work
+    Ifaces::Device *iface = createBackendObject(udi);
+
+    QWriteLocker locker(&m_devicesLock);
+
+    // Somebody could have registered it in the meantime
+    QExplicitlySharedDataPointer<DevicePrivate> dev = registeredDevice(udi);
+    if (dev) {
+        delete iface;
+        return dev;
+    }
+
+    DevicePrivate *devData = new DevicePrivate(udi);
+
+    // Created by a worker thread, which won't be there to deliver
+    // their signals: the backend notifications go through our thread,
+    // and so does their deletion (see Solid::Device's destructor)
+    if (QThread::currentThread() != thread()) {
+        if (iface) {
+            iface->moveToThread(thread());
+        }
+        devData->moveToThread(thread());
+    }
+
+    devData->setBackendObject(iface);
+
+    // Reference it before it gets visible to other threads
+    dev = devData;
+    m_devicesMap[udi] = devData;
+    m_reverseMap[devData] = udi;
+
+    connect(devData, SIGNAL(destroyed(QObject*)),
+            this, SLOT(_k_destroyed(QObject*)), Qt::DirectConnection);
+
+    return dev;
+}
+
+QStringList Solid::DeviceManagerPrivate::indexedDevices(const QSet<DeviceInterface::Type> &types,
+        const QString &parentUdi)
+{
+    ensureIndexed(types);
+
+    QReadLocker locker(&m_indexLock);
+    QSet<QString> candidates;
+
+    if (!parentUdi.isEmpty()) {
+        Q_FOREACH (const QString &udi, m_childrenIndex.value(parentUdi)) {
+            const QSet<DeviceInterface::Type> deviceTypes = m_indexEntries.value(udi).types;
+            Q_FOREACH (DeviceInterface::Type type, types) {
+                if (deviceTypes.contains(type)) {
+                    candidates << udi;
+                    break;
+                }
+            }
+        }
     } else {
-        Ifaces::Device *iface = createBackendObject(udi);
+        Q_FOREACH (DeviceInterface::Type type, types) {
+            candidates += m_typeIndex.value(type);
+        }
+    }
+
+    return orderedDevices(candidates);
+}
 
-        DevicePrivate *devData = new DevicePrivate(udi);
-        devData->setBackendObject(iface);
+QStringList Solid::DeviceManagerPrivate::plannedDevices(const Predicate &predicate, const QString &parentUdi,
+        bool *exact, QStringList *explanation)
+{
+    ensureIndexed(predicate.usedTypes());
 
-        QPointer<DevicePrivate> ptr(devData);
-        m_devicesMap[udi] = ptr;
-        m_reverseMap[devData] = udi;
+    QReadLocker locker(&m_indexLock);
+    QSet<QString> candidates = planCandidates(predicate, exact, 0, explanation);
 
-        connect(devData, SIGNAL(destroyed(QObject*)),
-                this, SLOT(_k_destroyed(QObject*)));
+    if (!parentUdi.isEmpty()) {
+        candidates &= m_childrenIndex.value(parentUdi);
 
-        return devData;
+        if (explanation) {
+            explanation->append(QStringLiteral("children of %1: %2 candidates").arg(parentUdi).arg(candidates.size()));
+        }
     }
+
+    return orderedDevices(candidates);
 }
 
-Solid::Ifaces::Device *Solid::DeviceManagerPrivate::createBackendObject(const QString &udi)
+QString Solid::DeviceManagerPrivate::explainQuery(const QString &predicate, const QString &parentUdi)
 {
-    QList<QObject *> backends = globalDeviceStorage->managerBackends();
+    const Predicate p = Predicate::fromString(predicate);
 
-    Q_FOREACH (QObject *backendObj, backends) {
-        Ifaces::DeviceManager *backend = qobject_cast<Ifaces::DeviceManager *>(backendObj);
+    if (!p.isValid()) {
+        return QStringLiteral("invalid predicate");
+    }
 
-        if (backend == 0) {
-            continue;
+    QStringList explanation;
+    bool exact = false;
+    const QStringList udis = plannedDevices(p, parentUdi, &exact, &explanation);
+
+    if (exact) {
+        explanation << QStringLiteral("%1 devices, no check needed").arg(udis.size());
+    } else {
+        const CompiledPredicate program(p);
+        int matching = 0;
+        Q_FOREACH (const QString &udi, udis) {
+            matching += program.matches(Device(udi)) ? 1 : 0;
+        }
+        explanation << QStringLiteral("%1 devices checked, %2 matching").arg(udis.size()).arg(matching);
+    }
+
+    return explanation.join(QLatin1Char('\n'));
+}
+
+QSet<QString> Solid::DeviceManagerPrivate::planCandidates(const Predicate &predicate, bool *exact,
+        int depth, QStringList *explanation) const
+{
+    // Must be called with m_indexLock held
+    QSet<QString> candidates;
+    QString step;
+    QStringList operandLines;
+
+    if (!predicate.isValid()) {
+        // Nothing matches an invalid predicate
+        *exact = true;
+        step = QStringLiteral("False");
+    } else if (predicate.type() == Predicate::Conjunction || predicate.type() == Predicate::Disjunction) {
+        QStringList *operandExplanation = explanation ? &operandLines : 0;
+        bool firstExact, secondExact;
+        const QSet<QString> first = planCandidates(predicate.firstOperand(), &firstExact, depth + 1, operandExplanation);
+        const QSet<QString> second = planCandidates(predicate.secondOperand(), &secondExact, depth + 1, operandExplanation);
+
+        if (predicate.type() == Predicate::Conjunction) {
+            const QSet<QString> &smaller = (first.size() < second.size()) ? first : second;
+            const QSet<QString> &larger = (first.size() < second.size()) ? second : first;
+            Q_FOREACH (const QString &udi, smaller) {
+                if (larger.contains(udi)) {
+                    candidates << udi;
+                }
+            }
+            step = QStringLiteral("AND");
+        } else {
+            candidates = first;
+            candidates += second;
+            step = QStringLiteral("OR");
         }
-        if (!udi.startsWith(backend->udiPrefix())) {
+        *exact = firstExact && secondExact;
+    } else {
+        // The interface alone decides an interface check, not a property check
+        candidates = m_typeIndex.value(predicate.interfaceType());
+        *exact = (predicate.type() == Predicate::InterfaceCheck);
+        step = predicate.toString();
+    }
+
+    if (explanation) {
+        explanation->append(QStringLiteral("%1%2: %3 candidates%4")
+                            .arg(QString(depth * 2, QLatin1Char(' ')), step)
+                            .arg(candidates.size())
+                            .arg(*exact ? QString() : QStringLiteral(", checked one by one")));
+        *explanation += operandLines;
+    }
+
+    return candidates;
+}
+
+QStringList Solid::DeviceManagerPrivate::orderedDevices(const QSet<QString> &udis) const
+{
+    // Must be called with m_indexLock held
+    // Keep the answer stable: grouped in backend order, sorted by UDI
+    QStringList result;
+    Q_FOREACH (QObject *backend, loadedBackends()) {
+        QStringList group;
+        Q_FOREACH (const QString &udi, udis) {
+            if (m_indexEntries.value(udi).backend == backend) {
+                group << udi;
+            }
+        }
+        group.sort();
+        result += group;
+    }
+
+    return result;
+}
+
+void Solid::DeviceManagerPrivate::ensureIndexed(const QSet<DeviceInterface::Type> &types)
+{
+    // Only the backends able to answer get loaded and indexed
+    const QList<QObject *> backends = managerBackends(types);
+
+    m_indexLock.lockForRead();
+    bool indexReady = true;
+    Q_FOREACH (QObject *backend, backends) {
+        indexReady = indexReady && m_indexedBackends.contains(backend);
+    }
+    m_indexLock.unlock();
+
+    if (indexReady) {
+        return;
+    }
+
+    // Some might have been indexed in the meantime
+    QList<QObject *> missing;
+    m_indexLock.lockForWrite();
+    Q_FOREACH (QObject *backend, backends) {
+        if (!m_indexedBackends.contains(backend)) {
+            missing << backend;
+            if (!m_indexingChanges.contains(backend)) {
+                m_indexingChanges.insert(backend, QSet<QString>());
+            }
+        }
+    }
+    m_indexLock.unlock();
+
+    // Described without the lock, the hotplug notifications keep coming meanwhile
+    const QList<BackendEntries> perBackend = fanOut(missing, &DeviceManagerPrivate::describeBackend);
+
+    QList<QPair<QObject *, QString> > changed;
+    m_indexLock.lockForWrite();
+    for (int i = 0; i < missing.size(); ++i) {
+        QObject *backend = missing.at(i);
+        if (m_indexedBackends.contains(backend)) {
+            // Another thread was faster
             continue;
         }
 
-        Ifaces::Device *iface = 0;
+        // Merged in backend order, the first backend to report a device owns it
+        const BackendEntries &entries = perBackend.at(i);
+        for (int j = 0; j < entries.size(); ++j) {
+            if (!m_indexEntries.contains(entries.at(j).first)) {
+                insertIndexEntry(entries.at(j).first, entries.at(j).second);
+            }
+        }
+
+        m_indexedBackends.insert(backend);
+        Q_FOREACH (const QString &udi, m_indexingChanges.take(backend)) {
+            changed << qMakePair(backend, udi);
+        }
+    }
+    m_indexLock.unlock();
+
+    // The devices which came, went or changed while the backends were described
+    for (int i = 0; i < changed.size(); ++i) {
+        reindexDevice(changed.at(i).first, changed.at(i).second);
+    }
+}
+
+Solid::DeviceManagerPrivate::BackendEntries Solid::DeviceManagerPrivate::describeBackend(QObject *backendObj)
+{
+    BackendEntries entries;
+    const QStringList udis = backendDevices(backendObj);
+
+    Q_FOREACH (const QString &udi, udis) {
+        IndexEntry entry;
+        if (describeDevice(backendObj, udi, &entry)) {
+            entries << qMakePair(udi, entry);
+        }
+    }
+
+    return entries;
+}
+
+bool Solid::DeviceManagerPrivate::describeDevice(QObject *backendObj, const QString &udi, IndexEntry *entry)
+{
+    Ifaces::DeviceManager *backend = qobject_cast<Ifaces::DeviceManager *>(backendObj);
+
+    if (backend == 0) {
+        return false;
+    }
+
+    QObject *object = backend->createDevice(udi);
+    Ifaces::Device *device = qobject_cast<Ifaces::Device *>(object);
+
+    if (device == 0) {
+        delete object;
+        return false;
+    }
+
+    entry->backend = backendObj;
+    entry->parentUdi = device->parentUdi();
+    entry->types.clear();
+
+    Q_FOREACH (DeviceInterface::Type type, backend->supportedInterfaces()) {
+        if (device->queryDeviceInterface(type)) {
+            entry->types << type;
+        }
+    }
+
+    delete object;
+    return true;
+}
+
+void Solid::DeviceManagerPrivate::insertIndexEntry(const QString &udi, const IndexEntry &entry)
+{
+    // Must be called with m_indexLock held for writing
+    m_indexEntries.insert(udi, entry);
+
+    Q_FOREACH (DeviceInterface::Type type, entry.types) {
+        m_typeIndex[type].insert(udi);
+    }
+
+    if (!entry.parentUdi.isEmpty()) {
+        m_childrenIndex[entry.parentUdi].insert(udi);
+    }
+}
+
+void Solid::DeviceManagerPrivate::removeIndexEntry(const QString &udi)
+{
+    // Must be called with m_indexLock held for writing
+    QHash<QString, IndexEntry>::iterator it = m_indexEntries.find(udi);
 
-        QObject *object = backend->createDevice(udi);
-        iface = qobject_cast<Ifaces::Device *>(object);
+    if (it == m_indexEntries.end()) {
+        return;
+    }
 
-        if (iface == 0) {
-            delete object;
+    Q_FOREACH (DeviceInterface::Type type, it->types) {
+        QSet<QString> &udis = m_typeIndex[type];
+        udis.remove(udi);
+        if (udis.isEmpty()) {
+            m_typeIndex.remove(type);
         }
+    }
 
-        return iface;
+    if (!it->parentUdi.isEmpty()) {
+        QSet<QString> &children = m_childrenIndex[it->parentUdi];
+        children.remove(udi);
+        if (children.isEmpty()) {
+            m_childrenIndex.remove(it->parentUdi);
+        }
     }
 
-    return 0;
+    m_indexEntries.erase(it);
+}
+
+Solid::Ifaces::Device *Solid::DeviceManagerPrivate::createBackendObject(const QString &udi)
+{
+    QObject *backendObj = managerBackendForUdi(udi);
+    Ifaces::DeviceManager *backend = qobject_cast<Ifaces::DeviceManager *>(backendObj);
+
+    if (backend == 0) {
+        return 0;
+    }
+
+    Ifaces::Device *iface = 0;
+    QMutexLocker locker(backendMutex(backendObj));
+
+    QObject *object = backend->createDevice(udi);
+    iface = qobject_cast<Ifaces::Device *>(object);
+
+    if (iface == 0) {
+        delete object;
+    }
+
+    return iface;
+}
+
+void Solid::DeviceManagerPrivate::connectNotify(const QMetaMethod &signal)
+{
+    // Whoever listens to hotplug events wants them from every backend. Not
+    // loading them right here, connecting them to us could deadlock
+    if (signal == QMetaMethod::fromSignal(&DeviceNotifier::deviceAdded)
+            || signal == QMetaMethod::fromSignal(&DeviceNotifier::deviceRemoved)
+            || signal == QMetaMethod::fromSignal(&DeviceNotifier::devicesChanged)) {
+        QMetaObject::invokeMethod(this, "_k_loadAllBackends", Qt::QueuedConnection);
+    }
+}
+
+void Solid::DeviceManagerPrivate::_k_loadAllBackends()
+{
+    managerBackends();
+}
+
+void Solid::DeviceManagerPrivate::backendLoaded(QObject *backend)
+{
+    // Loaded on demand, maybe by a worker thread: the notifications
+    // have to come through the manager's thread
+    if (backend->thread() != thread()) {
+        backend->moveToThread(thread());
+    }
+
+    connect(backend, SIGNAL(deviceAdded(QString)),
+            this, SLOT(_k_deviceAdded(QString)));
+    connect(backend, SIGNAL(deviceRemoved(QString)),
+            this, SLOT(_k_deviceRemoved(QString)));
+    connect(backend, SIGNAL(deviceChanged(QString)),
+            this, SLOT(_k_deviceChanged(QString)));
 }
 
 Solid::DeviceManagerStorage::DeviceManagerStorage()
+    : m_manager(0)
 {
 
 }
 
+Solid::DeviceManagerStorage::~DeviceManagerStorage()
+{
+    delete m_manager.load();
+}
+
 QList<QObject *> Solid::DeviceManagerStorage::managerBackends()
 {
-    ensureManagerCreated();
-    return m_storage.localData()->managerBackends();
+    return ensureManagerCreated()->managerBackends();
 }
 
 Solid::DeviceNotifier *Solid::DeviceManagerStorage::notifier()
 {
-    ensureManagerCreated();
-    return m_storage.localData();
+    return ensureManagerCreated();
 }
 
-void Solid::DeviceManagerStorage::ensureManagerCreated()
+Solid::DeviceManagerPrivate *Solid::DeviceManagerStorage::manager()
 {
-    if (!m_storage.hasLocalData()) {
-        m_storage.setLocalData(new DeviceManagerPrivate());
+    return ensureManagerCreated();
+}
+
+Solid::DeviceManagerPrivate *Solid::DeviceManagerStorage::ensureManagerCreated()
+{
+    DeviceManagerPrivate *manager = m_manager.loadAcquire();
+
+    if (manager) {
+        return manager;
     }
+
+    QMutexLocker locker(&m_creationMutex);
+
+    manager = m_manager.loadAcquire();
+    if (!manager) {
+        manager = new DeviceManagerPrivate();
+
+        // The creating thread might be a short lived worker, the backends
+        // have to keep receiving their notifications once it's gone
+        QCoreApplication *app = QCoreApplication::instance();
+        if (app && manager->thread() != app->thread()) {
+            Q_FOREACH (QObject *backend, manager->loadedBackends()) {
+                backend->moveToThread(app->thread());
+            }
+            manager->moveToThread(app->thread());
+        }
+
+        m_manager.storeRelease(manager);
+    }
+
+    return manager;
 }
 
 #include "moc_devicemanager_p.cpp"
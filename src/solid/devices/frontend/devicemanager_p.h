@@ -24,11 +24,18 @@
 #include "managerbase_p.h"
 
 #include "devicenotifier.h"
+#include "deviceinterface.h"
+#include "predicate.h"
 
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QHash>
 #include <QtCore/QMap>
-#include <QtCore/QPointer>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QSet>
 #include <QtCore/QSharedData>
-#include <QtCore/QThreadStorage>
+#include <QtCore/QTimer>
 
 namespace Solid
 {
@@ -45,33 +52,121 @@ public:
     DeviceManagerPrivate();
     ~DeviceManagerPrivate();
 
-    DevicePrivate *findRegisteredDevice(const QString &udi);
+    /**
+     * Returns the shared device data for @p udi, creating it if needed.
+     * Safe to call from any thread, lookups of already registered devices
+     * only take a read lock.
+     */
+    QExplicitlySharedDataPointer<DevicePrivate> findRegisteredDevice(const QString &udi);
+
+    /**
+     * Returns the UDIs of the devices providing at least one of @p types,
+     * restricted to the children of @p parentUdi if it isn't empty.
+     * Answered from an index built on first use and kept current with
+     * the backends hotplug and change notifications.
+     */
+    QStringList indexedDevices(const QSet<DeviceInterface::Type> &types,
+                               const QString &parentUdi);
+
+    /**
+     * Returns the UDIs of the devices which can match @p predicate, from
+     * the index: conjunctions intersect the candidates of their operands
+     * and disjunctions unite them. @p exact is set when every candidate is
+     * known to match already, otherwise the predicate still has to be
+     * checked on each of them. If @p explanation is given, it receives a
+     * line per step of the plan.
+     */
+    QStringList plannedDevices(const Predicate &predicate, const QString &parentUdi,
+                               bool *exact, QStringList *explanation = 0);
+
+    /**
+     * Describes the plan of plannedDevices() for @p predicate, a line per
+     * step, and how many of the candidates match. See explainQuery().
+     */
+    QString explainQuery(const QString &predicate, const QString &parentUdi);
+
+    void setBatchInterval(int msec);
+    int batchInterval() const;
+
+protected:
+    void backendLoaded(QObject *backend) Q_DECL_OVERRIDE;
+    void connectNotify(const QMetaMethod &signal) Q_DECL_OVERRIDE;
 
 private Q_SLOTS:
     void _k_deviceAdded(const QString &udi);
     void _k_deviceRemoved(const QString &udi);
+    void _k_deviceChanged(const QString &udi);
     void _k_destroyed(QObject *object);
+    void _k_flushBatch();
+    void _k_loadAllBackends();
 
 private:
     Ifaces::Device *createBackendObject(const QString &udi);
+    QExplicitlySharedDataPointer<DevicePrivate> registeredDevice(const QString &udi) const;
+
+    struct IndexEntry {
+        IndexEntry() : backend(0) {}
+
+        QObject *backend;
+        QString parentUdi;
+        QSet<DeviceInterface::Type> types;
+    };
+
+    void queueBatchedChange(const QString &udi, bool added);
+
+    void ensureIndexed(const QSet<DeviceInterface::Type> &types);
+    bool isIndexed(QObject *backend, const QString &udi);
+    void reindexDevice(QObject *backend, const QString &udi);
+    QSet<QString> planCandidates(const Predicate &predicate, bool *exact,
+                                 int depth, QStringList *explanation) const;
+    QStringList orderedDevices(const QSet<QString> &udis) const;
+    typedef QList<QPair<QString, IndexEntry> > BackendEntries;
+    static BackendEntries describeBackend(QObject *backend);
+    static bool describeDevice(QObject *backend, const QString &udi, IndexEntry *entry);
+    void insertIndexEntry(const QString &udi, const IndexEntry &entry);
+    void removeIndexEntry(const QString &udi);
 
     QExplicitlySharedDataPointer<DevicePrivate> m_nullDevice;
-    QMap<QString, QPointer<DevicePrivate> > m_devicesMap;
-    QMap<QObject *, QString> m_reverseMap;
+    mutable QReadWriteLock m_devicesLock;
+    QHash<QString, DevicePrivate *> m_devicesMap;
+    QHash<QObject *, QString> m_reverseMap;
+
+    QReadWriteLock m_indexLock;
+    QSet<QObject *> m_indexedBackends;
+    // The backends being described for the index, with the devices they notified meanwhile
+    QHash<QObject *, QSet<QString> > m_indexingChanges;
+    QHash<QString, IndexEntry> m_indexEntries;
+    QHash<DeviceInterface::Type, QSet<QString> > m_typeIndex;
+    QHash<QString, QSet<QString> > m_childrenIndex;
+
+    QTimer *m_batchTimer;
+    // The pending changes in arrival order, and the same as sets for the lookups
+    QStringList m_batchAdded;
+    QSet<QString> m_batchAddedSet;
+    QStringList m_batchRemoved;
+    QSet<QString> m_batchRemovedSet;
 };
 
+/**
+ * Holds the process-wide device manager. It is created once, by whichever
+ * thread first needs it, and then handed over to the main thread so that
+ * backend signals are always delivered from there.
+ */
 class DeviceManagerStorage
 {
 public:
     DeviceManagerStorage();
+    ~DeviceManagerStorage();
 
     QList<QObject *> managerBackends();
     DeviceNotifier *notifier();
+    DeviceManagerPrivate *manager();
 
 private:
-    void ensureManagerCreated();
+    DeviceManagerPrivate *ensureManagerCreated();
 
-    QThreadStorage<DeviceManagerPrivate *> m_storage;
+    QMutex m_creationMutex;
+    QAtomicPointer<DeviceManagerPrivate> m_manager;
 };
 }
 
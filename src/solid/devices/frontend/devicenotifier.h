@@ -23,6 +23,7 @@
 
 #include <QtCore/QObject>
 #include <QtCore/QList>
+#include <QtCore/QStringList>
 
 #include <solid/solid_export.h>
 
@@ -45,6 +46,24 @@ class SOLID_EXPORT DeviceNotifier : public QObject //krazy:exclude=dpointer (int
 public:
     static DeviceNotifier *instance();
 
+    /**
+     * Sets how long changes are gathered before devicesChanged() reports them.
+     *
+     * The window starts with the first change after the previous report, so
+     * no change is delayed by more than @p msec. With 0, the default, the
+     * changes are reported once control returns to the event loop.
+     *
+     * @param msec the length of the window in milliseconds
+     * @since 5.25
+     */
+    void setBatchInterval(int msec);
+
+    /**
+     * @return how long changes are gathered before devicesChanged() reports them
+     * @since 5.25
+     */
+    int batchInterval() const;
+
 Q_SIGNALS:
     /**
      * This signal is emitted when a new device appear in the underlying system.
@@ -59,6 +78,24 @@ Q_SIGNALS:
      * @param udi the old device UDI
      */
     void deviceRemoved(const QString &udi);
+
+    /**
+     * This signal is emitted with all the devices which appeared or disappeared
+     * during the last batch interval, for consumers which would rather process
+     * a hotplug storm at once than once per device. It is only emitted when
+     * something is connected to it, and always after the deviceAdded() and
+     * deviceRemoved() signals of the same changes.
+     *
+     * Apply @p removed before @p added: a device which got unplugged and
+     * plugged back is listed in both. A device which appeared and disappeared
+     * during the interval is only listed in @p removed.
+     *
+     * @param added the UDIs of the new devices, in order of appearance
+     * @param removed the UDIs of the old devices, in order of disappearance
+     * @see setBatchInterval()
+     * @since 5.25
+     */
+    void devicesChanged(const QStringList &added, const QStringList &removed);
 };
 }
 
@@ -137,6 +137,11 @@ public:
      * Retrieves the content types this disc contains (audio, video,
      * data...).
      *
+     * Some backends don't block the GUI thread on a spinning drive: the
+     * answer may only tell about data and audio tracks at first, and
+     * Solid::GenericInterface::propertyChanged() then reports a change of
+     * "availableContent" once the disc was probed.
+     *
      * @return the flag set indicating the available contents
      * @see Solid::OpticalDisc::ContentType
      */
@@ -19,35 +19,25 @@
 */
 
 #include "predicate.h"
+#include "predicate_p.h"
 
 #include <solid/device.h>
 #include <solid/deviceinterface.h>
+#include <solid/genericinterface.h>
+#include <solid/processor.h>
+#include <solid/block.h>
+#include <solid/storageaccess.h>
+#include <solid/storagedrive.h>
+#include <solid/opticaldrive.h>
+#include <solid/storagevolume.h>
+#include <solid/opticaldisc.h>
+#include <solid/camera.h>
+#include <solid/portablemediaplayer.h>
+#include <solid/battery.h>
+#include <solid/networkshare.h>
 #include <QtCore/QStringList>
 #include <QtCore/QMetaEnum>
 
-namespace Solid
-{
-class Predicate::Private
-{
-public:
-
-    Private() : isValid(false), type(PropertyCheck),
-        compOperator(Predicate::Equals),
-        operand1(0), operand2(0) {}
-
-    bool isValid;
-    Type type;
-
-    DeviceInterface::Type ifaceType;
-    QString property;
-    QVariant value;
-    Predicate::ComparisonOperator compOperator;
-
-    Predicate *operand1;
-    Predicate *operand2;
-};
-}
-
 Solid::Predicate::Predicate()
     : d(new Private())
 {
@@ -365,3 +355,184 @@ Solid::Predicate Solid::Predicate::secondOperand() const
     return Predicate();
 }
 
+// The frontend class asDeviceInterface() hands out for each type
+static const QMetaObject *metaObjectForType(Solid::DeviceInterface::Type type)
+{
+    switch (type) {
+    case Solid::DeviceInterface::GenericInterface:
+        return &Solid::GenericInterface::staticMetaObject;
+    case Solid::DeviceInterface::Processor:
+        return &Solid::Processor::staticMetaObject;
+    case Solid::DeviceInterface::Block:
+        return &Solid::Block::staticMetaObject;
+    case Solid::DeviceInterface::StorageAccess:
+        return &Solid::StorageAccess::staticMetaObject;
+    case Solid::DeviceInterface::StorageDrive:
+        return &Solid::StorageDrive::staticMetaObject;
+    case Solid::DeviceInterface::OpticalDrive:
+        return &Solid::OpticalDrive::staticMetaObject;
+    case Solid::DeviceInterface::StorageVolume:
+        return &Solid::StorageVolume::staticMetaObject;
+    case Solid::DeviceInterface::OpticalDisc:
+        return &Solid::OpticalDisc::staticMetaObject;
+    case Solid::DeviceInterface::Camera:
+        return &Solid::Camera::staticMetaObject;
+    case Solid::DeviceInterface::PortableMediaPlayer:
+        return &Solid::PortableMediaPlayer::staticMetaObject;
+    case Solid::DeviceInterface::Battery:
+        return &Solid::Battery::staticMetaObject;
+    case Solid::DeviceInterface::NetworkShare:
+        return &Solid::NetworkShare::staticMetaObject;
+    case Solid::DeviceInterface::Unknown:
+    case Solid::DeviceInterface::Last:
+        break;
+    }
+
+    return 0;
+}
+
+Solid::CompiledPredicate::CompiledPredicate()
+{
+}
+
+Solid::CompiledPredicate::CompiledPredicate(const Predicate &predicate)
+{
+    if (predicate.isValid()) {
+        m_program.reserve(leafCount(predicate));
+        compile(predicate, Accept, Reject);
+    }
+}
+
+bool Solid::CompiledPredicate::isValid() const
+{
+    return !m_program.isEmpty();
+}
+
+int Solid::CompiledPredicate::instructionCount() const
+{
+    return m_program.size();
+}
+
+int Solid::CompiledPredicate::leafCount(const Predicate &predicate)
+{
+    if (predicate.d->isValid
+            && (predicate.d->type == Predicate::Conjunction || predicate.d->type == Predicate::Disjunction)) {
+        return leafCount(*predicate.d->operand1) + leafCount(*predicate.d->operand2);
+    }
+
+    return 1;
+}
+
+void Solid::CompiledPredicate::compile(const Predicate &predicate, int onTrue, int onFalse)
+{
+    const Predicate::Private *d = predicate.d;
+
+    if (d->isValid && (d->type == Predicate::Conjunction || d->type == Predicate::Disjunction)) {
+        // Leaves are laid out in order, so the second operand starts right after the first one's
+        const int second = m_program.size() + leafCount(*d->operand1);
+
+        if (d->type == Predicate::Conjunction) {
+            compile(*d->operand1, second, onFalse);
+        } else {
+            compile(*d->operand1, onTrue, second);
+        }
+        compile(*d->operand2, onTrue, onFalse);
+        return;
+    }
+
+    Instruction instruction;
+    instruction.onTrue = onTrue;
+    instruction.onFalse = onFalse;
+    compileLeaf(predicate, &instruction);
+    m_program.append(instruction);
+}
+
+void Solid::CompiledPredicate::compileLeaf(const Predicate &predicate, Instruction *instruction) const
+{
+    const Predicate::Private *d = predicate.d;
+
+    instruction->op = AlwaysFalse;
+    instruction->ifaceType = d->ifaceType;
+    instruction->metaObject = 0;
+    instruction->mask = 0;
+    instruction->maskValid = false;
+
+    if (!d->isValid) {
+        return;
+    }
+
+    if (d->type == Predicate::InterfaceCheck) {
+        instruction->op = InterfaceCheck;
+        return;
+    }
+
+    instruction->op = (d->compOperator == Predicate::Mask) ? PropertyMask : PropertyEquals;
+    instruction->metaObject = metaObjectForType(d->ifaceType);
+    instruction->propertyName = d->property.toLatin1();
+    instruction->expected = d->value;
+
+    if (!instruction->metaObject) {
+        return;
+    }
+
+    // Same resolution as Predicate::matches() does for every device
+    const int index = instruction->metaObject->indexOfProperty(instruction->propertyName.constData());
+    instruction->property = instruction->metaObject->property(index);
+
+    if (instruction->property.isEnumType() && d->value.type() == QVariant::String) {
+        const int value = instruction->property.enumerator().keysToValue(d->value.toString().toLatin1().constData());
+        instruction->expected = (value >= 0) ? QVariant(value) : QVariant();
+    }
+
+    instruction->mask = instruction->expected.toInt(&instruction->maskValid);
+}
+
+bool Solid::CompiledPredicate::matches(const Device &device) const
+{
+    if (m_program.isEmpty()) {
+        return false;
+    }
+
+    // Jumps only go forward, ending on Accept or Reject
+    int pc = 0;
+    while (pc >= 0) {
+        const Instruction &instruction = m_program.at(pc);
+        pc = execute(instruction, device) ? instruction.onTrue : instruction.onFalse;
+    }
+
+    return pc == Accept;
+}
+
+bool Solid::CompiledPredicate::execute(const Instruction &instruction, const Device &device) const
+{
+    switch (instruction.op) {
+    case InterfaceCheck:
+        return device.isDeviceInterface(instruction.ifaceType);
+    case PropertyEquals:
+    case PropertyMask:
+        break;
+    case AlwaysFalse:
+        return false;
+    }
+
+    const DeviceInterface *iface = device.asDeviceInterface(instruction.ifaceType);
+    if (!iface) {
+        return false;
+    }
+
+    if (iface->metaObject() != instruction.metaObject) {
+        // Not the class we compiled for, look the property up the slow way
+        return Predicate(instruction.ifaceType, QString::fromLatin1(instruction.propertyName), instruction.expected,
+                         instruction.op == PropertyMask ? Predicate::Mask : Predicate::Equals).matches(device);
+    }
+
+    const QVariant value = instruction.property.isReadable() ? instruction.property.read(iface) : QVariant();
+
+    if (instruction.op == PropertyMask) {
+        bool ok;
+        const int v = value.toInt(&ok);
+        return ok && instruction.maskValid && (v & instruction.mask);
+    }
+
+    return value == instruction.expected;
+}
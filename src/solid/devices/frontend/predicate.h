@@ -263,6 +263,7 @@ public:
     Predicate secondOperand() const;
 
 private:
+    friend class CompiledPredicate;
     class Private;
     Private *const d;
 };
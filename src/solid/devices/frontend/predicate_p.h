@@ -0,0 +1,101 @@
+/*
+    Copyright 2006 Kevin Ottens <ervin@kde.org>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) version 3, or any
+    later version accepted by the membership of KDE e.V. (or its
+    successor approved by the membership of KDE e.V.), which shall
+    act as a proxy defined in Section 6 of version 3 of the license.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOLID_PREDICATE_P_H
+#define SOLID_PREDICATE_P_H
+
+#include "predicate.h"
+
+#include <QtCore/QMetaProperty>
+#include <QtCore/QVariant>
+#include <QtCore/QVector>
+
+namespace Solid
+{
+class Device;
+
+class Predicate::Private
+{
+public:
+
+    Private() : isValid(false), type(PropertyCheck),
+        compOperator(Predicate::Equals),
+        operand1(0), operand2(0) {}
+
+    bool isValid;
+    Type type;
+
+    DeviceInterface::Type ifaceType;
+    QString property;
+    QVariant value;
+    Predicate::ComparisonOperator compOperator;
+
+    Predicate *operand1;
+    Predicate *operand2;
+};
+
+/**
+ * A Predicate flattened into a list of instructions, for matching it
+ * against many devices.
+ *
+ * Everything that only depends on the predicate is resolved once, when
+ * compiling: the meta object of each interface, the index of each property
+ * and the value of enum keys. Conjunctions and disjunctions become jumps
+ * between the instructions, so matching walks the list without recursion
+ * and without allocating anything beyond what reading the properties does.
+ */
+class CompiledPredicate
+{
+public:
+    CompiledPredicate();
+    explicit CompiledPredicate(const Predicate &predicate);
+
+    bool isValid() const;
+    bool matches(const Device &device) const;
+
+    int instructionCount() const;
+
+private:
+    enum OpCode { InterfaceCheck, PropertyEquals, PropertyMask, AlwaysFalse };
+    enum { Accept = -1, Reject = -2 };
+
+    struct Instruction {
+        OpCode op;
+        DeviceInterface::Type ifaceType;
+        const QMetaObject *metaObject;
+        QMetaProperty property;
+        QByteArray propertyName;
+        QVariant expected;
+        int mask;
+        bool maskValid;
+        int onTrue;
+        int onFalse;
+    };
+
+    static int leafCount(const Predicate &predicate);
+    void compile(const Predicate &predicate, int onTrue, int onFalse);
+    void compileLeaf(const Predicate &predicate, Instruction *instruction) const;
+    bool execute(const Instruction &instruction, const Device &device) const;
+
+    QVector<Instruction> m_program;
+};
+}
+
+#endif
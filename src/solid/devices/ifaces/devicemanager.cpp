@@ -31,3 +31,7 @@ Solid::Ifaces::DeviceManager::~DeviceManager()
 
 }
 
+bool Solid::Ifaces::DeviceManager::isEnumerationThreadSafe() const
+{
+    return false;
+}
@@ -94,6 +94,21 @@ public:
      */
     virtual QObject *createDevice(const QString &udi) = 0;
 
+    /**
+     * Tells whether allDevices(), devicesFromQuery() and createDevice() can
+     * be called from a worker thread while the other backends are queried
+     * as well. Backends sharing no state with the others, and guarding
+     * their own, should return true so that queries don't wait on them
+     * one after another.
+     *
+     * Backends returning false are still called from any thread, only one
+     * at a time; the state their own slots change meanwhile has to be
+     * guarded all the same.
+     *
+     * The default implementation returns false.
+     */
+    virtual bool isEnumerationThreadSafe() const;
+
 Q_SIGNALS:
     /**
      * This signal is emitted when a new device appears in the system.
@@ -108,6 +123,14 @@ Q_SIGNALS:
      * @param udi the old device identifier
      */
     void deviceRemoved(const QString &udi);
+
+    /**
+     * This signal is emitted when a device may provide other interfaces
+     * than before, while staying in the system.
+     *
+     * @param udi the changed device identifier
+     */
+    void deviceChanged(const QString &udi);
 };
 }
 }
@@ -33,24 +33,39 @@
 #include "backends/hal/halmanager.h"
 #include "backends/udisks2/udisksmanager.h"
 #include "backends/upower/upowermanager.h"
+#include "backends/upower/upower.h"
 
 #if UDEV_FOUND
 #include "backends/udev/udevmanager.h"
+#include "backends/udev/udev.h"
 #endif
 
 #include "backends/fstab/fstabmanager.h"
+#include "backends/fstab/fstabservice.h"
 
 #elif defined (Q_OS_WIN) && !defined(_WIN32_WCE)
 #include "backends/win/windevicemanager.h"
 #endif
 
+#if defined(Q_OS_LINUX)
+template<class Manager>
+static QObject *createManager()
+{
+    return new Manager(0);
+}
+#endif
+
 Solid::ManagerBasePrivate::ManagerBasePrivate()
 {
 }
 
 Solid::ManagerBasePrivate::~ManagerBasePrivate()
 {
-    qDeleteAll(m_backends);
+    qDeleteAll(loadedBackends());
+
+    Q_FOREACH (const Backend &backend, m_backends) {
+        delete backend.mutex;
+    }
 }
 
 void Solid::ManagerBasePrivate::loadBackends()
@@ -58,34 +73,185 @@ void Solid::ManagerBasePrivate::loadBackends()
     QString solidFakeXml(QString::fromLocal8Bit(qgetenv("SOLID_FAKEHW")));
 
     if (!solidFakeXml.isEmpty()) {
-        m_backends << new Solid::Backends::Fake::FakeManager(0, solidFakeXml);
+        addBackend(new Solid::Backends::Fake::FakeManager(0, solidFakeXml));
     } else {
 #        if defined(Q_OS_MAC)
-        m_backends << new Solid::Backends::IOKit::IOKitManager(0);
+        addBackend(new Solid::Backends::IOKit::IOKitManager(0));
 
 #        elif defined(Q_OS_FREEBSD)
-        m_backends << new Solid::Backends::UPower::UPowerManager(0)
-                   << new Solid::Backends::Hal::HalManager(0)
-                   << new Solid::Backends::Fstab::FstabManager(0);
+        addBackend(new Solid::Backends::UPower::UPowerManager(0));
+        addBackend(new Solid::Backends::Hal::HalManager(0));
+        addBackend(new Solid::Backends::Fstab::FstabManager(0));
 
 #        elif defined(Q_OS_WIN) && !defined(_WIN32_WCE)
-        m_backends << new Solid::Backends::Win::WinDeviceManager(0);
+        addBackend(new Solid::Backends::Win::WinDeviceManager(0));
 #        elif defined(Q_OS_UNIX) && !defined(Q_OS_LINUX)
-        m_backends << new Solid::Backends::Hal::HalManager(0);
+        addBackend(new Solid::Backends::Hal::HalManager(0));
 
 #        elif defined(Q_OS_LINUX)
+        // Constructing them talks to the system bus or reads files, only do
+        // it once something asks for the interfaces or the UDIs they provide.
 #               if UDEV_FOUND
-            m_backends << new Solid::Backends::UDev::UDevManager(0);
-            m_backends << new Solid::Backends::UDisks2::Manager(0);
+            addBackend(QStringLiteral(UDEV_UDI_PREFIX),
+                       Solid::Backends::UDev::UDevManager::supportedInterfaceTypes(),
+                       &createManager<Solid::Backends::UDev::UDevManager>);
+            addBackend(QStringLiteral(UD2_UDI_DISKS_PREFIX),
+                       Solid::Backends::UDisks2::Manager::supportedInterfaceTypes(),
+                       &createManager<Solid::Backends::UDisks2::Manager>);
 #               endif
-            m_backends << new Solid::Backends::UPower::UPowerManager(0)
-                       << new Solid::Backends::Fstab::FstabManager(0);
+            addBackend(QStringLiteral(UP_UDI_PREFIX),
+                       Solid::Backends::UPower::UPowerManager::supportedInterfaceTypes(),
+                       &createManager<Solid::Backends::UPower::UPowerManager>);
+            addBackend(QStringLiteral(FSTAB_UDI_PREFIX),
+                       Solid::Backends::Fstab::FstabManager::supportedInterfaceTypes(),
+                       &createManager<Solid::Backends::Fstab::FstabManager>);
 #        endif
     }
 }
 
-QList<QObject *> Solid::ManagerBasePrivate::managerBackends() const
+void Solid::ManagerBasePrivate::addBackend(QObject *backend)
+{
+    Ifaces::DeviceManager *manager = qobject_cast<Ifaces::DeviceManager *>(backend);
+
+    Backend entry;
+    setObject(entry, backend);
+    if (manager) {
+        entry.udiPrefix = manager->udiPrefix();
+        entry.types = manager->supportedInterfaces();
+    }
+
+    m_backendsMutex.lock();
+    m_backends << entry;
+    m_backendsMutex.unlock();
+
+    backendLoaded(backend);
+}
+
+void Solid::ManagerBasePrivate::addBackend(const QString &udiPrefix, const QSet<DeviceInterface::Type> &types,
+                                           BackendFactory factory)
+{
+    Backend entry;
+    entry.udiPrefix = udiPrefix;
+    entry.types = types;
+    entry.factory = factory;
+
+    QMutexLocker locker(&m_backendsMutex);
+    m_backends << entry;
+}
+
+QObject *Solid::ManagerBasePrivate::ensureLoaded(Backend &backend, QList<QObject *> *loaded)
+{
+    // Must be called with m_backendsMutex held
+    if (!backend.object && backend.factory) {
+        setObject(backend, backend.factory());
+
+        Q_ASSERT(qobject_cast<Ifaces::DeviceManager *>(backend.object));
+        Q_ASSERT(qobject_cast<Ifaces::DeviceManager *>(backend.object)->udiPrefix() == backend.udiPrefix);
+        Q_ASSERT(qobject_cast<Ifaces::DeviceManager *>(backend.object)->supportedInterfaces() == backend.types);
+
+        *loaded << backend.object;
+    }
+
+    return backend.object;
+}
+
+void Solid::ManagerBasePrivate::announceLoaded(const QList<QObject *> &loaded)
+{
+    // Without m_backendsMutex held, backendLoaded() may need the backends
+    Q_FOREACH (QObject *backend, loaded) {
+        backendLoaded(backend);
+    }
+}
+
+void Solid::ManagerBasePrivate::setObject(Backend &backend, QObject *object)
+{
+    Ifaces::DeviceManager *manager = qobject_cast<Ifaces::DeviceManager *>(object);
+
+    backend.object = object;
+    if (!manager || !manager->isEnumerationThreadSafe()) {
+        backend.mutex = new QMutex(QMutex::Recursive);
+    }
+}
+
+QList<QObject *> Solid::ManagerBasePrivate::managerBackends()
+{
+    QList<QObject *> backends;
+    QList<QObject *> loaded;
+
+    m_backendsMutex.lock();
+    for (int i = 0; i < m_backends.size(); ++i) {
+        backends << ensureLoaded(m_backends[i], &loaded);
+    }
+    m_backendsMutex.unlock();
+
+    announceLoaded(loaded);
+    return backends;
+}
+
+QList<QObject *> Solid::ManagerBasePrivate::managerBackends(const QSet<DeviceInterface::Type> &types)
+{
+    QList<QObject *> backends;
+    QList<QObject *> loaded;
+
+    m_backendsMutex.lock();
+    for (int i = 0; i < m_backends.size(); ++i) {
+        if (m_backends.at(i).types.intersects(types)) {
+            backends << ensureLoaded(m_backends[i], &loaded);
+        }
+    }
+    m_backendsMutex.unlock();
+
+    announceLoaded(loaded);
+    return backends;
+}
+
+QObject *Solid::ManagerBasePrivate::managerBackendForUdi(const QString &udi)
+{
+    QObject *backend = 0;
+    QList<QObject *> loaded;
+
+    m_backendsMutex.lock();
+    for (int i = 0; i < m_backends.size(); ++i) {
+        if (udi.startsWith(m_backends.at(i).udiPrefix)) {
+            backend = ensureLoaded(m_backends[i], &loaded);
+            break;
+        }
+    }
+    m_backendsMutex.unlock();
+
+    announceLoaded(loaded);
+    return backend;
+}
+
+QList<QObject *> Solid::ManagerBasePrivate::loadedBackends() const
+{
+    QMutexLocker locker(&m_backendsMutex);
+    QList<QObject *> backends;
+
+    Q_FOREACH (const Backend &backend, m_backends) {
+        if (backend.object) {
+            backends << backend.object;
+        }
+    }
+
+    return backends;
+}
+
+QMutex *Solid::ManagerBasePrivate::backendMutex(QObject *backend) const
+{
+    QMutexLocker locker(&m_backendsMutex);
+
+    Q_FOREACH (const Backend &entry, m_backends) {
+        if (entry.object == backend) {
+            return entry.mutex;
+        }
+    }
+
+    return 0;
+}
+
+void Solid::ManagerBasePrivate::backendLoaded(QObject *backend)
 {
-    return m_backends;
+    Q_UNUSED(backend);
 }
 
@@ -21,10 +21,15 @@
 #ifndef SOLID_MANAGERBASE_P_H
 #define SOLID_MANAGERBASE_P_H
 
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
 #include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include "solid/solid_export.h"
+#include "ifaces/devicemanager.h"
 
 namespace Solid
 {
@@ -35,11 +40,112 @@ public:
     virtual ~ManagerBasePrivate();
     void loadBackends();
 
-    QList<QObject *> managerBackends() const;
+    /**
+     * Returns all the backends, constructing the ones not loaded yet.
+     */
+    QList<QObject *> managerBackends();
+
+    /**
+     * Returns the backends supporting at least one of @p types, only
+     * constructing those. Safe to call from any thread.
+     */
+    QList<QObject *> managerBackends(const QSet<DeviceInterface::Type> &types);
+
+    /**
+     * Returns the backend responsible for @p udi, constructing it if
+     * needed, or 0 if no backend handles that UDI prefix.
+     */
+    QObject *managerBackendForUdi(const QString &udi);
+
+    /**
+     * Returns the backends constructed so far, in backend order.
+     */
+    QList<QObject *> loadedBackends() const;
+
+    /**
+     * Returns the mutex to hold while calling into @p backend, or 0 if the
+     * backend is thread-safe for enumeration. All the threads share the
+     * same backends, the others must not be entered by two of them at once.
+     * The mutex is recursive, backends may call back into the manager.
+     * The backends' own slots don't take it: what they change on their
+     * thread while others enumerate is theirs to guard.
+     */
+    QMutex *backendMutex(QObject *backend) const;
+
+    /**
+     * Calls @p function on each of @p backends and returns the results in
+     * the order of the backends. The backends which are thread-safe for
+     * enumeration are handled concurrently from the global thread pool,
+     * the others one after another from the calling thread meanwhile, so
+     * the slowest backend sets the pace instead of the sum of them all.
+     */
+    template<typename T>
+    QList<T> fanOut(const QList<QObject *> &backends, T (*function)(QObject *)) const;
+
+protected:
+    /**
+     * Called right after @p backend got constructed, from the thread which
+     * needed it. The backends aren't locked anymore, so other threads may
+     * be handed the backend already.
+     */
+    virtual void backendLoaded(QObject *backend);
+
+    void addBackend(QObject *backend);
 
 private:
-    QList<QObject *> m_backends;
+    typedef QObject *(*BackendFactory)();
+
+    struct Backend {
+        Backend() : factory(0), object(0), mutex(0) {}
+
+        QString udiPrefix;
+        QSet<DeviceInterface::Type> types;
+        BackendFactory factory;
+        QObject *object;
+        QMutex *mutex;
+    };
+
+    static void setObject(Backend &backend, QObject *object);
+    void addBackend(const QString &udiPrefix, const QSet<DeviceInterface::Type> &types, BackendFactory factory);
+    QObject *ensureLoaded(Backend &backend, QList<QObject *> *loaded);
+    void announceLoaded(const QList<QObject *> &loaded);
+
+    mutable QMutex m_backendsMutex;
+    QList<Backend> m_backends;
 };
+
+template<typename T>
+QList<T> ManagerBasePrivate::fanOut(const QList<QObject *> &backends, T (*function)(QObject *)) const
+{
+    QVector<QFuture<T> > futures(backends.size());
+    QVector<bool> concurrent(backends.size(), false);
+    QVector<T> results(backends.size());
+
+    for (int i = 0; i < backends.size(); ++i) {
+        Ifaces::DeviceManager *backend = qobject_cast<Ifaces::DeviceManager *>(backends.at(i));
+        if (backend && backend->isEnumerationThreadSafe()) {
+            concurrent[i] = true;
+            futures[i] = QtConcurrent::run(function, backends.at(i));
+        }
+    }
+
+    for (int i = 0; i < backends.size(); ++i) {
+        if (!concurrent.at(i)) {
+            QMutexLocker locker(backendMutex(backends.at(i)));
+            results[i] = function(backends.at(i));
+        }
+    }
+
+    // Waiting runs the tasks the pool didn't start yet, no deadlock
+    // even when called from a thread of the pool itself
+    for (int i = 0; i < backends.size(); ++i) {
+        if (concurrent.at(i)) {
+            results[i] = futures.at(i).result();
+        }
+    }
+
+    return results.toList();
+}
 }
 
 #endif
@@ -37,6 +37,7 @@
 
 #include <iostream>
 #include <solid/devicenotifier.h>
+#include "solid/devices/frontend/queryplan_p.h"
 using namespace std;
 
 static const char appName[] = "solid-hardware";
@@ -193,6 +194,9 @@ int main(int argc, char **argv)
     QCommandLineOption commands("commands", QCoreApplication::translate("solid-hardware", "Show available commands"));
     parser.addOption(commands);
 
+    QCommandLineOption explain("explain", QCoreApplication::translate("solid-hardware", "Show how a query is answered"));
+    parser.addOption(explain);
+
     parser.process(app);
     if (parser.isSet(commands))
     {
@@ -219,12 +223,14 @@ int main(int argc, char **argv)
                 "             # Display all the properties of the device corresponding to 'udi'\n"
                 "             # (be careful, in this case property names are backend dependent).\n") << endl;
 
-        cout << "  solid-hardware query 'predicate' ['parentUdi']" << endl;
+        cout << "  solid-hardware query [--explain] 'predicate' ['parentUdi']" << endl;
         cout << QCoreApplication::translate("solid-hardware",
                 "             # List the UDI of devices corresponding to 'predicate'.\n"
                 "             # - If 'parentUdi' is specified, the search is restricted to the\n"
                 "             # branch of the corresponding device,\n"
-                "             # - Otherwise the search is done on all the devices.\n") << endl;
+                "             # - Otherwise the search is done on all the devices.\n"
+                "             # - If '--explain' is given, the query plan is shown first, with\n"
+                "             # the number of candidate devices of each step.\n") << endl;
 
         cout << "  solid-hardware mount 'udi'" << endl;
         cout << QCoreApplication::translate("solid-hardware",
@@ -284,7 +290,7 @@ int main(int argc, char **argv)
             parent = args.at(2);
         }
 
-        return app.hwQuery(parent, query);
+        return app.hwQuery(parent, query, parser.isSet(explain));
     } else if (command == "mount") {
         const QString udi = getUdiFromArguments(app, parser);
         return app.hwVolumeCall(SolidHardware::Mount, udi);
@@ -348,8 +354,13 @@ bool SolidHardware::hwProperties(const QString &udi)
     return true;
 }
 
-bool SolidHardware::hwQuery(const QString &parentUdi, const QString &query)
+bool SolidHardware::hwQuery(const QString &parentUdi, const QString &query, bool explain)
 {
+    if (explain)
+    {
+        cout << Solid::explainQuery(query, parentUdi) << endl;
+    }
+
     const QList<Solid::Device> devices
         = Solid::Device::listFromQuery(query, parentUdi);
 
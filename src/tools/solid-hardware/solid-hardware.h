@@ -36,7 +36,7 @@ public:
     bool hwList(bool interfaces, bool system);
     bool hwCapabilities(const QString &udi);
     bool hwProperties(const QString &udi);
-    bool hwQuery(const QString &parentUdi, const QString &query);
+    bool hwQuery(const QString &parentUdi, const QString &query, bool explain = false);
     bool listen();
 
     enum VolumeCallType { Mount, Unmount, Eject };